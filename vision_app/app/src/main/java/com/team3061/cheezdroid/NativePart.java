@@ -11,20 +11,165 @@ public class NativePart {
     public static final int DISP_MODE_TARGETS = 2;
     public static final int DISP_MODE_TARGETS_PLUS = 3;
 
+    // Target types, also the bit positions used by setEnabledMatchers()
+    public static final int TARGET_PEG = 0;
+    public static final int TARGET_BOILER = 1;
+
+    public static final int MATCHER_PEG = 1 << TARGET_PEG;
+    public static final int MATCHER_BOILER = 1 << TARGET_BOILER;
+
+    // Mask cleanup operations for setMorphology()
+    public static final int MORPH_NONE = 0;
+    public static final int MORPH_ERODE = 1;
+    public static final int MORPH_DILATE = 2;
+    public static final int MORPH_OPEN = 3;
+    public static final int MORPH_CLOSE = 4;
+
+    // Latency governor levels reported in TargetsInfo.governorLevel; each sheds more work
+    public static final int GOV_FULL = 0;
+    public static final int GOV_NO_VIS = 1;
+    public static final int GOV_DECIMATED = 2;
+    public static final int GOV_ROI_ONLY = 3;
+    public static final int GOV_FRAME_SKIP = 4;
+
+    /**
+     * Creates a native vision pipeline and returns an opaque handle to it. Each pipeline owns all
+     * of its buffers, so separate pipelines may be used concurrently from different threads, but
+     * a single handle must only be used by one thread at a time.
+     */
+    public static native long createPipeline();
+
+    public static native void destroyPipeline(long handle);
+
     public static native void processFrame(
+            long handle,
             int tex1,
             int tex2,
             int w,
             int h,
+            long timestamp,
             int mode,
-            int h_min,
-            int h_max,
-            int s_min,
-            int s_max,
-            int v_min,
-            int v_max,
             TargetsInfo destInfo);
 
+    /**
+     * Makes the pipeline take its detection parameters from a channel made by
+     * createConfigChannel(), picking up whatever was last published at the start of each frame.
+     * A channel can feed only one pipeline; 0 goes back to the pipeline's own defaults.
+     */
+    public static native void setConfigChannel(long handle, long channel);
+
+    /**
+     * Selects which target matchers run on each frame, as a mask of MATCHER_* bits.
+     */
+    public static native void setEnabledMatchers(long handle, int mask);
+
+    /**
+     * Cleans up the threshold mask with one of the MORPH_* operations and a w x h rectangle
+     * before blob extraction. Sizes are clamped to 1..31.
+     */
+    public static native void setMorphology(long handle, int op, int w, int h);
+
+    /**
+     * Reads frames back from GL {@code rows} rows at a time and runs detection on each batch as it
+     * arrives, so only the last batch and pairing are left once the readback ends. Uses the
+     * packed-mask blob labeler. 0 (the default) reads the whole frame, then processes it.
+     */
+    public static native void setStreamingReadback(long handle, int rows);
+
+    /**
+     * Sets the per-frame processing budget. While frames run over it the pipeline sheds work
+     * (GOV_* levels: visualization, resolution, search area, then every other frame) and brings
+     * it back once frames are comfortably under. 0 (the default) disables the governor.
+     */
+    public static native void setLatencyTarget(long handle, int targetUs);
+
+    /**
+     * Fills {@code info} with three dummy targets {@code iterations} times, the same way
+     * processFrame() returns its results, and returns the mean time per call in ns. This is the
+     * JNI marshalling cost of a frame, which the host benchmarks cannot measure.
+     */
+    public static native long benchmarkTargetsInfo(long handle, TargetsInfo info, int iterations);
+
+    /**
+     * Starts keeping the last {@code frames} raw camera frames of this pipeline in memory. The
+     * ring is allocated immediately (w * h * 4 bytes per frame).
+     */
+    public static native void enableFlightRecorder(long handle, int w, int h, int frames);
+
+    /**
+     * Saves the flight recorder ring to {@code dir} on a background thread. Returns false if no
+     * recorder is enabled, it has no frames yet or the previous dump is still being written.
+     */
+    public static native boolean persistFlightRecorder(long handle, String dir);
+
+    /**
+     * Records the run-length encoded threshold mask of every frame to {@code file} until
+     * stopMaskRecording() is called. Any recording already in progress is closed first.
+     */
+    public static native boolean startMaskRecording(long handle, String file, int w, int h);
+
+    public static native void stopMaskRecording(long handle);
+
+    /**
+     * Creates a channel for passing detection parameters (HSV thresholds, blob filters, target
+     * geometry) to a running pipeline. It must outlive any pipeline attached to it.
+     */
+    public static native long createConfigChannel();
+
+    public static native void destroyConfigChannel(long handle);
+
+    /**
+     * Publishes a config in the pipeline_config text format ("name value" lines, # comments);
+     * parameters it leaves out take their defaults. Safe to call from any thread while frames
+     * are being processed. Returns null, or a description of the first bad line, in which case
+     * nothing is published.
+     */
+    public static native String publishConfig(long handle, String text);
+
+    /**
+     * Parses a config as publishConfig() would without publishing it. Returns null, or a
+     * description of the first bad line.
+     */
+    public static native String validateConfig(String text);
+
+    /**
+     * Creates an estimator of the robot's clock relative to System.nanoTime(), fed with NTP-style
+     * heartbeat exchanges. Samples must be added from one thread; getClockEstimate() may be
+     * called from any.
+     */
+    public static native long createClockEstimator();
+
+    public static native void destroyClockEstimator(long handle);
+
+    public static native void resetClockEstimator(long handle);
+
+    /**
+     * t0: heartbeat sent, t1: robot received, t2: robot replied, t3: reply received; t0 and t3 in
+     * System.nanoTime(), t1 and t2 in robot nanoseconds. Returns false if the exchange was
+     * rejected (negative or very long round trip).
+     */
+    public static native boolean addClockSample(long handle, long t0, long t1, long t2, long t3);
+
+    /**
+     * Fills offsetAndRtt (at least 2 long) with robot time minus phone time and the round trip
+     * of the exchange it comes from, in ns, and returns whether the clock is synced. All three
+     * come from the same update.
+     */
+    public static native boolean getClockEstimate(long handle, long[] offsetAndRtt);
+
+    public static int matcherMaskFromNames(String names) {
+        int mask = 0;
+        for (String name : names.split(",")) {
+            name = name.trim();
+            if ("peg".equals(name)) {
+                mask |= MATCHER_PEG;
+            } else if ("boiler".equals(name)) {
+                mask |= MATCHER_BOILER;
+            }
+        }
+        return mask;
+    }
+
     /**
      * Classes referenced from native code, DO NOT CHANGE ANY NAMING!!!!
      */
@@ -35,10 +180,23 @@ public class NativePart {
             public double width;
             public double height;
             public double leftToRightRatio;
+            public int type;
         }
 
         public int numTargets;
         public final Target[] targets;
+        // GOV_* level the frame was processed at, and frames over budget so far
+        public int governorLevel;
+        public long budgetMisses;
+        // The governor skipped detection on this frame; the targets are the last processed
+        // frame's and must not be reported again as new
+        public boolean skipped;
+        // System.nanoTime() at the end of each native stage; 0 for stages a skipped frame
+        // never ran
+        public long readbackDoneNs;
+        public long thresholdDoneNs;
+        public long blobsDoneNs;
+        public long targetsDoneNs;
 
         public TargetsInfo() {
             targets = new Target[3];
@@ -11,6 +11,8 @@ public class RobotEventBroadcastReceiver extends BroadcastReceiver {
     public static final String ACTION_SHOT_TAKEN = "ACTION_SHOT_TAKEN";
     public static final String ACTION_WANT_VISION = "ACTION_WANT_VISION";
     public static final String ACTION_WANT_INTAKE = "ACTION_WANT_INTAKE";
+    public static final String ACTION_WANT_MATCHERS = "ACTION_WANT_MATCHERS";
+    public static final String EXTRA_MATCHER_MASK = "matcher_mask";
 
 
     private RobotEventListener m_listener;
@@ -22,6 +24,7 @@ public class RobotEventBroadcastReceiver extends BroadcastReceiver {
         intentFilter.addAction(ACTION_SHOT_TAKEN);
         intentFilter.addAction(ACTION_WANT_VISION);
         intentFilter.addAction(ACTION_WANT_INTAKE);
+        intentFilter.addAction(ACTION_WANT_MATCHERS);
         context.registerReceiver(this, intentFilter);
     }
 
@@ -36,5 +39,8 @@ public class RobotEventBroadcastReceiver extends BroadcastReceiver {
         if (ACTION_WANT_INTAKE.equals(intent.getAction())) {
             m_listener.wantsIntakeMode();
         }
+        if (ACTION_WANT_MATCHERS.equals(intent.getAction())) {
+            m_listener.wantsMatchers(intent.getIntExtra(EXTRA_MATCHER_MASK, NativePart.MATCHER_PEG));
+        }
     }
 }
@@ -51,6 +51,11 @@ public class SelfieActivity extends Activity implements RobotEventListener {
 
     }
 
+    @Override
+    public void wantsMatchers(int mask) {
+
+    }
+
     @Override
     protected void onDestroy() {
         super.onDestroy();
@@ -41,6 +41,10 @@ import com.team3061.cheezdroid.comm.RobotConnectionStatusBroadcastReceiver;
 
 import org.florescu.android.rangeseekbar.RangeSeekBar;
 
+import java.io.File;
+import java.text.SimpleDateFormat;
+import java.util.Date;
+import java.util.Locale;
 import java.util.Timer;
 import java.util.TimerTask;
 
@@ -72,6 +76,9 @@ public class VisionTrackerActivity extends Activity implements RobotConnectionSt
     @Override
     public void shotTaken() {
         Log.i("VisionActivity", "Shot taken");
+        if (mView != null) {
+            mView.saveFlightRecording("shot");
+        }
         playAirhorn();
     }
 
@@ -90,6 +97,13 @@ public class VisionTrackerActivity extends Activity implements RobotConnectionSt
         }
     }
 
+    @Override
+    public void wantsMatchers(int mask) {
+        if (mView != null) {
+            mView.setEnabledMatchers(mask);
+        }
+    }
+
     private class PowerStateBroadcastReceiver extends BroadcastReceiver {
 
         public PowerStateBroadcastReceiver(VisionTrackerActivity activity) {
@@ -386,6 +400,7 @@ public class VisionTrackerActivity extends Activity implements RobotConnectionSt
             public void onRangeSeekBarValuesChanged(RangeSeekBar<?> rangeSeekBar, Integer min, Integer max) {
                 Log.i("H", min + " " + max);
                 m_prefs.setThresholdHRange(min, max);
+                mView.publishConfig();
             }
         });
 
@@ -396,6 +411,7 @@ public class VisionTrackerActivity extends Activity implements RobotConnectionSt
             public void onRangeSeekBarValuesChanged(RangeSeekBar<?> rangeSeekBar, Integer min, Integer max) {
                 Log.i("S", min + " " + max);
                 m_prefs.setThresholdSRange(min, max);
+                mView.publishConfig();
             }
         });
 
@@ -406,6 +422,7 @@ public class VisionTrackerActivity extends Activity implements RobotConnectionSt
             public void onRangeSeekBarValuesChanged(RangeSeekBar<?> rangeSeekBar, Integer min, Integer max) {
                 Log.i("V", min + " " + max);
                 m_prefs.setThresholdVRange(min, max);
+                mView.publishConfig();
             }
         });
 
@@ -414,6 +431,7 @@ public class VisionTrackerActivity extends Activity implements RobotConnectionSt
             @Override
             public void onClick(View v) {
                 m_prefs.restoreDefaults();
+                mView.publishConfig();
                 setSeekBar(hSeekBar, getHRange());
                 setSeekBar(sSeekBar, getSRange());
                 setSeekBar(vSeekBar, getVRange());
@@ -442,6 +460,7 @@ public class VisionTrackerActivity extends Activity implements RobotConnectionSt
     public void robotConnected() {
         Log.i("MainActivity", "Robot Connected");
         mView.setRobotConnection(AppContext.getRobotConnection());
+        mView.startMaskRecording("match");
         connectionStateView.setBackgroundColor(ContextCompat.getColor(this, R.color.cheesy_poof_blue));
         stopBadConnectionAnimation();
     }
@@ -471,6 +490,9 @@ public class VisionTrackerActivity extends Activity implements RobotConnectionSt
     public void robotDisconnected() {
         Log.i("MainActivity", "Robot Disconnected");
         mView.setRobotConnection(null);
+        mView.saveFlightRecording("disconnect");
+        mView.stopMaskRecording();
+        saveLatencyReport("disconnect");
         connectionStateView.setBackgroundColor(ContextCompat.getColor(this, R.color.holo_red_light));
         if (isLocked()) {
             startBadConnectionAnimation();
@@ -479,6 +501,20 @@ public class VisionTrackerActivity extends Activity implements RobotConnectionSt
         }
     }
 
+    /**
+     * Writes the capture-to-socket latency histograms of the last few hundred frames to
+     * files/latency/<time>-<reason>.json.
+     */
+    private void saveLatencyReport(String reason) {
+        File base = getExternalFilesDir("latency");
+        if (base == null) {
+            Log.e("MainActivity", "No storage for latency report");
+            return;
+        }
+        String name = new SimpleDateFormat("yyyyMMdd-HHmmss", Locale.US).format(new Date()) + "-" + reason + ".json";
+        AppContext.getRobotConnection().getLatencyStats().exportTo(new File(base, name));
+    }
+
     public void setLockOn() {
         sLocked = true;
         mLockButton.setImageResource(R.drawable.locked);
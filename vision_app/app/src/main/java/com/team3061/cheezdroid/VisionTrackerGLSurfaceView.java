@@ -1,6 +1,7 @@
 package com.team3061.cheezdroid;
 
 import com.team3061.cheezdroid.comm.CameraTargetInfo;
+import com.team3061.cheezdroid.comm.FrameLatency;
 import com.team3061.cheezdroid.comm.RobotConnection;
 import com.team3061.cheezdroid.comm.VisionUpdate;
 import com.team3061.cheezdroid.comm.messages.TargetUpdateMessage;
@@ -10,18 +11,27 @@ import org.opencv.android.BetterCamera2Renderer;
 import org.opencv.android.BetterCameraGLSurfaceView;
 
 import android.app.Activity;
+import android.app.ActivityManager;
 import android.content.Context;
 import android.hardware.camera2.CaptureRequest;
 import android.os.Handler;
 import android.os.Looper;
 import android.util.AttributeSet;
 import android.util.Log;
+import android.text.TextUtils;
 import android.util.Pair;
 import android.view.SurfaceHolder;
 import android.widget.TextView;
 import android.widget.Toast;
 
+import java.io.BufferedReader;
+import java.io.File;
+import java.io.FileReader;
+import java.io.IOException;
+import java.text.SimpleDateFormat;
+import java.util.Date;
 import java.util.HashMap;
+import java.util.Locale;
 
 public class VisionTrackerGLSurfaceView extends BetterCameraGLSurfaceView implements BetterCameraGLSurfaceView.CameraTextureListener {
 
@@ -33,12 +43,35 @@ public class VisionTrackerGLSurfaceView extends BetterCameraGLSurfaceView implem
     TextView mFpsText = null;
     private RobotConnection mRobotConnection;
     private Preferences m_prefs;
+    private final Object mPipelineLock = new Object();
+    private long mPipeline = 0;
+    // Detection parameters, read by the pipeline each frame. Guarded by mPipelineLock; destroyed
+    // with the pipeline and recreated with the last published text.
+    private long mConfigChannel = 0;
+    private String mPublishedConfigText = null;
+    private String mConfigFileText = "";
+    private volatile int mMatcherMask = NativePart.MATCHER_PEG;
+    private int mAppliedMatcherMask = -1;
+    // op, width, height; replaced as a whole so the GL thread never sees a mix
+    private volatile int[] mMorphology = {NativePart.MORPH_NONE, 3, 3};
+    private int[] mAppliedMorphology = null;
+    private volatile String mMaskRecordingPath = null;
+    private String mAppliedMaskRecordingPath = null;
+    private volatile int mLatencyTargetUs = 0;
+    private int mAppliedLatencyTargetUs = -1;
+    private int mGovernorLevel = NativePart.GOV_FULL;
 
     static final int kHeight = 480;
     static final int kWidth = 640;
     static final double kCenterCol = ((double) kWidth) / 2.0 - .5;
     static final double kCenterRow = ((double) kHeight) / 2.0 - .5;
 
+    // Seconds of raw frames the flight recorder keeps, at the nominal 30 fps. The whole ring is
+    // allocated up front, so it is also held to a quarter of the app's memory class.
+    static final int kFlightRecorderSeconds = 1;
+    static final int kFlightRecorderFrames = kFlightRecorderSeconds * 30;
+    static final int kFlightRecorderMemoryShare = 4;
+
     static BetterCamera2Renderer.Settings getCameraSettings() {
         BetterCamera2Renderer.Settings settings = new BetterCamera2Renderer.Settings();
         settings.height = kHeight;
@@ -93,12 +126,26 @@ public class VisionTrackerGLSurfaceView extends BetterCameraGLSurfaceView implem
             }
         });
         // NativePart.initCL();
+        loadConfigFile();
         frameCounter = 0;
         lastNanoTime = System.nanoTime();
     }
 
     @Override
     public void onCameraViewStopped() {
+        synchronized (mPipelineLock) {
+            if (mPipeline != 0) {
+                // Also closes any mask recording; don't reopen (and truncate) it on restart
+                NativePart.destroyPipeline(mPipeline);
+                mPipeline = 0;
+            }
+            if (mConfigChannel != 0) {
+                NativePart.destroyConfigChannel(mConfigChannel);
+                mConfigChannel = 0;
+            }
+            mMaskRecordingPath = null;
+            mAppliedMaskRecordingPath = null;
+        }
         ((Activity) getContext()).runOnUiThread(new Runnable() {
             public void run() {
                 Toast.makeText(getContext(), "onCameraViewStopped", Toast.LENGTH_SHORT).show();
@@ -129,11 +176,61 @@ public class VisionTrackerGLSurfaceView extends BetterCameraGLSurfaceView implem
             lastNanoTime = System.nanoTime();
         }
         NativePart.TargetsInfo targetsInfo = new NativePart.TargetsInfo();
-        Pair<Integer, Integer> hRange = m_prefs != null ? m_prefs.getThresholdHRange() : blankPair();
-        Pair<Integer, Integer> sRange = m_prefs != null ? m_prefs.getThresholdSRange() : blankPair();
-        Pair<Integer, Integer> vRange = m_prefs != null ? m_prefs.getThresholdVRange() : blankPair();
-        NativePart.processFrame(texIn, texOut, width, height, procMode, hRange.first, hRange.second,
-                sRange.first, sRange.second, vRange.first, vRange.second, targetsInfo);
+        synchronized (mPipelineLock) {
+            if (mPipeline == 0) {
+                mPipeline = NativePart.createPipeline();
+                NativePart.setConfigChannel(mPipeline, configChannel());
+                NativePart.enableFlightRecorder(mPipeline, width, height, flightRecorderFrames(width, height));
+                if (BuildConfig.DEBUG) {
+                    Log.d(LOGTAG, "TargetsInfo marshalling: " +
+                            NativePart.benchmarkTargetsInfo(mPipeline, targetsInfo, 1000) + " ns/frame");
+                }
+                mAppliedMatcherMask = -1;
+                mAppliedMorphology = null;
+                mAppliedLatencyTargetUs = -1;
+            }
+            int matcherMask = mMatcherMask;
+            if (matcherMask != mAppliedMatcherMask) {
+                NativePart.setEnabledMatchers(mPipeline, matcherMask);
+                mAppliedMatcherMask = matcherMask;
+            }
+            int[] morphology = mMorphology;
+            if (morphology != mAppliedMorphology) {
+                NativePart.setMorphology(mPipeline, morphology[0], morphology[1], morphology[2]);
+                mAppliedMorphology = morphology;
+            }
+            int latencyTargetUs = mLatencyTargetUs;
+            if (latencyTargetUs != mAppliedLatencyTargetUs) {
+                NativePart.setLatencyTarget(mPipeline, latencyTargetUs);
+                mAppliedLatencyTargetUs = latencyTargetUs;
+            }
+            String maskRecordingPath = mMaskRecordingPath;
+            if (!TextUtils.equals(maskRecordingPath, mAppliedMaskRecordingPath)) {
+                NativePart.stopMaskRecording(mPipeline);
+                if (maskRecordingPath != null &&
+                        !NativePart.startMaskRecording(mPipeline, maskRecordingPath, width, height)) {
+                    Log.e(LOGTAG, "Could not start mask recording " + maskRecordingPath);
+                }
+                mAppliedMaskRecordingPath = maskRecordingPath;
+            }
+            NativePart.processFrame(mPipeline, texIn, texOut, width, height, image_timestamp, procMode, targetsInfo);
+        }
+        FrameLatency latency = new FrameLatency(image_timestamp);
+        latency.mark(FrameLatency.READBACK_DONE, targetsInfo.readbackDoneNs);
+        latency.mark(FrameLatency.THRESHOLD_DONE, targetsInfo.thresholdDoneNs);
+        latency.mark(FrameLatency.BLOBS_DONE, targetsInfo.blobsDoneNs);
+        latency.mark(FrameLatency.TARGETS_DONE, targetsInfo.targetsDoneNs);
+        latency.mark(FrameLatency.JNI_RETURN);
+
+        if (targetsInfo.governorLevel != mGovernorLevel) {
+            Log.w(LOGTAG, "Latency governor level " + mGovernorLevel + " -> " + targetsInfo.governorLevel +
+                    " (" + targetsInfo.budgetMisses + " frames over budget)");
+            mGovernorLevel = targetsInfo.governorLevel;
+        }
+        if (targetsInfo.skipped) {
+            // Nothing new to tell the robot; it keeps the last update
+            return true;
+        }
 
         VisionUpdate visionUpdate = new VisionUpdate(image_timestamp);
         Log.i(LOGTAG, "Num targets = " + targetsInfo.numTargets);
@@ -148,25 +245,182 @@ public class VisionTrackerGLSurfaceView extends BetterCameraGLSurfaceView implem
             double theta = target.leftToRightRatio; //TODO: This isn't true!!!!! Need to make an algorithm to calculate the actual angle!
             Log.i(LOGTAG, "Target at: " + y + ", " + z + " d:" + x + " in");
             visionUpdate.addCameraTargetInfo(
-                    new CameraTargetInfo(x, y, z, theta));
+                    new CameraTargetInfo(x, y, z, theta, target.type));
         }
 
         if (mRobotConnection != null) {
-            TargetUpdateMessage update = new TargetUpdateMessage(visionUpdate, System.nanoTime());
+            TargetUpdateMessage update = new TargetUpdateMessage(visionUpdate, latency);
             mRobotConnection.send(update);
         }
         return true;
     }
 
+    private int flightRecorderFrames(int width, int height) {
+        ActivityManager am = (ActivityManager) getContext().getSystemService(Context.ACTIVITY_SERVICE);
+        long budget = (long) am.getMemoryClass() * 1024 * 1024 / kFlightRecorderMemoryShare;
+        long frames = budget / ((long) width * height * 4);
+        return (int) Math.max(1, Math.min(kFlightRecorderFrames, frames));
+    }
+
     public void setRobotConnection(RobotConnection robotConnection) {
         mRobotConnection = robotConnection;
     }
 
+    /**
+     * Saves the flight recorder's camera frames under the app's external files directory, for
+     * offline replay. Safe to call from any thread.
+     */
+    public void saveFlightRecording(String reason) {
+        File base = getContext().getExternalFilesDir("flight_recorder");
+        if (base == null) {
+            Log.e(LOGTAG, "No storage for flight recording");
+            return;
+        }
+        String name = new SimpleDateFormat("yyyyMMdd-HHmmss", Locale.US).format(new Date()) + "-" + reason;
+        synchronized (mPipelineLock) {
+            if (mPipeline == 0 ||
+                    !NativePart.persistFlightRecorder(mPipeline, new File(base, name).getAbsolutePath())) {
+                Log.w(LOGTAG, "Flight recording not saved (" + reason + ")");
+            }
+        }
+    }
+
+    /**
+     * Starts recording the threshold mask of every frame to a new .vrle file under the app's
+     * external files directory. Takes effect on the next frame.
+     */
+    public void startMaskRecording(String reason) {
+        File base = getContext().getExternalFilesDir("mask_recordings");
+        if (base == null) {
+            Log.e(LOGTAG, "No storage for mask recording");
+            return;
+        }
+        String name = new SimpleDateFormat("yyyyMMdd-HHmmss", Locale.US).format(new Date()) + "-" + reason + ".vrle";
+        mMaskRecordingPath = new File(base, name).getAbsolutePath();
+    }
+
+    public void stopMaskRecording() {
+        mMaskRecordingPath = null;
+    }
+
+    /**
+     * Selects the target matchers to run, as a mask of NativePart.MATCHER_* bits. Takes effect on
+     * the next frame.
+     */
+    public void setEnabledMatchers(int mask) {
+        mMatcherMask = mask;
+    }
+
+    /**
+     * Selects the threshold mask cleanup (NativePart.MORPH_*) and its w x h element. Takes effect
+     * on the next frame.
+     */
+    public void setMorphology(int op, int w, int h) {
+        mMorphology = new int[] {op, w, h};
+    }
+
+    /**
+     * Sets the per-frame processing budget in microseconds; 0 turns the latency governor off.
+     * Takes effect on the next frame.
+     */
+    public void setLatencyTarget(int targetUs) {
+        mLatencyTargetUs = targetUs;
+    }
+
     public void setPreferences(Preferences prefs) {
         m_prefs = prefs;
+        loadConfigFile();
+    }
+
+    /**
+     * Re-reads pipeline.cfg from the app's external files directory, if there is one, and
+     * publishes it. Thresholds in the file replace the saved slider positions; everything else
+     * it sets (blob filters, target geometry) stays in effect until the file changes. Lets
+     * parameters be tuned at an event by pushing a file, without rebuilding the app.
+     */
+    public synchronized void loadConfigFile() {
+        File base = getContext().getExternalFilesDir(null);
+        File file = base != null ? new File(base, "pipeline.cfg") : null;
+        StringBuilder text = new StringBuilder();
+        if (file != null && file.exists()) {
+            try (BufferedReader reader = new BufferedReader(new FileReader(file))) {
+                String line;
+                while ((line = reader.readLine()) != null) {
+                    text.append(line).append('\n');
+                }
+            } catch (IOException e) {
+                Log.e(LOGTAG, "Could not read " + file, e);
+                return;
+            }
+        }
+        String error = NativePart.validateConfig(text.toString());
+        if (error != null) {
+            Log.e(LOGTAG, "Ignoring " + file + ": " + error);
+            return;
+        }
+        mConfigFileText = text.toString();
+        if (m_prefs != null) {
+            copyThresholdsToPrefs(mConfigFileText);
+        }
+        publishConfig();
+    }
+
+    /**
+     * Publishes the config file with the current threshold sliders on top. Call after changing
+     * the thresholds in the preferences; takes effect on the next frame.
+     */
+    public synchronized void publishConfig() {
+        StringBuilder text = new StringBuilder(mConfigFileText);
+        if (m_prefs != null) {
+            Pair<Integer, Integer> h = m_prefs.getThresholdHRange();
+            Pair<Integer, Integer> s = m_prefs.getThresholdSRange();
+            Pair<Integer, Integer> v = m_prefs.getThresholdVRange();
+            text.append("h_min ").append(h.first).append("\nh_max ").append(h.second)
+                    .append("\ns_min ").append(s.first).append("\ns_max ").append(s.second)
+                    .append("\nv_min ").append(v.first).append("\nv_max ").append(v.second)
+                    .append('\n');
+        }
+        synchronized (mPipelineLock) {
+            String error = NativePart.publishConfig(configChannel(), text.toString());
+            if (error != null) {
+                Log.e(LOGTAG, "Config not published: " + error);
+                return;
+            }
+            mPublishedConfigText = text.toString();
+        }
+    }
+
+    // Call with mPipelineLock held
+    private long configChannel() {
+        if (mConfigChannel == 0) {
+            mConfigChannel = NativePart.createConfigChannel();
+            if (mPublishedConfigText != null) {
+                NativePart.publishConfig(mConfigChannel, mPublishedConfigText);
+            }
+        }
+        return mConfigChannel;
+    }
+
+    // The file has already been parsed natively, so the values here are well formed
+    private void copyThresholdsToPrefs(String text) {
+        HashMap<String, Integer> values = new HashMap<>();
+        for (String line : text.split("\n")) {
+            int comment = line.indexOf('#');
+            String[] words = (comment >= 0 ? line.substring(0, comment) : line).trim().split("\\s+");
+            if (words.length == 2 && words[0].matches("[hsv]_(min|max)")) {
+                values.put(words[0], Integer.parseInt(words[1]));
+            }
+        }
+        Pair<Integer, Integer> h = m_prefs.getThresholdHRange();
+        Pair<Integer, Integer> s = m_prefs.getThresholdSRange();
+        Pair<Integer, Integer> v = m_prefs.getThresholdVRange();
+        m_prefs.setThresholdHRange(valueOr(values, "h_min", h.first), valueOr(values, "h_max", h.second));
+        m_prefs.setThresholdSRange(valueOr(values, "s_min", s.first), valueOr(values, "s_max", s.second));
+        m_prefs.setThresholdVRange(valueOr(values, "v_min", v.first), valueOr(values, "v_max", v.second));
     }
 
-    private static Pair<Integer, Integer> blankPair() {
-        return new Pair<Integer, Integer>(0, 255);
+    private static int valueOr(HashMap<String, Integer> values, String key, int fallback) {
+        Integer value = values.get(key);
+        return value != null ? value : fallback;
     }
 }
@@ -10,6 +10,7 @@ public class CameraTargetInfo {
     protected double m_y;
     protected double m_z;
     protected double m_theta;
+    protected int m_type;
 
     // Coordinate frame:
     // +x is out the camera's optical axis
@@ -17,10 +18,15 @@ public class CameraTargetInfo {
     // +z is to the top of the image
     // We assume the x component of all targets is +1.0 (since this is homogeneous)
     public CameraTargetInfo(double x, double y, double z, double theta) {
+        this(x, y, z, theta, 0);
+    }
+
+    public CameraTargetInfo(double x, double y, double z, double theta, int type) {
         m_x = x;
         m_y = y;
         m_z = z;
         m_theta = theta;
+        m_type = type;
     }
 
     private double doubleize(double value) {
@@ -47,6 +53,10 @@ public class CameraTargetInfo {
         return m_theta;
     }
 
+    public int getType() {
+        return m_type;
+    }
+
     public JSONObject toJson() {
         JSONObject j = new JSONObject();
         try {
@@ -54,6 +64,7 @@ public class CameraTargetInfo {
             j.put("y", doubleize(getY()));
             j.put("z", doubleize(getZ()));
             j.put("theta", getTheta());
+            j.put("type", getType());
         } catch (JSONException e) {
             Log.e("CameraTargetInfo", "Could not encode Json");
         }
@@ -0,0 +1,38 @@
+package com.team3061.cheezdroid.comm;
+
+/**
+ * System.nanoTime() timestamps of one frame on its way from the camera to the robot socket.
+ * Points a frame never reached (a skipped stage, a message that was dropped) stay 0.
+ */
+public class FrameLatency {
+    public static final int CAPTURE = 0;
+    public static final int READBACK_DONE = 1;
+    public static final int THRESHOLD_DONE = 2;
+    public static final int BLOBS_DONE = 3;
+    public static final int TARGETS_DONE = 4;
+    public static final int JNI_RETURN = 5;
+    public static final int ENQUEUED = 6;
+    public static final int WRITTEN = 7;
+    public static final int NUM_POINTS = 8;
+
+    public static final String[] POINT_NAMES = new String[]{
+            "capture", "readback", "threshold", "blobs", "targets", "jni_return", "enqueued", "written"};
+
+    private final long[] mTimesNs = new long[NUM_POINTS];
+
+    public FrameLatency(long captureNs) {
+        mTimesNs[CAPTURE] = captureNs;
+    }
+
+    public void mark(int point, long timeNs) {
+        mTimesNs[point] = timeNs;
+    }
+
+    public void mark(int point) {
+        mark(point, System.nanoTime());
+    }
+
+    public long get(int point) {
+        return mTimesNs[point];
+    }
+}
@@ -0,0 +1,161 @@
+package com.team3061.cheezdroid.comm;
+
+import android.util.Log;
+
+import org.json.JSONArray;
+import org.json.JSONException;
+import org.json.JSONObject;
+
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.util.Arrays;
+
+/**
+ * Rolling latency histograms over the last few hundred frames that reached the socket. Each
+ * segment is the time between two consecutive FrameLatency points (capture to readback,
+ * readback to threshold, ... enqueued to written); the last one is the whole trip. Safe to use
+ * from any thread.
+ */
+public class LatencyStats {
+    public static final int NUM_SEGMENTS = FrameLatency.NUM_POINTS;
+    public static final int TOTAL = NUM_SEGMENTS - 1;
+
+    // 1 ms buckets; the last one also holds everything slower
+    public static final int NUM_BUCKETS = 100;
+
+    private final int mWindow;
+    private final int[][] mSamplesUs;
+    private int mCount = 0;
+    private int mNext = 0;
+    private long mFrames = 0;
+    private long mDropped = 0;
+
+    public LatencyStats(int window) {
+        mWindow = window;
+        mSamplesUs = new int[NUM_SEGMENTS][window];
+    }
+
+    public static String segmentName(int segment) {
+        if (segment == TOTAL) {
+            return "total";
+        }
+        return FrameLatency.POINT_NAMES[segment] + "_to_" + FrameLatency.POINT_NAMES[segment + 1];
+    }
+
+    /**
+     * Adds a frame that reached the socket. Segments with a missing end point are left out.
+     */
+    public synchronized void add(FrameLatency frame) {
+        for (int segment = 0; segment < NUM_SEGMENTS; ++segment) {
+            long start = frame.get(segment == TOTAL ? FrameLatency.CAPTURE : segment);
+            long end = frame.get(segment == TOTAL ? FrameLatency.WRITTEN : segment + 1);
+            // -1 marks a missing sample, so all segments share one window
+            mSamplesUs[segment][mNext] = start != 0 && end != 0 ? (int) ((end - start) / 1000) : -1;
+        }
+        mNext = (mNext + 1) % mWindow;
+        mCount = Math.min(mCount + 1, mWindow);
+        ++mFrames;
+    }
+
+    /**
+     * Counts a frame whose message never reached the socket (queue full or no connection).
+     */
+    public synchronized void addDropped() {
+        ++mDropped;
+    }
+
+    public synchronized long getFrames() {
+        return mFrames;
+    }
+
+    public synchronized long getDropped() {
+        return mDropped;
+    }
+
+    /**
+     * Counts per 1 ms bucket of a segment over the window.
+     */
+    public synchronized int[] getHistogram(int segment) {
+        int[] buckets = new int[NUM_BUCKETS];
+        for (int i = 0; i < mCount; ++i) {
+            int us = mSamplesUs[segment][i];
+            if (us >= 0) {
+                ++buckets[Math.min(us / 1000, NUM_BUCKETS - 1)];
+            }
+        }
+        return buckets;
+    }
+
+    /**
+     * p in [0, 1]; returns 0 if the segment has no samples.
+     */
+    public synchronized double getPercentileMs(int segment, double p) {
+        int[] sorted = sortedSamples(segment);
+        if (sorted.length == 0) {
+            return 0;
+        }
+        int i = Math.min(sorted.length - 1, (int) (p * (sorted.length - 1) + 0.5));
+        return sorted[i] / 1000.0;
+    }
+
+    private int[] sortedSamples(int segment) {
+        int[] samples = new int[mCount];
+        int n = 0;
+        for (int i = 0; i < mCount; ++i) {
+            if (mSamplesUs[segment][i] >= 0) {
+                samples[n++] = mSamplesUs[segment][i];
+            }
+        }
+        samples = Arrays.copyOf(samples, n);
+        Arrays.sort(samples);
+        return samples;
+    }
+
+    public synchronized JSONObject toJson() {
+        JSONObject j = new JSONObject();
+        try {
+            j.put("frames", mFrames);
+            j.put("dropped", mDropped);
+            j.put("bucketMs", 1);
+            JSONObject segments = new JSONObject();
+            for (int segment = 0; segment < NUM_SEGMENTS; ++segment) {
+                JSONObject s = new JSONObject();
+                s.put("p50Ms", getPercentileMs(segment, 0.5));
+                s.put("p90Ms", getPercentileMs(segment, 0.9));
+                s.put("p99Ms", getPercentileMs(segment, 0.99));
+                s.put("maxMs", getPercentileMs(segment, 1));
+                JSONArray histogram = new JSONArray();
+                for (int count : getHistogram(segment)) {
+                    histogram.put(count);
+                }
+                s.put("histogram", histogram);
+                segments.put(segmentName(segment), s);
+            }
+            j.put("segments", segments);
+        } catch (JSONException e) {
+            Log.e("LatencyStats", "Could not encode JSON");
+        }
+        return j;
+    }
+
+    public boolean exportTo(File file) {
+        String json = toJson().toString();
+        FileOutputStream os = null;
+        try {
+            os = new FileOutputStream(file);
+            os.write(json.getBytes());
+            return true;
+        } catch (IOException e) {
+            Log.e("LatencyStats", "Could not write " + file);
+            return false;
+        } finally {
+            if (os != null) {
+                try {
+                    os.close();
+                } catch (IOException e) {
+                }
+            }
+        }
+    }
+}
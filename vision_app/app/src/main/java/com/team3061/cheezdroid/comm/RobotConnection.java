@@ -4,11 +4,14 @@ import android.content.Context;
 import android.content.Intent;
 import android.util.Log;
 
+import com.team3061.cheezdroid.NativePart;
 import com.team3061.cheezdroid.RobotEventBroadcastReceiver;
 import com.team3061.cheezdroid.comm.messages.HeartbeatMessage;
 import com.team3061.cheezdroid.comm.messages.OffWireMessage;
+import com.team3061.cheezdroid.comm.messages.TargetUpdateMessage;
 import com.team3061.cheezdroid.comm.messages.VisionMessage;
 
+import org.json.JSONException;
 import org.json.JSONObject;
 
 import java.io.BufferedReader;
@@ -18,14 +21,17 @@ import java.io.InputStreamReader;
 import java.io.OutputStream;
 import java.net.Socket;
 import java.util.concurrent.ArrayBlockingQueue;
-import java.util.concurrent.TimeUnit;
 
 public class RobotConnection {
     public static final int K_ROBOT_PORT = 3061;
+    // Target datagrams, when enabled with setUdpTargets()
+    public static final int K_ROBOT_UDP_PORT = 3062;
     public static final String K_ROBOT_PROXY_HOST = "localhost";
     public static final int K_CONNECTOR_SLEEP_MS = 100;
     public static final int K_THRESHOLD_HEARTBEAT = 800;
     public static final int K_SEND_HEARTBEAT_PERIOD = 100;
+    // Frames kept in the latency histograms, about 10 s at 30 fps
+    public static final int K_LATENCY_WINDOW = 300;
 
     private int m_port;
     private String m_host;
@@ -38,7 +44,18 @@ public class RobotConnection {
     private long m_last_heartbeat_sent_at = System.currentTimeMillis();
     private long m_last_heartbeat_rcvd_at = 0;
 
+    // Heartbeats and control messages, sent in order
     private ArrayBlockingQueue<VisionMessage> mToSend = new ArrayBlockingQueue<VisionMessage>(30);
+    // Newest latest-value-only message (target updates) not yet taken by the writer. A new one
+    // replaces it, so the robot never gets more than one update behind.
+    private final Object mSendLock = new Object();
+    private VisionMessage mLatestValue = null;
+    private long mSuperseded = 0;
+    private final LatencyStats mLatencyStats = new LatencyStats(K_LATENCY_WINDOW);
+    private volatile UdpTargetSender mUdpTargets = null;
+    // Robot clock relative to System.nanoTime(), from heartbeat exchanges. Samples come from
+    // the read thread only.
+    private final long mClockEstimator = NativePart.createClockEstimator();
 
     protected class WriteThread implements Runnable {
 
@@ -47,27 +64,44 @@ public class RobotConnection {
             while (m_running) {
                 VisionMessage nextToSend = null;
                 try {
-                    nextToSend = mToSend.poll(250, TimeUnit.MILLISECONDS);
+                    nextToSend = takeNextToSend(250);
                 } catch (InterruptedException e) {
                     Log.e("WriteThead", "Couldn't poll queue");
                 }
                 if (nextToSend == null) {
                     continue;
                 }
-                sendToWire(nextToSend);
+                boolean written = sendToWire(nextToSend);
+                FrameLatency latency = nextToSend.getLatency();
+                if (latency != null) {
+                    if (written) {
+                        mLatencyStats.add(latency);
+                    } else {
+                        mLatencyStats.addDropped();
+                    }
+                }
             }
         }
     }
 
     protected class ReadThread implements Runnable {
 
-        public void handleMessage(VisionMessage message) {
+        private Socket mClockSocket = null;
+
+        public void handleMessage(VisionMessage message, long receivedAtNs) {
             if ("heartbeat".equals(message.getType())) {
                 m_last_heartbeat_rcvd_at = System.currentTimeMillis();
+                addClockSample(message.getMessage(), receivedAtNs);
             }
             if ("shot".equals(message.getType())) {
                 broadcastShotTaken();
             }
+            if ("matchers".equals(message.getType())) {
+                broadcastWantMatchers(NativePart.matcherMaskFromNames(message.getMessage()));
+            }
+            if ("target_transport".equals(message.getType())) {
+                setUdpTargets("udp".equals(message.getMessage()));
+            }
             if ("camera_mode".equals(message.getType())) {
                 if ("vision".equals(message.getMessage())) {
                     broadcastWantVisionMode();
@@ -79,6 +113,25 @@ public class RobotConnection {
             Log.w("Connection" , message.getType() + " " + message.getMessage());
         }
 
+        // Older robot code answers heartbeats with "{}", which just leaves the clock unsynced
+        private void addClockSample(String reply, long receivedAtNs) {
+            Socket socket = m_socket;
+            if (socket != mClockSocket) {
+                // New connection, maybe to a rebooted robot with a new clock
+                NativePart.resetClockEstimator(mClockEstimator);
+                mClockSocket = socket;
+            }
+            try {
+                JSONObject j = new JSONObject(reply);
+                if (j.has("t0") && j.has("t1") && j.has("t2")) {
+                    NativePart.addClockSample(mClockEstimator, j.getLong("t0"), j.getLong("t1"),
+                            j.getLong("t2"), receivedAtNs);
+                }
+            } catch (JSONException e) {
+                Log.w("ReadThread", "Bad heartbeat reply " + reply);
+            }
+        }
+
         @Override
         public void run() {
             while (m_running) {
@@ -100,9 +153,10 @@ public class RobotConnection {
                     } catch (IOException e) {
                     }
                     if (jsonMessage != null) {
+                        long receivedAtNs = System.nanoTime();
                         OffWireMessage parsedMessage = new OffWireMessage(jsonMessage);
                         if (parsedMessage.isValid()) {
-                            handleMessage(parsedMessage);
+                            handleMessage(parsedMessage, receivedAtNs);
                         }
                     }
                 } else {
@@ -235,6 +289,9 @@ public class RobotConnection {
             try {
                 OutputStream os = m_socket.getOutputStream();
                 os.write(toSend.getBytes());
+                if (message.getLatency() != null) {
+                    message.getLatency().mark(FrameLatency.WRITTEN);
+                }
                 return true;
             } catch (IOException e) {
                 Log.w("RobotConnection", "Could not send data to socket, try to reconnect");
@@ -244,8 +301,112 @@ public class RobotConnection {
         return false;
     }
 
-    public synchronized boolean send(VisionMessage message) {
-        return mToSend.offer(message);
+    /**
+     * Queues a message for the writer thread without waiting on the socket. Returns false if the
+     * ordered queue is full; latest-value-only messages are always accepted, replacing any
+     * older one that has not been written yet.
+     */
+    public boolean send(VisionMessage message) {
+        FrameLatency latency = message.getLatency();
+        if (latency != null) {
+            latency.mark(FrameLatency.ENQUEUED);
+        }
+        if (message instanceof TargetUpdateMessage) {
+            // One read, so the offset can't come from a different state than the synced flag
+            long[] clock = new long[2];
+            if (NativePart.getClockEstimate(mClockEstimator, clock)) {
+                ((TargetUpdateMessage) message).setRobotClockOffset(clock[0]);
+            }
+        }
+        UdpTargetSender udp = mUdpTargets;
+        if (udp != null && message instanceof TargetUpdateMessage) {
+            // The sender's thread does the rest, and records the latency
+            udp.send((TargetUpdateMessage) message);
+            return true;
+        }
+        synchronized (mSendLock) {
+            boolean queued = true;
+            if (message.isLatestValueOnly()) {
+                if (mLatestValue != null) {
+                    ++mSuperseded;
+                    if (mLatestValue.getLatency() != null) {
+                        mLatencyStats.addDropped();
+                    }
+                }
+                mLatestValue = message;
+            } else {
+                queued = mToSend.offer(message);
+                if (!queued && latency != null) {
+                    mLatencyStats.addDropped();
+                }
+            }
+            mSendLock.notify();
+            return queued;
+        }
+    }
+
+    // Ordered messages go first; they are rare and small, and control messages should not wait
+    // behind target updates
+    private VisionMessage takeNextToSend(long timeoutMs) throws InterruptedException {
+        synchronized (mSendLock) {
+            if (mToSend.isEmpty() && mLatestValue == null) {
+                mSendLock.wait(timeoutMs);
+            }
+            VisionMessage next = mToSend.poll();
+            if (next == null) {
+                next = mLatestValue;
+                mLatestValue = null;
+            }
+            return next;
+        }
+    }
+
+    /**
+     * Sends target updates as UDP datagrams to the robot host on K_ROBOT_UDP_PORT instead of
+     * over the TCP connection. Heartbeats and control messages stay on TCP. Needs a network
+     * route to the robot; adb reverse does not forward UDP. The robot can also switch this with a
+     * "target_transport" message of "udp" or "tcp".
+     */
+    public void setUdpTargets(boolean enabled) {
+        UdpTargetSender old = mUdpTargets;
+        mUdpTargets = enabled ? new UdpTargetSender(m_host, K_ROBOT_UDP_PORT, mLatencyStats) : null;
+        if (old != null) {
+            old.close();
+        }
+    }
+
+    /**
+     * Robot clock minus System.nanoTime() in ns, or null until a heartbeat exchange with a
+     * timestamping robot has completed on the current connection.
+     */
+    public Long getRobotClockOffsetNs() {
+        long[] clock = new long[2];
+        return NativePart.getClockEstimate(mClockEstimator, clock) ? Long.valueOf(clock[0]) : null;
+    }
+
+    /**
+     * Round trip of the heartbeat exchange the clock offset comes from, in ns.
+     */
+    public long getRobotClockRttNs() {
+        long[] clock = new long[2];
+        NativePart.getClockEstimate(mClockEstimator, clock);
+        return clock[1];
+    }
+
+    /**
+     * Target updates replaced by a newer one before the writer got to them.
+     */
+    public long getSupersededCount() {
+        synchronized (mSendLock) {
+            return mSuperseded;
+        }
+    }
+
+    /**
+     * Where the time goes between capture and the socket, for target updates sent through here.
+     */
+    public LatencyStats getLatencyStats() {
+        return mLatencyStats;
     }
 
     public void broadcastRobotConnected() {
@@ -268,6 +429,12 @@ public class RobotConnection {
         m_context.sendBroadcast(i);
     }
 
+    public void broadcastWantMatchers(int mask) {
+        Intent i = new Intent(RobotEventBroadcastReceiver.ACTION_WANT_MATCHERS);
+        i.putExtra(RobotEventBroadcastReceiver.EXTRA_MATCHER_MASK, mask);
+        m_context.sendBroadcast(i);
+    }
+
     public void broadcastRobotDisconnected() {
         Intent i = new Intent(RobotConnectionStatusBroadcastReceiver.ACTION_ROBOT_DISCONNECTED);
         m_context.sendBroadcast(i);
@@ -0,0 +1,145 @@
+package com.team3061.cheezdroid.comm;
+
+import android.util.Log;
+
+import com.team3061.cheezdroid.comm.messages.TargetUpdateMessage;
+
+import java.io.IOException;
+import java.net.DatagramPacket;
+import java.net.DatagramSocket;
+import java.net.InetAddress;
+import java.util.Random;
+
+/**
+ * Sends each target update as a single datagram, so a lost packet only loses that update instead
+ * of holding up every later one the way a lost TCP segment does. Updates carry a sequence number;
+ * the robot keeps only the newest. Each sender numbers from 0 under a random session id, so the
+ * robot can tell a new sender from a late datagram of the old one.
+ *
+ * Resolving the host can block for seconds, so the sending happens on the sender's own thread;
+ * send() only hands the update over. An update the thread has not got to yet is replaced by a
+ * newer one.
+ *
+ * adb reverse only forwards TCP, so this needs a real network route to the robot.
+ */
+public class UdpTargetSender {
+    private final String mHost;
+    private final int mPort;
+    private final LatencyStats mLatencyStats;
+    private final long mSession = new Random().nextInt(Integer.MAX_VALUE);
+    private final Thread mThread;
+
+    private final Object mLock = new Object();
+    private TargetUpdateMessage mPending = null;
+    private boolean mRunning = true;
+
+    // Sender thread only
+    private DatagramSocket mSocket;
+    private InetAddress mAddress;
+    private long mSeq = 0;
+
+    public UdpTargetSender(String host, int port, LatencyStats latencyStats) {
+        mHost = host;
+        mPort = port;
+        mLatencyStats = latencyStats;
+        mThread = new Thread(new Runnable() {
+            @Override
+            public void run() {
+                sendLoop();
+            }
+        }, "UdpTargetSender");
+        mThread.setDaemon(true);
+        mThread.start();
+    }
+
+    /**
+     * Queues the update for the sender thread without blocking. Its latency is recorded once it
+     * has been sent, or dropped if it fails or a newer update replaces it first.
+     */
+    public void send(TargetUpdateMessage message) {
+        synchronized (mLock) {
+            if (!mRunning) {
+                dropped(message);
+                return;
+            }
+            if (mPending != null) {
+                dropped(mPending);
+            }
+            mPending = message;
+            mLock.notify();
+        }
+    }
+
+    /**
+     * Stops the sender thread; an update it has not sent yet is dropped.
+     */
+    public void close() {
+        synchronized (mLock) {
+            mRunning = false;
+            if (mPending != null) {
+                dropped(mPending);
+                mPending = null;
+            }
+            mLock.notify();
+        }
+    }
+
+    private void dropped(TargetUpdateMessage message) {
+        if (message.getLatency() != null) {
+            mLatencyStats.addDropped();
+        }
+    }
+
+    private void sendLoop() {
+        while (true) {
+            TargetUpdateMessage message;
+            synchronized (mLock) {
+                while (mRunning && mPending == null) {
+                    try {
+                        mLock.wait();
+                    } catch (InterruptedException e) {
+                    }
+                }
+                if (!mRunning) {
+                    break;
+                }
+                message = mPending;
+                mPending = null;
+            }
+            if (sendNow(message)) {
+                if (message.getLatency() != null) {
+                    mLatencyStats.add(message.getLatency());
+                }
+            } else {
+                dropped(message);
+            }
+        }
+        closeSocket();
+    }
+
+    private boolean sendNow(TargetUpdateMessage message) {
+        try {
+            if (mSocket == null) {
+                mAddress = InetAddress.getByName(mHost);
+                mSocket = new DatagramSocket();
+            }
+            byte[] data = message.toDatagramJson(mSession, mSeq++).getBytes();
+            mSocket.send(new DatagramPacket(data, data.length, mAddress, mPort));
+            if (message.getLatency() != null) {
+                message.getLatency().mark(FrameLatency.WRITTEN);
+            }
+            return true;
+        } catch (IOException e) {
+            Log.w("UdpTargetSender", "Could not send target datagram: " + e.getMessage());
+            closeSocket();
+            return false;
+        }
+    }
+
+    private void closeSocket() {
+        if (mSocket != null) {
+            mSocket.close();
+            mSocket = null;
+        }
+    }
+}
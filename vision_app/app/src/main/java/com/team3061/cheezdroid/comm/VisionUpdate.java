@@ -12,6 +12,8 @@ import java.util.List;
 public class VisionUpdate {
     protected List<CameraTargetInfo> m_targets;
     protected long m_captured = 0;
+    protected boolean m_has_robot_clock = false;
+    protected long m_robot_clock_offset = 0;
 
     public VisionUpdate(long capturedAtTimestamp) {
         m_captured = capturedAtTimestamp;
@@ -22,11 +24,44 @@ public class VisionUpdate {
         m_targets.add(t);
     }
 
+    /**
+     * Also stamps the update with its capture time on the robot's clock (capturedAtRobotNs),
+     * given robot time minus System.nanoTime().
+     */
+    public void setRobotClockOffset(long offsetNs) {
+        m_has_robot_clock = true;
+        m_robot_clock_offset = offsetNs;
+    }
+
     public String getSendableJsonString(long timestamp) {
+        return toJson(timestamp).toString();
+    }
+
+    /**
+     * For transports that can lose or reorder updates: adds the sender's session id, a sequence
+     * number and the capture time (System.nanoTime()) so the receiver can throw away anything
+     * older than what it has.
+     */
+    public String getSendableJsonString(long timestamp, long session, long seq) {
+        JSONObject j = toJson(timestamp);
+        try {
+            j.put("session", session);
+            j.put("seq", seq);
+            j.put("capturedAtNs", m_captured);
+        } catch (JSONException e) {
+            Log.e("VisionUpdate", "Could not encode JSON");
+        }
+        return j.toString();
+    }
+
+    private JSONObject toJson(long timestamp) {
         long captured_ago = (timestamp - m_captured) / 1000000L;  // nanos to millis
         JSONObject j = new JSONObject();
         try {
             j.put("capturedAgoMs", captured_ago);
+            if (m_has_robot_clock) {
+                j.put("capturedAtRobotNs", m_captured + m_robot_clock_offset);
+            }
             JSONArray arr = new JSONArray();
             for (CameraTargetInfo t : m_targets) {
                 if (t != null) {
@@ -37,7 +72,6 @@ public class VisionUpdate {
         } catch (JSONException e) {
             Log.e("VisionUpdate", "Could not encode JSON");
         }
-
-        return j.toString();
+        return j;
     }
 }
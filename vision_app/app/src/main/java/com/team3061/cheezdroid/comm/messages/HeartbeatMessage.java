@@ -16,8 +16,12 @@ public class HeartbeatMessage extends VisionMessage {
         return "heartbeat";
     }
 
+    /**
+     * Stamped when serialized, right before the write. The robot echoes t0 with its own receive
+     * and reply times (t1, t2) so the phone can estimate the clock offset.
+     */
     @Override
     public String getMessage() {
-        return "{}";
+        return "{\"t0\":" + System.nanoTime() + "}";
     }
 }
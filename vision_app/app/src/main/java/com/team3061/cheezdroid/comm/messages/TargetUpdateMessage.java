@@ -1,23 +1,65 @@
 package com.team3061.cheezdroid.comm.messages;
 
+import android.util.Log;
+
+import com.team3061.cheezdroid.comm.FrameLatency;
 import com.team3061.cheezdroid.comm.VisionUpdate;
 
+import org.json.JSONException;
+import org.json.JSONObject;
+
 public class TargetUpdateMessage extends VisionMessage {
 
     VisionUpdate mUpdate;
-    long mTimestamp;
+    FrameLatency mLatency;
+
+    public TargetUpdateMessage(VisionUpdate update) {
+        this(update, null);
+    }
 
-    public TargetUpdateMessage(VisionUpdate update, long timestamp) {
+    public TargetUpdateMessage(VisionUpdate update, FrameLatency latency) {
         mUpdate = update;
-        mTimestamp = timestamp;
+        mLatency = latency;
     }
+
+    @Override
+    public FrameLatency getLatency() {
+        return mLatency;
+    }
+
+    public void setRobotClockOffset(long offsetNs) {
+        mUpdate.setRobotClockOffset(offsetNs);
+    }
+
+    @Override
+    public boolean isLatestValueOnly() {
+        return true;
+    }
+
     @Override
     public String getType() {
         return "targets";
     }
 
+    /**
+     * The update as one datagram: the usual envelope, with the sender's session id, a sequence
+     * number and the capture time added to the message.
+     */
+    public String toDatagramJson(long session, long seq) {
+        JSONObject j = new JSONObject();
+        try {
+            j.put("type", getType());
+            j.put("message", mUpdate.getSendableJsonString(System.nanoTime(), session, seq));
+        } catch (JSONException e) {
+            Log.e("TargetUpdateMessage", "Could not encode JSON");
+        }
+        return j.toString();
+    }
+
     @Override
     public String getMessage() {
-        return mUpdate.getSendableJsonString(mTimestamp);
+        // Serialized right before the write, so capturedAgoMs includes the time spent waiting
+        // to be sent
+        return mUpdate.getSendableJsonString(System.nanoTime());
     }
 }
@@ -3,6 +3,8 @@ package com.team3061.cheezdroid.comm.messages;
 
 import android.util.Log;
 
+import com.team3061.cheezdroid.comm.FrameLatency;
+
 import org.json.JSONException;
 import org.json.JSONObject;
 
@@ -12,6 +14,21 @@ public abstract class VisionMessage {
 
     public abstract String getMessage();
 
+    /**
+     * Messages that only matter until a newer one of the same kind exists. RobotConnection keeps
+     * just the newest one instead of queueing them.
+     */
+    public boolean isLatestValueOnly() {
+        return false;
+    }
+
+    /**
+     * Latency record of the frame this message reports on, or null.
+     */
+    public FrameLatency getLatency() {
+        return null;
+    }
+
     public String toJson() {
         JSONObject j = new JSONObject();
         try {
@@ -1,12 +1,62 @@
 LOCAL_PATH := $(call my-dir)
 
+VISION_CPPFLAGS := -O3 -std=c++11
+
+# Detection code shared by the app and the command line tools
+include $(CLEAR_VARS)
+include $(LOCAL_PATH)/OpenCV.mk
+
+LOCAL_MODULE    := visioncore
+LOCAL_SRC_FILES := vision_pipeline.cpp blob_extractor.cpp target_matcher.cpp \
+                   flight_recorder.cpp replay_format.cpp \
+                   rle_mask.cpp packed_mask.cpp hsv_threshold.cpp run_labeler.cpp \
+                   mask_morphology.cpp tiled_extractor.cpp \
+                   streaming_detector.cpp latency_governor.cpp \
+                   robot_protocol.cpp standin_server.cpp frame_source.cpp \
+                   target_drawing.cpp perf_counters.cpp pipeline_config.cpp \
+                   mask_kernels.cpp mask_kernels_x86.cpp
+# The NEON kernels only run after a CPU check, so on armeabi-v7a only their
+# file is built with NEON enabled
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_SRC_FILES += mask_kernels_neon.cpp.neon
+else
+LOCAL_SRC_FILES += mask_kernels_neon.cpp
+endif
+LOCAL_CPPFLAGS  += $(VISION_CPPFLAGS)
+LOCAL_STATIC_LIBRARIES += cpufeatures
+
+include $(BUILD_STATIC_LIBRARY)
+
 # add OpenCV
 include $(CLEAR_VARS)
 include $(LOCAL_PATH)/OpenCV.mk
 
 LOCAL_MODULE    := JNIpart
-LOCAL_SRC_FILES := jni.c image_processor.cpp
+LOCAL_SRC_FILES := jni.c image_processor.cpp gl_frame_source.cpp
+LOCAL_STATIC_LIBRARIES += visioncore
 LOCAL_LDLIBS    += -llog -lGLESv2 -lEGL -ldl
-LOCAL_CPPFLAGS  += -O3 -std=c++11
+LOCAL_CPPFLAGS  += $(VISION_CPPFLAGS)
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Command line tools, run on the phone through adb shell
+define add_vision_tool
+    include $(CLEAR_VARS)
+    include $(LOCAL_PATH)/OpenCV.mk
+    LOCAL_MODULE    := $1
+    LOCAL_SRC_FILES := tools/$1.cpp
+    LOCAL_STATIC_LIBRARIES += visioncore
+    LOCAL_LDLIBS    += -llog -ldl
+    LOCAL_CPPFLAGS  += $(VISION_CPPFLAGS)
+    LOCAL_CFLAGS    += -fPIE
+    LOCAL_LDFLAGS   += -fPIE -pie
+    include $(BUILD_EXECUTABLE)
+endef
+
+VISION_TOOLS := replay_convert replay_bench mask_replay governor_sim robot_standin link_rig \
+                vision_detect micro_bench golden_check scene_gen auto_tune \
+                batch_eval
+
+$(foreach tool,$(VISION_TOOLS),$(eval $(call add_vision_tool,$(tool))))
+
+$(call import-module,android/cpufeatures)
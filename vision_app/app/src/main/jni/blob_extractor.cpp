@@ -0,0 +1,105 @@
+#include "blob_extractor.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+
+static TargetInfo targetFromBox(const cv::Rect &box) {
+  TargetInfo target;
+  target.box = box;
+
+  target.centroid_x  = (target.box.tl().x + target.box.br().x)/2.0;
+  target.centroid_y  = (target.box.tl().y + target.box.br().y)/2.0;
+
+  target.width = target.box.width;
+  target.height = target.box.height;
+  target.leftToRightRatio = 0;
+  return target;
+}
+
+// Keep in mind width/height are in imager terms...
+static bool sizeOk(const TargetInfo &target, const CandidateFilter &filter) {
+  return target.width >= filter.min_width && target.width <= filter.max_width &&
+         target.height >= filter.min_height &&
+         target.height <= filter.max_height;
+}
+
+static bool fullnessOk(int whiteCnt, const TargetInfo &target,
+                       const CandidateFilter &filter) {
+  double fullness = whiteCnt*1.0/target.box.area();
+  if (fullness < filter.min_fullness || fullness > filter.max_fullness) {
+    LOGD("Rejected target due to fullness: %.2lf", fullness);
+    return false;
+  }
+  return true;
+}
+
+int countWhite(const cv::Mat &thresh, const cv::Rect &box) {
+  int threshChannels = thresh.channels();
+  int i,j;
+  int xStart, xStop, yStop;
+  int whiteCnt = 0;
+  xStart = box.tl().x;
+  xStop = box.br().x;
+  yStop = box.br().y;
+  const uchar* p;
+  for( i = box.tl().y; i < yStop; ++i)
+  {
+      p = thresh.ptr<uchar>(i);
+      for ( j = xStart; j < xStop; j+=threshChannels)
+      {
+          whiteCnt += (p[j]==255) ? 1 : 0;
+      }
+  }
+  return whiteCnt;
+}
+
+void extractCandidates(const cv::Mat &thresh, cv::Mat &contour_scratch,
+                       std::vector<TargetInfo> *candidates,
+                       std::vector<TargetInfo> *rejected,
+                       const CandidateFilter &filter) {
+  // accept only char type matrices
+  CV_Assert(thresh.depth() == CV_8U);
+
+  // findContours modifies its input, so work on a copy
+  thresh.copyTo(contour_scratch);
+  std::vector<std::vector<cv::Point>> contours;
+  cv::findContours(contour_scratch, contours, cv::RETR_EXTERNAL, //Find all extreme (outer) contours, save in contours.
+                   cv::CHAIN_APPROX_TC89_KCOS);
+  for (auto &contour : contours) {
+      TargetInfo target = targetFromBox(cv::boundingRect(contour));
+      if (!sizeOk(target, filter)) {
+        //LOGD("Rejecting target due to size");
+        rejected->push_back(std::move(target));
+        continue;
+      }
+
+      int whiteCnt = countWhite(thresh, target.box);
+      if (!fullnessOk(whiteCnt, target, filter)) {
+        rejected->push_back(std::move(target));
+        continue;
+      }
+
+      candidates->push_back(std::move(target));
+  }
+}
+
+void extractCandidates(const PackedMask &mask, const std::vector<Blob> &blobs,
+                       std::vector<TargetInfo> *candidates,
+                       std::vector<TargetInfo> *rejected,
+                       const CandidateFilter &filter) {
+  for (auto &blob : blobs) {
+    TargetInfo target = targetFromBox(blob.box);
+    if (!sizeOk(target, filter)) {
+      rejected->push_back(std::move(target));
+      continue;
+    }
+    // Counts every set pixel in the box, like the contour path, not just
+    // those of this blob
+    if (!fullnessOk(mask.countBox(target.box), target, filter)) {
+      rejected->push_back(std::move(target));
+      continue;
+    }
+    candidates->push_back(std::move(target));
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "packed_mask.hpp"
+#include "run_labeler.hpp"
+#include "targets.hpp"
+
+// Size and fullness limits for candidate strips. Sizes are in pixels of the
+// frame detection ran on.
+struct CandidateFilter {
+  double min_width, max_width;
+  double min_height, max_height;
+  double min_fullness, max_fullness;  // set fraction of the bounding box
+};
+
+static const CandidateFilter kDefaultCandidateFilter = {4, 250, 5, 250, .70, 1};
+
+// Finds the outer contours of a binary threshold image and turns each one
+// into a candidate strip. Only the filters that hold for every kind of target
+// (size and fullness) are applied here; shape tests belong to the matchers.
+//
+// thresh is left untouched. contour_scratch is reused between frames so
+// findContours does not allocate a new image every call.
+void extractCandidates(const cv::Mat &thresh, cv::Mat &contour_scratch,
+                       std::vector<TargetInfo> *candidates,
+                       std::vector<TargetInfo> *rejected,
+                       const CandidateFilter &filter = kDefaultCandidateFilter);
+
+// Number of 255 pixels of thresh inside box; the fullness filter of the
+// contour path
+int countWhite(const cv::Mat &thresh, const cv::Rect &box);
+
+// Same filters, applied to blobs from a RunLabeler. Fullness is counted on
+// the packed mask the blobs were labeled from.
+void extractCandidates(const PackedMask &mask, const std::vector<Blob> &blobs,
+                       std::vector<TargetInfo> *candidates,
+                       std::vector<TargetInfo> *rejected,
+                       const CandidateFilter &filter = kDefaultCandidateFilter);
@@ -1,3 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __ANDROID__
 #include <android/log.h>
 #define LOG_TAG "JNIpart"
 #define LOGV(...)                                                              \
@@ -8,6 +13,15 @@
   ((void)__android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__))
 #define LOGE(...)                                                              \
   ((void)__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__))
+#else
+// Host builds of the tools: verbose/debug logging would swamp benchmark
+// output, so only info and errors are kept, on stderr.
+#include <stdio.h>
+#define LOGV(...) ((void)0)
+#define LOGD(...) ((void)0)
+#define LOGI(...) ((void)fprintf(stderr, __VA_ARGS__), (void)fputc('\n', stderr))
+#define LOGE(...) ((void)fprintf(stderr, __VA_ARGS__), (void)fputc('\n', stderr))
+#endif
 
 #include <time.h> // clock_gettime
 
@@ -20,3 +34,9 @@ static inline int64_t getTimeMs() {
 static inline int getTimeInterval(int64_t startTime) {
   return int(getTimeMs() - startTime);
 }
+
+static inline int64_t getTimeNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
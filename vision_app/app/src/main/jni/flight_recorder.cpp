@@ -0,0 +1,193 @@
+#include "flight_recorder.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+#include "writer_thread.hpp"
+
+// Fastest zlib level. The dump only has to finish before the next one.
+static const int kPngCompression = 1;
+
+void FrameRecord::setTargets(const std::vector<TargetInfo> &found) {
+  num_targets = std::min<int>(found.size(), kMaxRecordedTargets);
+  for (int i = 0; i < num_targets; ++i) {
+    targets[i].type = found[i].type;
+    targets[i].centroid_x = found[i].centroid_x;
+    targets[i].centroid_y = found[i].centroid_y;
+    targets[i].width = found[i].width;
+    targets[i].height = found[i].height;
+    targets[i].leftToRightRatio = found[i].leftToRightRatio;
+  }
+}
+
+FlightRecorder::FlightRecorder(int width, int height, int capacity)
+    : width_(width), height_(height),
+      slots_(new Slot[capacity]), capacity_(capacity),
+      next_slot_(0), next_sequence_(0),
+      recorded_(0), dropped_(0), busy_(false), stop_(false) {
+  for (int i = 0; i < capacity_; ++i) {
+    // Touch every page now so the first lap around the ring doesn't page
+    // fault on the vision thread
+    slots_[i].frame.create(height_, width_, CV_8UC4);
+    slots_[i].frame.setTo(cv::Scalar::all(0));
+  }
+  writer_ = std::thread(&FlightRecorder::writerLoop, this);
+}
+
+FlightRecorder::~FlightRecorder() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+}
+
+void FlightRecorder::record(cv::Mat &frame, const FrameRecord &meta,
+                            OverlayUndo *overlays) {
+  Slot &slot = slots_[next_slot_];
+  next_slot_ = (next_slot_ + 1) % capacity_;
+
+  if (frame.cols != width_ || frame.rows != height_ || frame.type() != CV_8UC4) {
+    dropped_++;
+    return;
+  }
+  int state = slot.state.load();
+  if (state == SLOT_PENDING ||
+      !slot.state.compare_exchange_strong(state, SLOT_RECORDING)) {
+    // The writer owns this slot; keep the old contents and move on
+    dropped_++;
+    return;
+  }
+  std::swap(frame, slot.frame);
+  slot.overlays.swap(*overlays);
+  slot.meta = meta;
+  slot.meta.sequence = next_sequence_++;
+  slot.state.store(SLOT_FILLED);
+  recorded_++;
+}
+
+bool FlightRecorder::persist(const std::string &dir) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (busy_.load()) {
+    return false;
+  }
+  std::vector<int> slots;
+  slots.reserve(capacity_);
+  for (int i = 0; i < capacity_; ++i) {
+    int expected = SLOT_FILLED;
+    if (slots_[i].state.compare_exchange_strong(expected, SLOT_PENDING)) {
+      slots.push_back(i);
+    }
+  }
+  if (slots.empty()) {
+    // The writer would never wake for an empty dump, so busy_ would stick
+    LOGI("Flight recorder has no frames to save");
+    return false;
+  }
+  std::sort(slots.begin(), slots.end(), [this](int a, int b) {
+    return slots_[a].meta.sequence < slots_[b].meta.sequence;
+  });
+  LOGI("Flight recorder saving %d frames to %s", int(slots.size()), dir.c_str());
+
+  busy_.store(true);
+  dump_dir_ = dir;
+  dump_slots_.swap(slots);
+  wake_.notify_one();
+  return true;
+}
+
+void FlightRecorder::writerLoop() {
+  // On Linux the nice value applies to the calling thread only
+  if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), kWriterNice) != 0) {
+    LOGE("Could not lower flight recorder priority: %d", errno);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this] { return stop_ || !dump_slots_.empty(); });
+    if (stop_) {
+      break;
+    }
+    std::string dir;
+    std::vector<int> slots;
+    dir.swap(dump_dir_);
+    slots.swap(dump_slots_);
+
+    lock.unlock();
+    writeDump(dir, slots);
+    lock.lock();
+
+    busy_.store(false);
+  }
+}
+
+void FlightRecorder::writeDump(const std::string &dir,
+                               const std::vector<int> &slots) {
+  int64_t t = getTimeMs();
+  if (mkdir(dir.c_str(), 0775) != 0 && errno != EEXIST) {
+    LOGE("Could not create %s: %d", dir.c_str(), errno);
+  }
+  FILE *csv = fopen((dir + "/frames.csv").c_str(), "w");
+  if (csv == nullptr) {
+    LOGE("Could not open %s/frames.csv", dir.c_str());
+  } else {
+    fprintf(csv, "file,timestamp_ns,h_min,h_max,s_min,s_max,v_min,v_max,mode,"
+                 "num_targets,targets\n");
+  }
+
+  // Reused for every frame so the writer's memory stays bounded
+  cv::Mat clean, bgra;
+  std::vector<int> params = {cv::IMWRITE_PNG_COMPRESSION, kPngCompression};
+  char name[32];
+  int written = 0;
+  for (size_t i = 0; i < slots.size(); ++i) {
+    Slot &slot = slots_[slots[i]];
+    bool stopping;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping = stop_;
+    }
+    if (!stopping && csv != nullptr) {
+      snprintf(name, sizeof(name), "frame_%05d.png", written);
+      // The slot may still be on screen, so the overlays come off a copy
+      const cv::Mat *frame = &slot.frame;
+      if (!slot.overlays.empty()) {
+        slot.frame.copyTo(clean);
+        slot.overlays.restore(clean);
+        frame = &clean;
+      }
+      // PNG expects BGR order; the replay tools swap it back
+      cv::cvtColor(*frame, bgra, CV_RGBA2BGRA);
+      if (cv::imwrite(dir + "/" + name, bgra, params)) {
+        const FrameRecord &m = slot.meta;
+        fprintf(csv, "%s,%lld,%d,%d,%d,%d,%d,%d,%d,%d,", name,
+                (long long)m.timestamp_ns, m.h_min, m.h_max, m.s_min, m.s_max,
+                m.v_min, m.v_max, m.mode, m.num_targets);
+        for (int j = 0; j < m.num_targets; ++j) {
+          const FrameRecord::Target &target = m.targets[j];
+          fprintf(csv, "%s%d:%.2lf:%.2lf:%.2lf:%.2lf:%.4lf", j == 0 ? "" : ";",
+                  target.type, target.centroid_x, target.centroid_y,
+                  target.width, target.height, target.leftToRightRatio);
+        }
+        fprintf(csv, "\n");
+        written++;
+      }
+    }
+    slot.state.store(SLOT_FILLED);
+  }
+  if (csv != nullptr) {
+    fclose(csv);
+  }
+  LOGI("Flight recorder wrote %d frames in %d ms", written, getTimeInterval(t));
+}
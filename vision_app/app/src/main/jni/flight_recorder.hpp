@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "target_drawing.hpp"
+#include "targets.hpp"
+
+static const int kMaxRecordedTargets = 8;
+
+// Everything the pipeline knew about a frame, besides its pixels
+struct FrameRecord {
+  struct Target {
+    int type;
+    double centroid_x, centroid_y;
+    double width, height;
+    double leftToRightRatio;
+  };
+
+  int64_t sequence;
+  int64_t timestamp_ns;
+  int h_min, h_max, s_min, s_max, v_min, v_max;
+  int mode;
+  int num_targets;
+  Target targets[kMaxRecordedTargets];
+
+  void setTargets(const std::vector<TargetInfo> &found);
+};
+
+// Black-box recorder for the last few seconds of raw input frames.
+//
+// The ring is allocated up front. Recording a frame swaps the caller's
+// buffer with the oldest slot, so the vision thread never copies pixels and
+// never blocks. persist() hands the current contents of the ring to a
+// low-priority writer thread, which saves them one at a time as PNG plus a
+// frames.csv with the metadata, the layout the replay tools read.
+//
+// The frame may already have overlays drawn on it for display; the pixels
+// they covered come along as an OverlayUndo, and the writer puts them back
+// before saving. While a slot is being written the vision thread skips it and
+// counts the frame as dropped instead of waiting.
+class FlightRecorder {
+ public:
+  FlightRecorder(int width, int height, int capacity);
+  ~FlightRecorder();
+
+  // Vision thread only. frame must be a width x height RGBA Mat; on return it
+  // holds a different buffer of the same size, ready for the next readback.
+  // overlays is swapped with the slot's as well, so on return it holds stale
+  // contents the caller should clear.
+  void record(cv::Mat &frame, const FrameRecord &meta, OverlayUndo *overlays);
+
+  // Any thread. Starts saving the ring into dir (created if missing). Returns
+  // false if a previous dump is still being written or nothing has been
+  // recorded yet.
+  bool persist(const std::string &dir);
+
+  int64_t recordedFrames() const { return recorded_.load(); }
+  int64_t droppedFrames() const { return dropped_.load(); }
+  bool busy() const { return busy_.load(); }
+
+ private:
+  enum SlotState {
+    SLOT_EMPTY,
+    SLOT_FILLED,
+    SLOT_RECORDING,  // vision thread is swapping in a new frame
+    SLOT_PENDING     // queued for, or being written by, the writer thread
+  };
+
+  struct Slot {
+    Slot(): state(SLOT_EMPTY) { }
+    cv::Mat frame;
+    OverlayUndo overlays;
+    FrameRecord meta;
+    std::atomic<int> state;
+  };
+
+  void writerLoop();
+  void writeDump(const std::string &dir, const std::vector<int> &slots);
+
+  const int width_, height_;
+  std::unique_ptr<Slot[]> slots_;
+  const int capacity_;
+  int next_slot_;  // vision thread only
+  int64_t next_sequence_;
+
+  std::atomic<int64_t> recorded_;
+  std::atomic<int64_t> dropped_;
+  std::atomic<bool> busy_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+  std::string dump_dir_;
+  std::vector<int> dump_slots_;
+  std::thread writer_;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// Layouts a frame can arrive in
+enum PixelFormat {
+  PIXEL_RGBA = 0,  // width x height x 4, as read back from GL
+  PIXEL_NV21 = 1   // Y plane then interleaved VU, as delivered by the camera
+};
+
+// Shape of the cv::Mat that holds one frame: CV_8UC4 rows for RGBA, a single
+// CV_8UC1 plane of height * 3 / 2 rows for NV21
+static inline int frameRows(PixelFormat format, int height) {
+  return format == PIXEL_NV21 ? height * 3 / 2 : height;
+}
+
+static inline uint64_t frameBytes(PixelFormat format, int width, int height) {
+  return format == PIXEL_NV21 ? uint64_t(width) * height * 3 / 2
+                              : uint64_t(width) * height * 4;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <type_traits>
+
+// Frame sizes the per-frame mask loops are compiled for. 640x480 is what the
+// app captures, 320x240 the governor's decimated frame and 1280x720 the
+// largest camera mode. Any other size takes the generic path.
+#define VISION_FIXED_FRAME_SHAPES(X) X(320, 240) X(640, 480) X(1280, 720)
+
+// Frame size known at compile time. Loops written against a shape get
+// constant trip counts, which the compiler can unroll and vectorize.
+template <int W, int H>
+struct FixedShape {
+  int width() const { return W; }
+  int height() const { return H; }
+  int words() const { return (W + 63) / 64; }
+};
+
+// The generic path: the same interface, read at run time
+struct RuntimeShape {
+  RuntimeShape(int width, int height) : w(width), h(height) {}
+
+  int width() const { return w; }
+  int height() const { return h; }
+  int words() const { return (w + 63) / 64; }
+
+  int w, h;
+};
+
+// True if width x height has a FixedShape instantiation
+static inline bool isFixedFrameShape(int width, int height) {
+#define VISION_MATCH_SHAPE(W, H) (width == W && height == H) ||
+  return VISION_FIXED_FRAME_SHAPES(VISION_MATCH_SHAPE) false;
+#undef VISION_MATCH_SHAPE
+}
+
+// Whether a frame's results are rendered; compile-time so a detection-only
+// instantiation drops the visualization code entirely
+typedef std::true_type WithVisualization;
+typedef std::false_type DetectionOnly;
+
+// Calls fn(shape, visualize) with the FixedShape matching width x height, or
+// a RuntimeShape, and WithVisualization or DetectionOnly. fn is a functor
+// with a template operator() over both.
+template <class Fn>
+void dispatchFrameShape(int width, int height, bool visualize, Fn &fn) {
+#define VISION_DISPATCH_SHAPE(W, H)                  \
+  if (width == W && height == H) {                   \
+    if (visualize) {                                 \
+      fn(FixedShape<W, H>(), WithVisualization());   \
+    } else {                                         \
+      fn(FixedShape<W, H>(), DetectionOnly());       \
+    }                                                \
+    return;                                          \
+  }
+  VISION_FIXED_FRAME_SHAPES(VISION_DISPATCH_SHAPE)
+#undef VISION_DISPATCH_SHAPE
+  if (visualize) {
+    fn(RuntimeShape(width, height), WithVisualization());
+  } else {
+    fn(RuntimeShape(width, height), DetectionOnly());
+  }
+}
@@ -0,0 +1,231 @@
+#include "frame_source.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+
+static const int64_t kDirFramePeriodNs = 1000000000LL / 30;
+
+static bool endsWith(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Converts a decoded BGR(A) or gray image into the pipeline's RGBA input
+static void toInput(const cv::Mat &image, VisionPipeline *pipeline) {
+  cv::Mat &input = pipeline->inputBuffer(image.cols, image.rows);
+  if (image.channels() == 4) {
+    cv::cvtColor(image, input, CV_BGRA2RGBA);
+  } else if (image.channels() == 3) {
+    cv::cvtColor(image, input, CV_BGR2RGBA);
+  } else {
+    cv::cvtColor(image, input, CV_GRAY2RGBA);
+  }
+}
+
+ImageDirSource::ImageDirSource(const std::string &dir, int raw_width, int raw_height)
+    : dir_(dir), raw_width_(raw_width), raw_height_(raw_height) {
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) {
+    LOGE("Could not open %s", dir.c_str());
+    return;
+  }
+  while (struct dirent *entry = readdir(d)) {
+    std::string name = entry->d_name;
+    if (endsWith(name, ".png") || (raw_width > 0 && endsWith(name, ".rgba"))) {
+      files_.push_back(name);
+    }
+  }
+  closedir(d);
+  std::sort(files_.begin(), files_.end());
+}
+
+bool ImageDirSource::next(VisionPipeline *pipeline, int64_t *timestamp_ns) {
+  if (next_ >= files_.size()) {
+    return false;
+  }
+  std::string path = dir_ + "/" + files_[next_];
+  if (endsWith(path, ".rgba")) {
+    cv::Mat &input = pipeline->inputBuffer(raw_width_, raw_height_);
+    FILE *file = fopen(path.c_str(), "rb");
+    bool ok = file != nullptr &&
+              fread(input.data, input.total() * input.elemSize(), 1, file) == 1;
+    if (file != nullptr) {
+      fclose(file);
+    }
+    if (!ok) {
+      LOGE("Could not read %s", path.c_str());
+      return false;
+    }
+    width_ = raw_width_;
+    height_ = raw_height_;
+  } else {
+    decoded_ = cv::imread(path, cv::IMREAD_UNCHANGED);
+    if (decoded_.empty()) {
+      LOGE("Could not read %s", path.c_str());
+      return false;
+    }
+    toInput(decoded_, pipeline);
+    width_ = decoded_.cols;
+    height_ = decoded_.rows;
+  }
+  *timestamp_ns = int64_t(next_) * kDirFramePeriodNs;
+  ++next_;
+  return true;
+}
+
+bool PipeSource::readFully(void *data, size_t length) {
+  uint8_t *out = static_cast<uint8_t *>(data);
+  while (length > 0) {
+    ssize_t n = read(fd_, out, length);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    out += n;
+    length -= n;
+  }
+  return true;
+}
+
+bool PipeSource::next(VisionPipeline *pipeline, int64_t *timestamp_ns) {
+  int64_t stamp = 0;
+  if (timestamped_ && !readFully(&stamp, sizeof(stamp))) {
+    return false;
+  }
+  cv::Mat *frame;
+  if (format_ == PIXEL_RGBA) {
+    frame = &pipeline->inputBuffer(width_, height_);
+  } else {
+    nv21_.create(frameRows(format_, height_), width_, CV_8UC1);
+    frame = &nv21_;
+  }
+  if (!readFully(frame->data, frameBytes(format_, width_, height_))) {
+    return false;
+  }
+  if (format_ != PIXEL_RGBA) {
+    pipeline->setInput(nv21_, format_);
+  }
+  *timestamp_ns = timestamped_ ? stamp : getTimeNs();
+  return true;
+}
+
+VideoSource::VideoSource(const std::string &path) : capture_(path) {
+  if (capture_.isOpened()) {
+    width_ = int(capture_.get(cv::CAP_PROP_FRAME_WIDTH));
+    height_ = int(capture_.get(cv::CAP_PROP_FRAME_HEIGHT));
+  }
+}
+
+bool VideoSource::next(VisionPipeline *pipeline, int64_t *timestamp_ns) {
+  if (!capture_.read(decoded_) || decoded_.empty()) {
+    return false;
+  }
+  toInput(decoded_, pipeline);
+  width_ = decoded_.cols;
+  height_ = decoded_.rows;
+  *timestamp_ns = int64_t(capture_.get(cv::CAP_PROP_POS_MSEC) * 1e6);
+  return true;
+}
+
+bool ReplaySource::next(VisionPipeline *pipeline, int64_t *timestamp_ns) {
+  if (next_ >= replay_.frameCount()) {
+    return false;
+  }
+  if (next_ % 16 == 0) {
+    replay_.prefetch(next_, std::min(16, replay_.frameCount() - next_));
+  }
+  pipeline->setInput(replay_.frame(next_), replay_.pixelFormat());
+  *timestamp_ns = replay_.meta(next_).timestamp_ns;
+  ++next_;
+  return true;
+}
+
+// "WxH" at the start of s; returns the rest
+static bool parseSize(const std::string &s, int *width, int *height, std::string *rest) {
+  int consumed = 0;
+  if (sscanf(s.c_str(), "%dx%d%n", width, height, &consumed) != 2 ||
+      *width <= 0 || *height <= 0) {
+    return false;
+  }
+  *rest = s.substr(consumed);
+  return true;
+}
+
+std::unique_ptr<FrameSource> openFrameSource(const std::string &spec) {
+  size_t colon = spec.find(':');
+  std::string kind = spec.substr(0, colon);
+  std::string arg = colon == std::string::npos ? "" : spec.substr(colon + 1);
+  if (kind == "dir") {
+    // Directory names may contain ':', so the size is only taken from the end
+    int width = 0, height = 0;
+    size_t last = arg.rfind(':');
+    std::string rest;
+    if (last != std::string::npos && parseSize(arg.substr(last + 1), &width, &height, &rest) &&
+        rest.empty()) {
+      arg = arg.substr(0, last);
+    } else {
+      width = height = 0;
+    }
+    std::unique_ptr<ImageDirSource> source(new ImageDirSource(arg, width, height));
+    if (source->frameCount() == 0) {
+      LOGE("No frames in %s", arg.c_str());
+      return nullptr;
+    }
+    return std::unique_ptr<FrameSource>(source.release());
+  }
+  if (kind == "pipe") {
+    int width, height;
+    std::string rest;
+    if (!parseSize(arg, &width, &height, &rest)) {
+      LOGE("Bad frame size in %s", spec.c_str());
+      return nullptr;
+    }
+    PixelFormat format = PIXEL_RGBA;
+    bool timestamped = false;
+    while (!rest.empty()) {
+      size_t end = rest.find(':', 1);
+      std::string option = rest.substr(1, end == std::string::npos ? end : end - 1);
+      if (rest[0] != ':' || (option != "nv21" && option != "ts")) {
+        LOGE("Bad pipe option in %s", spec.c_str());
+        return nullptr;
+      }
+      if (option == "nv21") {
+        format = PIXEL_NV21;
+      } else {
+        timestamped = true;
+      }
+      rest = end == std::string::npos ? "" : rest.substr(end);
+    }
+    return std::unique_ptr<FrameSource>(
+        new PipeSource(STDIN_FILENO, width, height, format, timestamped));
+  }
+  if (kind == "video") {
+    std::unique_ptr<VideoSource> source(new VideoSource(arg));
+    if (!source->isOpened()) {
+      LOGE("Could not open video %s", arg.c_str());
+      return nullptr;
+    }
+    return std::unique_ptr<FrameSource>(source.release());
+  }
+  if (kind == "replay") {
+    std::unique_ptr<ReplaySource> source(new ReplaySource());
+    if (!source->open(arg)) {
+      return nullptr;
+    }
+    return std::unique_ptr<FrameSource>(source.release());
+  }
+  LOGE("Unknown frame source %s", spec.c_str());
+  return nullptr;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "frame_format.hpp"
+#include "replay_format.hpp"
+#include "vision_pipeline.hpp"
+
+// Where frames come from. next() puts the next frame into a pipeline's
+// input, either by filling VisionPipeline::inputBuffer() in place or by
+// pointing setInput() at memory the source owns, so frames are not copied on
+// the way in. A frame set with setInput() stays valid until the next call to
+// next(). Sources that decode or convert (PNG, video) do it straight into
+// the input buffer.
+class FrameSource {
+ public:
+  virtual ~FrameSource() {}
+
+  // Returns false at the end of the stream or on an error
+  virtual bool next(VisionPipeline *pipeline, int64_t *timestamp_ns) = 0;
+
+  // Frame size; 0 until the first frame for sources that learn it from the
+  // data
+  virtual int width() const = 0;
+  virtual int height() const = 0;
+};
+
+// Opens a source from a command line spec:
+//
+//   dir:PATH[:WxH]           *.png in PATH in name order, and with WxH also
+//                            raw *.rgba files of that size; 30 fps timestamps
+//   pipe:WxH[:nv21][:ts]     raw frames on stdin, RGBA unless nv21; with ts
+//                            each frame is preceded by an int64 timestamp in
+//                            ns, otherwise frames are stamped on arrival
+//   video:PATH               anything cv::VideoCapture can open
+//   replay:PATH              a .vrpl replay file
+//
+// Returns null and logs the reason if the spec is bad or the source can't be
+// opened. The GL readback source is fed by the app instead.
+std::unique_ptr<FrameSource> openFrameSource(const std::string &spec);
+
+class ImageDirSource : public FrameSource {
+ public:
+  // raw_width/raw_height give the size of *.rgba files; 0 skips them
+  ImageDirSource(const std::string &dir, int raw_width, int raw_height);
+
+  bool next(VisionPipeline *pipeline, int64_t *timestamp_ns) override;
+  int width() const override { return width_; }
+  int height() const override { return height_; }
+  size_t frameCount() const { return files_.size(); }
+
+ private:
+  std::string dir_;
+  std::vector<std::string> files_;
+  size_t next_ = 0;
+  int raw_width_, raw_height_;
+  int width_ = 0, height_ = 0;
+  cv::Mat decoded_;
+};
+
+// Raw frames back to back on a file descriptor, e.g. stdin fed by another
+// process. RGBA frames are read straight into the input buffer.
+class PipeSource : public FrameSource {
+ public:
+  PipeSource(int fd, int width, int height, PixelFormat format, bool timestamped)
+      : fd_(fd), width_(width), height_(height), format_(format),
+        timestamped_(timestamped) {}
+
+  bool next(VisionPipeline *pipeline, int64_t *timestamp_ns) override;
+  int width() const override { return width_; }
+  int height() const override { return height_; }
+
+ private:
+  bool readFully(void *data, size_t length);
+
+  int fd_;
+  int width_, height_;
+  PixelFormat format_;
+  bool timestamped_;
+  cv::Mat nv21_;
+};
+
+class VideoSource : public FrameSource {
+ public:
+  explicit VideoSource(const std::string &path);
+
+  bool isOpened() const { return capture_.isOpened(); }
+  bool next(VisionPipeline *pipeline, int64_t *timestamp_ns) override;
+  int width() const override { return width_; }
+  int height() const override { return height_; }
+
+ private:
+  cv::VideoCapture capture_;
+  cv::Mat decoded_;
+  int width_ = 0, height_ = 0;
+};
+
+class ReplaySource : public FrameSource {
+ public:
+  bool open(const std::string &path) { return replay_.open(path); }
+
+  bool next(VisionPipeline *pipeline, int64_t *timestamp_ns) override;
+  int width() const override { return replay_.width(); }
+  int height() const override { return replay_.height(); }
+
+  // Metadata of the frame last returned by next()
+  const ReplayFrameMeta &meta() const { return replay_.meta(next_ - 1); }
+
+ private:
+  ReplayReader replay_;
+  int next_ = 0;
+};
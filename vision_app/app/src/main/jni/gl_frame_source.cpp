@@ -0,0 +1,14 @@
+#include "gl_frame_source.hpp"
+
+#include <GLES2/gl2.h>
+
+bool GlReadbackSource::next(VisionPipeline *pipeline, int64_t *timestamp_ns) {
+  readRows(pipeline, 0, height_);
+  *timestamp_ns = timestamp_ns_;
+  return true;
+}
+
+void GlReadbackSource::readRows(VisionPipeline *pipeline, int first, int count) {
+  cv::Mat &input = pipeline->inputBuffer(width_, height_);
+  glReadPixels(0, first, width_, count, GL_RGBA, GL_UNSIGNED_BYTE, input.ptr(first));
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "frame_source.hpp"
+
+// Reads the frame the camera was rendered into back from the current GL
+// framebuffer, straight into the pipeline's input buffer. Lives with the JNI
+// code since it needs a GL context.
+class GlReadbackSource : public FrameSource {
+ public:
+  GlReadbackSource(int width, int height, int64_t timestamp_ns)
+      : width_(width), height_(height), timestamp_ns_(timestamp_ns) {}
+
+  // The whole frame in one read
+  bool next(VisionPipeline *pipeline, int64_t *timestamp_ns) override;
+
+  // Rows [first, first + count) only, for handing a frame to the pipeline in
+  // batches as it is read back
+  void readRows(VisionPipeline *pipeline, int first, int count);
+
+  int width() const override { return width_; }
+  int height() const override { return height_; }
+  int64_t timestampNs() const { return timestamp_ns_; }
+
+ private:
+  int width_, height_;
+  int64_t timestamp_ns_;
+};
@@ -0,0 +1,44 @@
+#include "hsv_threshold.hpp"
+
+#include <algorithm>
+
+#include "mask_kernels.hpp"
+
+static void fillRange(uint8_t *table, uint8_t *lo, uint8_t *hi, int min, int max) {
+  for (int i = 0; i < 256; ++i) {
+    table[i] = (i >= min && i <= max) ? 1 : 0;
+  }
+  min = std::max(min, 0);
+  max = std::min(max, 255);
+  if (min > max) {
+    *lo = 255;
+    *hi = 0;
+  } else {
+    *lo = uint8_t(min);
+    *hi = uint8_t(max);
+  }
+}
+
+void HsvLut::build(const HsvThresholds &thresholds) {
+  fillRange(h, &lo[0], &hi[0], thresholds.h_min, thresholds.h_max);
+  fillRange(s, &lo[1], &hi[1], thresholds.s_min, thresholds.s_max);
+  fillRange(v, &lo[2], &hi[2], thresholds.v_min, thresholds.v_max);
+}
+
+void thresholdPacked(const cv::Mat &hsv, const HsvLut &lut, PackedMask *mask) {
+  if (mask->width != hsv.cols || mask->height != hsv.rows) {
+    mask->create(hsv.cols, hsv.rows);
+  }
+  thresholdPackedRows(hsv, lut, mask, 0);
+}
+
+void thresholdPackedRows(const cv::Mat &hsv, const HsvLut &lut, PackedMask *mask,
+                         int first_row) {
+  CV_Assert(hsv.type() == CV_8UC3 && hsv.cols == mask->width &&
+            first_row + hsv.rows <= mask->height);
+  // Every word is rewritten, so the padding bits stay zero
+  const auto thresholdRow = maskKernels().threshold_row;
+  for (int y = 0; y < hsv.rows; ++y) {
+    thresholdRow(hsv.ptr<uint8_t>(y), hsv.cols, lut, mask->row(first_row + y));
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <opencv2/core.hpp>
+
+#include "packed_mask.hpp"
+
+struct HsvThresholds {
+  int h_min, h_max;
+  int s_min, s_max;
+  int v_min, v_max;
+};
+
+static inline bool operator==(const HsvThresholds &a, const HsvThresholds &b) {
+  return a.h_min == b.h_min && a.h_max == b.h_max && a.s_min == b.s_min &&
+         a.s_max == b.s_max && a.v_min == b.v_min && a.v_max == b.v_max;
+}
+
+static inline bool operator!=(const HsvThresholds &a, const HsvThresholds &b) {
+  return !(a == b);
+}
+
+// Per-channel lookup tables for an HSV range test. A pixel passes when
+// h[H] & s[S] & v[V] is nonzero, which matches cv::inRange (both bounds
+// inclusive) without any compares in the inner loop.
+struct HsvLut {
+  uint8_t h[256];
+  uint8_t s[256];
+  uint8_t v[256];
+  // The same ranges as bounds clamped to 0-255, for the vector kernels that
+  // compare instead of looking up. An empty range is lo 255, hi 0.
+  uint8_t lo[3];
+  uint8_t hi[3];
+
+  void build(const HsvThresholds &thresholds);
+};
+
+// Thresholds a 3-channel HSV image straight into a packed mask
+void thresholdPacked(const cv::Mat &hsv, const HsvLut &lut, PackedMask *mask);
+
+// Same for a strip of rows: writes mask rows [first_row, first_row + hsv.rows).
+// The mask must already have the full frame size.
+void thresholdPackedRows(const cv::Mat &hsv, const HsvLut &lut, PackedMask *mask,
+                         int first_row);
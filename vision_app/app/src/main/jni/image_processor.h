@@ -6,20 +6,59 @@
 extern "C" {
 #endif
 
+  jlong createPipeline();
+
+  void destroyPipeline(jlong handle);
+
   void processFrame(JNIEnv* env,
+                    jlong handle,
                     int tex1,
                     int tex2,
                     int w,
                     int h,
+                    jlong timestamp,
                     int mode,
-                    int h_min,
-                    int h_max,
-                    int s_min,
-                    int s_max,
-                    int v_min,
-                    int v_max,
                     jobject destTargetInfo);
 
+  void setConfigChannel(jlong handle, jlong channel);
+
+  void setEnabledMatchers(jlong handle, int mask);
+
+  void setMorphology(jlong handle, int op, int w, int h);
+
+  void setStreamingReadback(jlong handle, int rows);
+
+  void setLatencyTarget(jlong handle, int target_us);
+
+  jlong benchmarkTargetsInfo(JNIEnv* env, jlong handle, jobject destTargetInfo,
+                             int iterations);
+
+  void enableFlightRecorder(jlong handle, int w, int h, int frames);
+
+  jboolean persistFlightRecorder(JNIEnv* env, jlong handle, jstring dir);
+
+  jboolean startMaskRecording(JNIEnv* env, jlong handle, jstring file, int w, int h);
+
+  void stopMaskRecording(jlong handle);
+
+  jlong createConfigChannel();
+
+  void destroyConfigChannel(jlong handle);
+
+  jstring validateConfig(JNIEnv* env, jstring text);
+
+  jstring publishConfig(JNIEnv* env, jlong handle, jstring text);
+
+  jlong createClockEstimator();
+
+  void destroyClockEstimator(jlong handle);
+
+  void resetClockEstimator(jlong handle);
+
+  jboolean addClockSample(jlong handle, jlong t0, jlong t1, jlong t2, jlong t3);
+
+  jboolean getClockEstimate(JNIEnv* env, jlong handle, jlongArray offsetAndRtt);
+
 #ifdef __cplusplus
 }
 #endif
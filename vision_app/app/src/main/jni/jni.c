@@ -1,19 +1,181 @@
 #include "image_processor.h"
 
+JNIEXPORT jlong JNICALL Java_com_team3061_cheezdroid_NativePart_createPipeline(
+    JNIEnv *env,
+    jclass cls) {
+  return createPipeline();
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_destroyPipeline(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle) {
+  destroyPipeline(handle);
+}
+
 JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_processFrame(
     JNIEnv *env,
     jclass cls,
+    jlong handle,
     jint tex1,
     jint tex2,
     jint w,
     jint h,
+    jlong timestamp,
     jint mode,
-    jint h_min,
-    jint h_max,
-    jint s_min,
-    jint s_max,
-    jint v_min,
-    jint v_max,
     jobject destTargetInfo) {
-  processFrame(env, tex1, tex2, w, h, mode, h_min, h_max, s_min, s_max, v_min, v_max, destTargetInfo);
+  processFrame(env, handle, tex1, tex2, w, h, timestamp, mode, destTargetInfo);
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_setConfigChannel(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jlong channel) {
+  setConfigChannel(handle, channel);
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_setEnabledMatchers(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jint mask) {
+  setEnabledMatchers(handle, mask);
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_setMorphology(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jint op,
+    jint w,
+    jint h) {
+  setMorphology(handle, op, w, h);
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_setStreamingReadback(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jint rows) {
+  setStreamingReadback(handle, rows);
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_setLatencyTarget(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jint targetUs) {
+  setLatencyTarget(handle, targetUs);
+}
+
+JNIEXPORT jlong JNICALL Java_com_team3061_cheezdroid_NativePart_benchmarkTargetsInfo(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jobject destTargetInfo,
+    jint iterations) {
+  return benchmarkTargetsInfo(env, handle, destTargetInfo, iterations);
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_enableFlightRecorder(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jint w,
+    jint h,
+    jint frames) {
+  enableFlightRecorder(handle, w, h, frames);
+}
+
+JNIEXPORT jboolean JNICALL Java_com_team3061_cheezdroid_NativePart_persistFlightRecorder(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jstring dir) {
+  return persistFlightRecorder(env, handle, dir);
+}
+
+JNIEXPORT jboolean JNICALL Java_com_team3061_cheezdroid_NativePart_startMaskRecording(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jstring file,
+    jint w,
+    jint h) {
+  return startMaskRecording(env, handle, file, w, h);
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_stopMaskRecording(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle) {
+  stopMaskRecording(handle);
+}
+
+JNIEXPORT jlong JNICALL Java_com_team3061_cheezdroid_NativePart_createConfigChannel(
+    JNIEnv *env,
+    jclass cls) {
+  return createConfigChannel();
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_destroyConfigChannel(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle) {
+  destroyConfigChannel(handle);
+}
+
+JNIEXPORT jstring JNICALL Java_com_team3061_cheezdroid_NativePart_validateConfig(
+    JNIEnv *env,
+    jclass cls,
+    jstring text) {
+  return validateConfig(env, text);
+}
+
+JNIEXPORT jstring JNICALL Java_com_team3061_cheezdroid_NativePart_publishConfig(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jstring text) {
+  return publishConfig(env, handle, text);
+}
+
+JNIEXPORT jlong JNICALL Java_com_team3061_cheezdroid_NativePart_createClockEstimator(
+    JNIEnv *env,
+    jclass cls) {
+  return createClockEstimator();
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_destroyClockEstimator(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle) {
+  destroyClockEstimator(handle);
+}
+
+JNIEXPORT void JNICALL Java_com_team3061_cheezdroid_NativePart_resetClockEstimator(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle) {
+  resetClockEstimator(handle);
+}
+
+JNIEXPORT jboolean JNICALL Java_com_team3061_cheezdroid_NativePart_addClockSample(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jlong t0,
+    jlong t1,
+    jlong t2,
+    jlong t3) {
+  return addClockSample(handle, t0, t1, t2, t3);
+}
+
+JNIEXPORT jboolean JNICALL Java_com_team3061_cheezdroid_NativePart_getClockEstimate(
+    JNIEnv *env,
+    jclass cls,
+    jlong handle,
+    jlongArray offsetAndRtt) {
+  return getClockEstimate(env, handle, offsetAndRtt);
 }
@@ -0,0 +1,66 @@
+#include "latency_governor.hpp"
+
+#include "common.hpp"
+
+LatencyGovernor::LatencyGovernor()
+    : config_(kDefaultGovernorConfig), level_(GOV_FULL), pinned_(false), over_count_(0),
+      under_count_(0), misses_(0), frame_counter_(0) {
+  config_.target_ns = 0;
+}
+
+void LatencyGovernor::configure(const GovernorConfig &config) {
+  config_ = config;
+  if (config_.degrade_frames < 1) {
+    config_.degrade_frames = 1;
+  }
+  if (config_.recover_frames < 1) {
+    config_.recover_frames = 1;
+  }
+  if (!enabled() && !pinned_) {
+    setLevel(GOV_FULL);
+  }
+}
+
+void LatencyGovernor::pin(GovernorLevel level) {
+  pinned_ = level != NUM_GOVERNOR_LEVELS;
+  setLevel(pinned_ ? level : GOV_FULL);
+}
+
+bool LatencyGovernor::shouldProcess() {
+  ++frame_counter_;
+  return level_ < GOV_FRAME_SKIP || (frame_counter_ & 1) == 0;
+}
+
+void LatencyGovernor::update(int64_t frame_ns) {
+  if (!enabled() || pinned_) {
+    return;
+  }
+  if (frame_ns > config_.target_ns) {
+    ++misses_;
+    ++over_count_;
+    under_count_ = 0;
+    if (over_count_ >= config_.degrade_frames &&
+        level_ + 1 < NUM_GOVERNOR_LEVELS) {
+      setLevel(level_ + 1);
+    }
+  } else if (frame_ns < config_.target_ns * config_.recover_fraction) {
+    ++under_count_;
+    over_count_ = 0;
+    if (under_count_ >= config_.recover_frames && level_ > GOV_FULL) {
+      setLevel(level_ - 1);
+    }
+  } else {
+    // Inside the hysteresis band: neither counts
+    over_count_ = 0;
+    under_count_ = 0;
+  }
+}
+
+void LatencyGovernor::setLevel(int level) {
+  if (level != level_) {
+    LOGD("Latency governor level %d -> %d", level_, level);
+  }
+  level_ = static_cast<GovernorLevel>(level);
+  over_count_ = 0;
+  under_count_ = 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+// How much of the pipeline runs. Each level includes the savings of the
+// levels before it. Values are shared with NativePart.java.
+enum GovernorLevel {
+  GOV_FULL = 0,        // everything
+  GOV_NO_VIS = 1,      // no overlay drawing; the raw frame is shown
+  GOV_DECIMATED = 2,   // detection on a half-resolution frame
+  GOV_ROI_ONLY = 3,    // detection only around the last targets (decimated
+                       // full frame when there are none)
+  GOV_FRAME_SKIP = 4,  // as ROI_ONLY, and only every other frame
+  NUM_GOVERNOR_LEVELS
+};
+
+struct GovernorConfig {
+  int64_t target_ns;       // per-frame budget; 0 disables the governor
+  int degrade_frames;      // consecutive misses before stepping down
+  int recover_frames;      // consecutive fast frames before stepping up
+  double recover_fraction; // "fast" means under this fraction of the budget
+};
+
+static const GovernorConfig kDefaultGovernorConfig = {12000000, 3, 30, 0.6};
+
+// Steps through GovernorLevels to keep frame times under a budget. It only
+// sees the frame times it is given, so the same sequence of times always
+// produces the same sequence of levels.
+//
+// The gap between the miss threshold (the budget) and the recovery threshold
+// (recover_fraction of it), together with the frame counts, keeps the level
+// from bouncing when load sits near the budget.
+class LatencyGovernor {
+ public:
+  LatencyGovernor();
+
+  void configure(const GovernorConfig &config);
+  bool enabled() const { return config_.target_ns > 0; }
+
+  GovernorLevel level() const { return level_; }
+
+  // Holds the level fixed, for tools that measure a single level. The
+  // budget then has no effect; NUM_GOVERNOR_LEVELS releases it.
+  void pin(GovernorLevel level);
+
+  // Whether the next frame should be processed at all; only false at
+  // GOV_FRAME_SKIP. Call once per camera frame.
+  bool shouldProcess();
+
+  // Reports how long a processed frame took
+  void update(int64_t frame_ns);
+
+  int64_t misses() const { return misses_; }
+
+ private:
+  void setLevel(int level);
+
+  GovernorConfig config_;
+  GovernorLevel level_;
+  bool pinned_;
+  int over_count_;
+  int under_count_;
+  int64_t misses_;
+  int64_t frame_counter_;
+};
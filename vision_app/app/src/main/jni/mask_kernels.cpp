@@ -0,0 +1,168 @@
+#include "mask_kernels.hpp"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__arm__) && defined(__ANDROID__)
+#include <cpu-features.h>
+#endif
+
+#include "common.hpp"
+#include "hsv_threshold.hpp"
+
+// Variant tables from the instruction set specific files; each adds nothing
+// when built for another architecture
+void addX86MaskKernels(std::vector<const MaskKernels *> *variants);
+void addNeonMaskKernels(std::vector<const MaskKernels *> *variants);
+
+static unsigned detectCpuFeatures() {
+  unsigned features = 0;
+#if defined(__aarch64__)
+  features |= KERNEL_CPU_NEON;
+#elif defined(__arm__) && defined(__ANDROID__)
+  if (android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM &&
+      (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON)) {
+    features |= KERNEL_CPU_NEON;
+  }
+#elif defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3")) {
+    features |= KERNEL_CPU_SSSE3;
+  }
+  if (__builtin_cpu_supports("popcnt")) {
+    features |= KERNEL_CPU_POPCNT;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    features |= KERNEL_CPU_AVX2;
+  }
+#endif
+  return features;
+}
+
+unsigned cpuFeatures() {
+  static const unsigned features = detectCpuFeatures();
+  return features;
+}
+
+static void thresholdRowScalar(const uint8_t *hsv, int width, const HsvLut &lut,
+                               uint64_t *words) {
+  const uint8_t *p = hsv;
+  int words_per_row = (width + 63) / 64;
+  for (int i = 0; i < words_per_row; ++i) {
+    int count = std::min(64, width - i * 64);
+    uint64_t word = 0;
+    for (int bit = 0; bit < count; ++bit, p += 3) {
+      uint64_t pass = lut.h[p[0]] & lut.s[p[1]] & lut.v[p[2]];
+      word |= pass << bit;
+    }
+    words[i] = word;
+  }
+}
+
+static void packRowScalar(const uint8_t *mask, int width, uint64_t *words) {
+  int words_per_row = (width + 63) / 64;
+  for (int i = 0; i < words_per_row; ++i) {
+    int count = std::min(64, width - i * 64);
+    uint64_t word = 0;
+    for (int bit = 0; bit < count; ++bit) {
+      word |= uint64_t(mask[i * 64 + bit] != 0) << bit;
+    }
+    words[i] = word;
+  }
+}
+
+static int countBoxScalar(const uint64_t *words, int words_per_row, int rows,
+                          int first_word, int last_word, uint64_t first_mask,
+                          uint64_t last_mask) {
+  if (first_word == last_word) {
+    first_mask &= last_mask;
+  }
+  int count = 0;
+  for (int y = 0; y < rows; ++y, words += words_per_row) {
+    count += __builtin_popcountll(words[first_word] & first_mask);
+    if (first_word == last_word) {
+      continue;
+    }
+    for (int i = first_word + 1; i < last_word; ++i) {
+      count += __builtin_popcountll(words[i]);
+    }
+    count += __builtin_popcountll(words[last_word] & last_mask);
+  }
+  return count;
+}
+
+static void rowRunsScalar(const uint64_t *words, int words_per_row, int width, int y,
+                          std::vector<MaskRun> *runs) {
+  bool inRun = false;
+  int start = 0;
+  for (int i = 0; i < words_per_row; ++i) {
+    uint64_t word = words[i];
+    // Whole words inside or outside a run need no bit scanning
+    if (word == (inRun ? ~0ULL : 0)) {
+      continue;
+    }
+    scanRunWord(word, i * 64, y, &inRun, &start, runs);
+  }
+  finishRowRuns(width, y, inRun, start, runs);
+}
+
+static const MaskKernels kScalarKernels = {
+  "scalar", 0, thresholdRowScalar, packRowScalar, countBoxScalar, rowRunsScalar
+};
+
+const MaskKernels &scalarMaskKernels() {
+  return kScalarKernels;
+}
+
+static std::vector<const MaskKernels *> allVariants() {
+  std::vector<const MaskKernels *> variants = {&kScalarKernels};
+  addX86MaskKernels(&variants);
+  addNeonMaskKernels(&variants);
+  return variants;
+}
+
+std::vector<const MaskKernels *> supportedMaskKernels() {
+  std::vector<const MaskKernels *> supported;
+  unsigned features = cpuFeatures();
+  for (const MaskKernels *variant : allVariants()) {
+    if ((variant->required & features) == variant->required) {
+      supported.push_back(variant);
+    }
+  }
+  return supported;
+}
+
+static std::atomic<const MaskKernels *> sActiveKernels(nullptr);
+
+bool selectMaskKernels(const std::string &name) {
+  std::vector<const MaskKernels *> supported = supportedMaskKernels();
+  if (name.empty() || name == "auto") {
+    sActiveKernels = supported.back();
+    return true;
+  }
+  for (const MaskKernels *variant : supported) {
+    if (name == variant->name) {
+      sActiveKernels = variant;
+      return true;
+    }
+  }
+  return false;
+}
+
+const MaskKernels &maskKernels() {
+  const MaskKernels *active = sActiveKernels;
+  if (active == nullptr) {
+    const char *forced = getenv("VISION_KERNELS");
+    if (forced == nullptr || !selectMaskKernels(forced)) {
+      if (forced != nullptr) {
+        LOGE("VISION_KERNELS=%s is not supported here", forced);
+      }
+      selectMaskKernels("auto");
+    }
+    active = sActiveKernels;
+    LOGD("Mask kernels: %s", active->name);
+  }
+  return *active;
+}
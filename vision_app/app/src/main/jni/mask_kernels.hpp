@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "rle_mask.hpp"
+
+struct HsvLut;
+
+// CPU features the kernel variants can depend on
+enum KernelCpuFeature {
+  KERNEL_CPU_NEON = 1 << 0,
+  KERNEL_CPU_SSSE3 = 1 << 1,
+  KERNEL_CPU_POPCNT = 1 << 2,
+  KERNEL_CPU_AVX2 = 1 << 3,
+};
+
+// KernelCpuFeature bits of this CPU, detected on first use
+unsigned cpuFeatures();
+
+// The per-row kernels behind thresholding, packing, fullness counting and
+// run extraction, as one table per instruction set. Every variant produces
+// exactly the same bits and runs as the scalar one, which is the reference
+// the others are checked against (micro_bench does this for every variant
+// the CPU supports). A variant that has nothing to gain on a kernel keeps the
+// scalar function for it.
+//
+// Rows are (width + 63) / 64 words; the kernels that write rows write every
+// word, keeping the padding bits past width zero.
+struct MaskKernels {
+  const char *name;
+  unsigned required;  // KernelCpuFeature bits
+
+  // One row of 3-channel HSV pixels through the LUT's ranges
+  void (*threshold_row)(const uint8_t *hsv, int width, const HsvLut &lut,
+                        uint64_t *words);
+  // One row of an 8-bit mask; any nonzero byte is set
+  void (*pack_row)(const uint8_t *mask, int width, uint64_t *words);
+  // Set bits in words [first_word, last_word] of `rows` rows, the first and
+  // last word masked by first_mask and last_mask (both applied when they are
+  // the same word)
+  int (*count_box)(const uint64_t *words, int words_per_row, int rows,
+                   int first_word, int last_word, uint64_t first_mask,
+                   uint64_t last_mask);
+  // Appends the runs of row y in raster order
+  void (*row_runs)(const uint64_t *words, int words_per_row, int width, int y,
+                   std::vector<MaskRun> *runs);
+};
+
+// The variant in use. Chosen once, on first use: the best one the CPU
+// supports, unless the VISION_KERNELS environment variable names another.
+const MaskKernels &maskKernels();
+
+const MaskKernels &scalarMaskKernels();
+
+// Every variant this CPU can run, scalar first and best last
+std::vector<const MaskKernels *> supportedMaskKernels();
+
+// Switches to the named variant ("auto" for the best one), for testing and
+// benchmarks. Returns false, leaving the current one, if this CPU can't run
+// it. Not safe while another thread is inside a kernel.
+bool selectMaskKernels(const std::string &name);
+
+// Bit scan shared by the row_runs variants: continues the runs of a row
+// through one word whose first bit is pixel `base`
+static inline void scanRunWord(uint64_t word, int base, int y, bool *in_run,
+                               int *start, std::vector<MaskRun> *runs) {
+  // Alternately look for the next set bit (run start) and the next clear
+  // bit (run end)
+  int pos = 0;
+  while (pos < 64) {
+    uint64_t look = (*in_run ? ~word : word) >> pos;
+    if (look == 0) {
+      break;
+    }
+    int bit = pos + __builtin_ctzll(look);
+    if (*in_run) {
+      MaskRun run;
+      run.y = uint16_t(y);
+      run.x = uint16_t(*start);
+      run.length = uint16_t(base + bit - *start);
+      runs->push_back(run);
+    } else {
+      *start = base + bit;
+    }
+    *in_run = !*in_run;
+    pos = bit;
+  }
+}
+
+// Closes a run still open at the end of a row
+static inline void finishRowRuns(int width, int y, bool in_run, int start,
+                                 std::vector<MaskRun> *runs) {
+  if (in_run) {
+    MaskRun run;
+    run.y = uint16_t(y);
+    run.x = uint16_t(start);
+    run.length = uint16_t(width - start);
+    runs->push_back(run);
+  }
+}
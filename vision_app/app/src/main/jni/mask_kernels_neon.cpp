@@ -0,0 +1,125 @@
+#include "mask_kernels.hpp"
+
+// Built with NEON enabled (arm64, or the .neon suffix in Android.mk on
+// armeabi-v7a); only called when the CPU reports NEON
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <algorithm>
+
+#include <arm_neon.h>
+
+#include "hsv_threshold.hpp"
+
+// NEON has no movemask: weight each 0xff lane by its bit and add the halves
+// up pairwise. Lane i becomes bit i.
+static inline uint32_t laneBits16(uint8x16_t lanes) {
+  static const uint8_t kWeights[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                       1, 2, 4, 8, 16, 32, 64, 128};
+  uint8x16_t bits = vandq_u8(lanes, vld1q_u8(kWeights));
+  uint8x8_t low = vget_low_u8(bits), high = vget_high_u8(bits);
+  low = vpadd_u8(low, low);
+  low = vpadd_u8(low, low);
+  low = vpadd_u8(low, low);
+  high = vpadd_u8(high, high);
+  high = vpadd_u8(high, high);
+  high = vpadd_u8(high, high);
+  return vget_lane_u8(low, 0) | (uint32_t(vget_lane_u8(high, 0)) << 8);
+}
+
+static inline uint8x16_t inRange16(uint8x16_t x, uint8x16_t lo, uint8x16_t hi) {
+  return vandq_u8(vcgeq_u8(x, lo), vcleq_u8(x, hi));
+}
+
+static void thresholdRowNeon(const uint8_t *hsv, int width, const HsvLut &lut,
+                             uint64_t *words) {
+  const uint8x16_t loH = vdupq_n_u8(lut.lo[0]), hiH = vdupq_n_u8(lut.hi[0]);
+  const uint8x16_t loS = vdupq_n_u8(lut.lo[1]), hiS = vdupq_n_u8(lut.hi[1]);
+  const uint8x16_t loV = vdupq_n_u8(lut.lo[2]), hiV = vdupq_n_u8(lut.hi[2]);
+  int words_per_row = (width + 63) / 64;
+  int x = 0;
+  for (int i = 0; i < words_per_row; ++i) {
+    int end = std::min(width, i * 64 + 64);
+    uint64_t word = 0;
+    // vld3 splits the channels as it loads; 16 pixels never straddle a word
+    for (; x + 16 <= end; x += 16) {
+      uint8x16x3_t p = vld3q_u8(hsv + 3 * x);
+      uint8x16_t pass = vandq_u8(inRange16(p.val[0], loH, hiH),
+                                 vandq_u8(inRange16(p.val[1], loS, hiS),
+                                          inRange16(p.val[2], loV, hiV)));
+      word |= uint64_t(laneBits16(pass)) << (x & 63);
+    }
+    for (; x < end; ++x) {
+      const uint8_t *p = hsv + 3 * x;
+      word |= uint64_t(lut.h[p[0]] & lut.s[p[1]] & lut.v[p[2]]) << (x & 63);
+    }
+    words[i] = word;
+  }
+}
+
+static void packRowNeon(const uint8_t *mask, int width, uint64_t *words) {
+  int words_per_row = (width + 63) / 64;
+  int x = 0;
+  for (int i = 0; i < words_per_row; ++i) {
+    int end = std::min(width, i * 64 + 64);
+    uint64_t word = 0;
+    for (; x + 16 <= end; x += 16) {
+      uint8x16_t bytes = vld1q_u8(mask + x);
+      word |= uint64_t(laneBits16(vtstq_u8(bytes, bytes))) << (x & 63);
+    }
+    for (; x < end; ++x) {
+      word |= uint64_t(mask[x] != 0) << (x & 63);
+    }
+    words[i] = word;
+  }
+}
+
+// vcnt counts bits per byte; widening pairwise adds sum the bytes. On
+// armeabi-v7a __builtin_popcountll is a library call, so this is the win
+// there; arm64 compilers already use cnt.
+static inline uint64_t popcount64(uint64_t word) {
+  uint8x8_t counts = vcnt_u8(vcreate_u8(word));
+  return vget_lane_u64(vpaddl_u32(vpaddl_u16(vpaddl_u8(counts))), 0);
+}
+
+static int countBoxNeon(const uint64_t *words, int words_per_row, int rows,
+                        int first_word, int last_word, uint64_t first_mask,
+                        uint64_t last_mask) {
+  if (first_word == last_word) {
+    first_mask &= last_mask;
+  }
+  int count = 0;
+  for (int y = 0; y < rows; ++y, words += words_per_row) {
+    count += popcount64(words[first_word] & first_mask);
+    if (first_word == last_word) {
+      continue;
+    }
+    for (int i = first_word + 1; i < last_word; ++i) {
+      count += popcount64(words[i]);
+    }
+    count += popcount64(words[last_word] & last_mask);
+  }
+  return count;
+}
+
+static MaskKernels neonKernels() {
+  // Run extraction is bit scanning, which NEON does not speed up
+  MaskKernels kernels = scalarMaskKernels();
+  kernels.name = "neon";
+  kernels.required = KERNEL_CPU_NEON;
+  kernels.threshold_row = thresholdRowNeon;
+  kernels.pack_row = packRowNeon;
+  kernels.count_box = countBoxNeon;
+  return kernels;
+}
+
+void addNeonMaskKernels(std::vector<const MaskKernels *> *variants) {
+  static const MaskKernels kNeon = neonKernels();
+  variants->push_back(&kNeon);
+}
+
+#else
+
+void addNeonMaskKernels(std::vector<const MaskKernels *> *) {
+}
+
+#endif
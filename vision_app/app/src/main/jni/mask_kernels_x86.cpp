@@ -0,0 +1,237 @@
+#include "mask_kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+#include "hsv_threshold.hpp"
+
+// Each function is compiled for its instruction set on its own, so the rest
+// of the library still runs on any x86 CPU
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+
+// Splits 16 packed HSV pixels into one vector per channel
+TARGET_SSSE3 static inline void deinterleave16(const uint8_t *p, __m128i *h,
+                                               __m128i *s, __m128i *v) {
+  __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+  __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32));
+  // -1 zeroes the lane; channel k of pixel i is byte 3 * i + k
+  *h = _mm_or_si128(
+      _mm_or_si128(
+          _mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+          _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+      _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+  *s = _mm_or_si128(
+      _mm_or_si128(
+          _mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+          _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+      _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+  *v = _mm_or_si128(
+      _mm_or_si128(
+          _mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+          _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+      _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+// 0xff where lo <= x <= hi (unsigned)
+TARGET_SSSE3 static inline __m128i inRange16(__m128i x, __m128i lo, __m128i hi) {
+  return _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, lo), x),
+                       _mm_cmpeq_epi8(_mm_min_epu8(x, hi), x));
+}
+
+TARGET_AVX2 static inline __m256i inRange32(__m256i x, __m256i lo, __m256i hi) {
+  return _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, lo), x),
+                          _mm256_cmpeq_epi8(_mm256_min_epu8(x, hi), x));
+}
+
+TARGET_AVX2 static inline __m256i combine(__m128i low, __m128i high) {
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+}
+
+// Pixels [x, end) one at a time through the LUT, for the end of a row
+static inline uint64_t thresholdTail(const uint8_t *hsv, int x, int end,
+                                     const HsvLut &lut) {
+  uint64_t word = 0;
+  for (; x < end; ++x) {
+    const uint8_t *p = hsv + 3 * x;
+    word |= uint64_t(lut.h[p[0]] & lut.s[p[1]] & lut.v[p[2]]) << (x & 63);
+  }
+  return word;
+}
+
+TARGET_SSSE3 static void thresholdRowSsse3(const uint8_t *hsv, int width,
+                                           const HsvLut &lut, uint64_t *words) {
+  const __m128i loH = _mm_set1_epi8(char(lut.lo[0])), hiH = _mm_set1_epi8(char(lut.hi[0]));
+  const __m128i loS = _mm_set1_epi8(char(lut.lo[1])), hiS = _mm_set1_epi8(char(lut.hi[1]));
+  const __m128i loV = _mm_set1_epi8(char(lut.lo[2])), hiV = _mm_set1_epi8(char(lut.hi[2]));
+  int words_per_row = (width + 63) / 64;
+  int x = 0;
+  for (int i = 0; i < words_per_row; ++i) {
+    int end = std::min(width, i * 64 + 64);
+    uint64_t word = 0;
+    // 16 pixels never straddle a word
+    for (; x + 16 <= end; x += 16) {
+      __m128i h, s, v;
+      deinterleave16(hsv + 3 * x, &h, &s, &v);
+      __m128i pass = _mm_and_si128(inRange16(h, loH, hiH),
+                                   _mm_and_si128(inRange16(s, loS, hiS),
+                                                 inRange16(v, loV, hiV)));
+      word |= uint64_t(uint16_t(_mm_movemask_epi8(pass))) << (x & 63);
+    }
+    words[i] = word | thresholdTail(hsv, x, end, lut);
+    x = end;
+  }
+}
+
+TARGET_AVX2 static void thresholdRowAvx2(const uint8_t *hsv, int width,
+                                         const HsvLut &lut, uint64_t *words) {
+  const __m256i loH = _mm256_set1_epi8(char(lut.lo[0])), hiH = _mm256_set1_epi8(char(lut.hi[0]));
+  const __m256i loS = _mm256_set1_epi8(char(lut.lo[1])), hiS = _mm256_set1_epi8(char(lut.hi[1]));
+  const __m256i loV = _mm256_set1_epi8(char(lut.lo[2])), hiV = _mm256_set1_epi8(char(lut.hi[2]));
+  int words_per_row = (width + 63) / 64;
+  int x = 0;
+  for (int i = 0; i < words_per_row; ++i) {
+    int end = std::min(width, i * 64 + 64);
+    uint64_t word = 0;
+    for (; x + 32 <= end; x += 32) {
+      // The shuffles only work within 128 bits, so split 16 pixels at a time
+      // and compare all 32 at once
+      __m128i h0, s0, v0, h1, s1, v1;
+      deinterleave16(hsv + 3 * x, &h0, &s0, &v0);
+      deinterleave16(hsv + 3 * x + 48, &h1, &s1, &v1);
+      __m256i pass = _mm256_and_si256(
+          inRange32(combine(h0, h1), loH, hiH),
+          _mm256_and_si256(inRange32(combine(s0, s1), loS, hiS),
+                           inRange32(combine(v0, v1), loV, hiV)));
+      word |= uint64_t(uint32_t(_mm256_movemask_epi8(pass))) << (x & 63);
+    }
+    words[i] = word | thresholdTail(hsv, x, end, lut);
+    x = end;
+  }
+}
+
+static inline uint64_t packTail(const uint8_t *mask, int x, int end) {
+  uint64_t word = 0;
+  for (; x < end; ++x) {
+    word |= uint64_t(mask[x] != 0) << (x & 63);
+  }
+  return word;
+}
+
+TARGET_SSSE3 static void packRowSse(const uint8_t *mask, int width, uint64_t *words) {
+  const __m128i zero = _mm_setzero_si128();
+  int words_per_row = (width + 63) / 64;
+  int x = 0;
+  for (int i = 0; i < words_per_row; ++i) {
+    int end = std::min(width, i * 64 + 64);
+    uint64_t word = 0;
+    for (; x + 16 <= end; x += 16) {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(mask + x));
+      uint16_t clear = uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)));
+      word |= uint64_t(uint16_t(~clear)) << (x & 63);
+    }
+    words[i] = word | packTail(mask, x, end);
+    x = end;
+  }
+}
+
+TARGET_AVX2 static void packRowAvx2(const uint8_t *mask, int width, uint64_t *words) {
+  const __m256i zero = _mm256_setzero_si256();
+  int words_per_row = (width + 63) / 64;
+  int x = 0;
+  for (int i = 0; i < words_per_row; ++i) {
+    int end = std::min(width, i * 64 + 64);
+    uint64_t word = 0;
+    for (; x + 32 <= end; x += 32) {
+      __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(mask + x));
+      uint32_t clear = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero)));
+      word |= uint64_t(~clear) << (x & 63);
+    }
+    words[i] = word | packTail(mask, x, end);
+    x = end;
+  }
+}
+
+// The scalar loop, built so __builtin_popcountll becomes the popcnt
+// instruction instead of generic bit twiddling
+TARGET_AVX2 static int countBoxPopcnt(const uint64_t *words, int words_per_row, int rows,
+                                      int first_word, int last_word, uint64_t first_mask,
+                                      uint64_t last_mask) {
+  if (first_word == last_word) {
+    first_mask &= last_mask;
+  }
+  int count = 0;
+  for (int y = 0; y < rows; ++y, words += words_per_row) {
+    count += __builtin_popcountll(words[first_word] & first_mask);
+    if (first_word == last_word) {
+      continue;
+    }
+    for (int i = first_word + 1; i < last_word; ++i) {
+      count += __builtin_popcountll(words[i]);
+    }
+    count += __builtin_popcountll(words[last_word] & last_mask);
+  }
+  return count;
+}
+
+// Skips four words at a time while they are all inside or all outside a run
+TARGET_AVX2 static void rowRunsAvx2(const uint64_t *words, int words_per_row, int width,
+                                    int y, std::vector<MaskRun> *runs) {
+  bool inRun = false;
+  int start = 0;
+  int i = 0;
+  while (i < words_per_row) {
+    uint64_t fill = inRun ? ~0ULL : 0;
+    if (i + 4 <= words_per_row) {
+      __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + i));
+      __m256i same = _mm256_cmpeq_epi64(block, _mm256_set1_epi64x(int64_t(fill)));
+      if (_mm256_movemask_epi8(same) == -1) {
+        i += 4;
+        continue;
+      }
+    }
+    if (words[i] != fill) {
+      scanRunWord(words[i], i * 64, y, &inRun, &start, runs);
+    }
+    ++i;
+  }
+  finishRowRuns(width, y, inRun, start, runs);
+}
+
+static MaskKernels ssse3Kernels() {
+  MaskKernels kernels = scalarMaskKernels();
+  kernels.name = "ssse3";
+  kernels.required = KERNEL_CPU_SSSE3;
+  kernels.threshold_row = thresholdRowSsse3;
+  kernels.pack_row = packRowSse;
+  return kernels;
+}
+
+static MaskKernels avx2Kernels() {
+  MaskKernels kernels = scalarMaskKernels();
+  kernels.name = "avx2";
+  kernels.required = KERNEL_CPU_SSSE3 | KERNEL_CPU_AVX2 | KERNEL_CPU_POPCNT;
+  kernels.threshold_row = thresholdRowAvx2;
+  kernels.pack_row = packRowAvx2;
+  kernels.count_box = countBoxPopcnt;
+  kernels.row_runs = rowRunsAvx2;
+  return kernels;
+}
+
+void addX86MaskKernels(std::vector<const MaskKernels *> *variants) {
+  static const MaskKernels kSsse3 = ssse3Kernels();
+  static const MaskKernels kAvx2 = avx2Kernels();
+  variants->push_back(&kSsse3);
+  variants->push_back(&kAvx2);
+}
+
+#else
+
+void addX86MaskKernels(std::vector<const MaskKernels *> *) {
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "mask_morphology.hpp"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "frame_shape.hpp"
+
+static int clampSize(int size) {
+  return std::max(1, std::min(size, kMaxMorphSize));
+}
+
+void PackedMorphology::apply(const MorphConfig &config, PackedMask *mask) {
+  apply(config, RuntimeShape(mask->width, mask->height), mask);
+}
+
+template <class Shape>
+void PackedMorphology::apply(const MorphConfig &config, const Shape &shape,
+                             PackedMask *mask) {
+  int width = clampSize(config.width);
+  int height = clampSize(config.height);
+  switch (config.op) {
+    case MORPH_OP_ERODE:
+      erode(width, height, shape, mask);
+      break;
+    case MORPH_OP_DILATE:
+      dilate(width, height, shape, mask);
+      break;
+    case MORPH_OP_OPEN:
+      erode(width, height, shape, mask);
+      dilate(width, height, shape, mask);
+      break;
+    case MORPH_OP_CLOSE:
+      dilate(width, height, shape, mask);
+      erode(width, height, shape, mask);
+      break;
+    default:
+      break;
+  }
+}
+
+// A rectangle is separable: a row pass then a column pass gives the same
+// result as the full element, at width + height operations per word instead
+// of width * height.
+template <class Shape>
+void PackedMorphology::erode(int width, int height, const Shape &shape,
+                             PackedMask *mask) {
+  horizontal(true, width, shape, mask);
+  vertical(true, height, shape, mask);
+}
+
+template <class Shape>
+void PackedMorphology::dilate(int width, int height, const Shape &shape,
+                              PackedMask *mask) {
+  horizontal(false, width, shape, mask);
+  vertical(false, height, shape, mask);
+}
+
+template <class Shape>
+void PackedMorphology::horizontal(bool erode, int size, const Shape &shape,
+                                  PackedMask *mask) {
+  if (size == 1 || shape.width() == 0) {
+    return;
+  }
+  const int words = shape.words();
+  // Outside the image counts as set for erode and clear for dilate, so the
+  // border never changes the result
+  const uint64_t fill = erode ? ~0ULL : 0;
+  const int tailBits = shape.width() & 63;
+  const uint64_t tailMask = tailBits ? (1ULL << tailBits) - 1 : ~0ULL;
+  const int before = size / 2;
+  const int after = size - 1 - before;
+
+  // One sentinel word on each side so shifts never index out of the row
+  row_.resize(words + 2);
+  row_[0] = fill;
+  row_[words + 1] = fill;
+  for (int y = 0; y < shape.height(); ++y) {
+    uint64_t *bits = &mask->words[y * words];
+    std::copy(bits, bits + words, row_.begin() + 1);
+    row_[words] = (row_[words] & tailMask) | (fill & ~tailMask);
+
+    for (int i = 0; i < words; ++i) {
+      const uint64_t *w = &row_[i + 1];
+      uint64_t out = w[0];
+      // Bit b of the shifted word is pixel b + d of this word
+      for (int d = 1; d <= after; ++d) {
+        uint64_t shifted = (w[0] >> d) | (w[1] << (64 - d));
+        out = erode ? (out & shifted) : (out | shifted);
+      }
+      for (int d = 1; d <= before; ++d) {
+        uint64_t shifted = (w[0] << d) | (w[-1] >> (64 - d));
+        out = erode ? (out & shifted) : (out | shifted);
+      }
+      bits[i] = out;
+    }
+    bits[words - 1] &= tailMask;
+  }
+}
+
+template <class Shape>
+void PackedMorphology::vertical(bool erode, int size, const Shape &shape,
+                                PackedMask *mask) {
+  if (size == 1 || shape.height() == 0) {
+    return;
+  }
+  const int words = shape.words();
+  const int before = size / 2;
+  const int after = size - 1 - before;
+  if (tmp_.width != shape.width() || tmp_.height != shape.height()) {
+    // Every word is overwritten below, so reuse doesn't need clearing
+    tmp_.create(shape.width(), shape.height());
+  }
+  for (int y = 0; y < shape.height(); ++y) {
+    uint64_t *out = &tmp_.words[y * words];
+    const uint64_t *in = &mask->words[y * words];
+    std::copy(in, in + words, out);
+    // Rows outside the image are skipped, the same as filling them
+    int first = std::max(0, y - before);
+    int last = std::min(shape.height() - 1, y + after);
+    for (int r = first; r <= last; ++r) {
+      if (r == y) {
+        continue;
+      }
+      in = &mask->words[r * words];
+      if (erode) {
+        for (int i = 0; i < words; ++i) {
+          out[i] &= in[i];
+        }
+      } else {
+        for (int i = 0; i < words; ++i) {
+          out[i] |= in[i];
+        }
+      }
+    }
+  }
+  mask->words.swap(tmp_.words);
+}
+
+#define INSTANTIATE_APPLY(W, H)                                       \
+  template void PackedMorphology::apply(const MorphConfig &,            \
+                                        const FixedShape<W, H> &, PackedMask *);
+VISION_FIXED_FRAME_SHAPES(INSTANTIATE_APPLY)
+template void PackedMorphology::apply(const MorphConfig &, const RuntimeShape &,
+                                      PackedMask *);
+
+void applyMorphology(const MorphConfig &config, cv::Mat &mask) {
+  static const int kCvOps[] = {-1, cv::MORPH_ERODE, cv::MORPH_DILATE,
+                               cv::MORPH_OPEN, cv::MORPH_CLOSE};
+  if (config.op <= MORPH_OP_NONE || config.op > MORPH_OP_CLOSE) {
+    return;
+  }
+  cv::Mat element = cv::getStructuringElement(
+      cv::MORPH_RECT, cv::Size(clampSize(config.width), clampSize(config.height)));
+  cv::morphologyEx(mask, mask, kCvOps[config.op], element);
+}
+
+bool parseMorphology(const std::string &text, MorphConfig *config) {
+  static const char *kNames[] = {"none", "erode", "dilate", "open", "close"};
+  std::string name = text.substr(0, text.find(':'));
+  int op = -1;
+  for (int i = 0; i <= MORPH_OP_CLOSE; ++i) {
+    if (name == kNames[i]) {
+      op = i;
+    }
+  }
+  if (op < 0) {
+    return false;
+  }
+  int width = 3, height = 3;
+  if (name.size() < text.size()) {
+    const char *size = text.c_str() + name.size() + 1;
+    if (sscanf(size, "%dx%d", &width, &height) != 2 || width < 1 ||
+        height < 1 || width > kMaxMorphSize || height > kMaxMorphSize) {
+      return false;
+    }
+  }
+  config->op = static_cast<MorphOp>(op);
+  config->width = width;
+  config->height = height;
+  return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "packed_mask.hpp"
+
+// Cleanup applied to the threshold mask before blob extraction
+enum MorphOp {
+  MORPH_OP_NONE = 0,
+  MORPH_OP_ERODE = 1,
+  MORPH_OP_DILATE = 2,
+  MORPH_OP_OPEN = 3,   // erode then dilate: removes speckle
+  MORPH_OP_CLOSE = 4   // dilate then erode: fills pinholes
+};
+
+// Rectangular structuring element, anchored at its center like OpenCV's
+// default. Sizes are clamped to [1, kMaxMorphSize].
+struct MorphConfig {
+  MorphOp op;
+  int width;
+  int height;
+};
+
+static const int kMaxMorphSize = 31;
+
+// Runs the operation on a packed mask in place, a word (64 pixels) at a
+// time. Matches cv::morphologyEx with the default border handling: pixels
+// outside the image never erode anything or get dilated into.
+class PackedMorphology {
+ public:
+  void apply(const MorphConfig &config, PackedMask *mask);
+  // apply() compiled for a frame shape (frame_shape.hpp) matching the mask
+  template <class Shape>
+  void apply(const MorphConfig &config, const Shape &shape, PackedMask *mask);
+
+ private:
+  template <class Shape>
+  void erode(int width, int height, const Shape &shape, PackedMask *mask);
+  template <class Shape>
+  void dilate(int width, int height, const Shape &shape, PackedMask *mask);
+  template <class Shape>
+  void horizontal(bool erode, int size, const Shape &shape, PackedMask *mask);
+  template <class Shape>
+  void vertical(bool erode, int size, const Shape &shape, PackedMask *mask);
+
+  PackedMask tmp_;
+  std::vector<uint64_t> row_;
+};
+
+// The same operation on an 8-bit mask with OpenCV, for the findContours path
+void applyMorphology(const MorphConfig &config, cv::Mat &mask);
+
+// Parses "none", "<op>" or "<op>:<w>x<h>" where op is erode, dilate, open or
+// close (3x3 if no size is given)
+bool parseMorphology(const std::string &text, MorphConfig *config);
@@ -0,0 +1,93 @@
+#include "packed_mask.hpp"
+
+#include <algorithm>
+
+#include "frame_shape.hpp"
+#include "mask_kernels.hpp"
+
+static inline uint64_t lowBits(int count) {
+  return count >= 64 ? ~0ULL : (1ULL << count) - 1;
+}
+
+void PackedMask::create(int width, int height) {
+  this->width = width;
+  this->height = height;
+  words_per_row = (width + 63) / 64;
+  words.assign(size_t(words_per_row) * height, 0);
+}
+
+int PackedMask::countBox(const cv::Rect &box) const {
+  if (box.width <= 0 || box.height <= 0) {
+    return 0;
+  }
+  int firstWord = box.x >> 6;
+  int lastWord = (box.x + box.width - 1) >> 6;
+  uint64_t firstMask = ~0ULL << (box.x & 63);
+  uint64_t lastMask = lowBits(((box.x + box.width - 1) & 63) + 1);
+  return maskKernels().count_box(row(box.y), words_per_row, box.height, firstWord,
+                                 lastWord, firstMask, lastMask);
+}
+
+void PackedMask::extractRuns(std::vector<MaskRun> *runs, int first_row,
+                             int end_row) const {
+  if (end_row < 0) {
+    end_row = height;
+  }
+  const auto rowRuns = maskKernels().row_runs;
+  for (int y = first_row; y < end_row; ++y) {
+    rowRuns(row(y), words_per_row, width, y, runs);
+  }
+}
+
+void PackedMask::setRuns(const std::vector<MaskRun> &runs, int width,
+                         int height) {
+  create(width, height);
+  for (auto &run : runs) {
+    uint64_t *words = row(run.y);
+    int x = run.x;
+    int end = run.x + run.length;
+    while (x < end) {
+      int bit = x & 63;
+      int count = std::min(64 - bit, end - x);
+      words[x >> 6] |= lowBits(count) << bit;
+      x += count;
+    }
+  }
+}
+
+void PackedMask::pack(const cv::Mat &mask) {
+  CV_Assert(mask.type() == CV_8UC1);
+  create(mask.cols, mask.rows);
+  const auto packRow = maskKernels().pack_row;
+  for (int y = 0; y < height; ++y) {
+    packRow(mask.ptr<uint8_t>(y), width, row(y));
+  }
+}
+
+void PackedMask::unpack(cv::Mat &mask) const {
+  unpack(RuntimeShape(width, height), mask);
+}
+
+template <class Shape>
+void PackedMask::unpack(const Shape &shape, cv::Mat &mask) const {
+  mask.create(shape.height(), shape.width(), CV_8UC1);
+  const int fullWords = shape.width() / 64;
+  const int tailBits = shape.width() % 64;
+  for (int y = 0; y < shape.height(); ++y) {
+    const uint64_t *bits = &words[y * shape.words()];
+    uint8_t *dst = mask.ptr<uint8_t>(y);
+    for (int i = 0; i < fullWords; ++i, dst += 64) {
+      for (int bit = 0; bit < 64; ++bit) {
+        dst[bit] = uint8_t(0 - ((bits[i] >> bit) & 1));
+      }
+    }
+    for (int bit = 0; bit < tailBits; ++bit) {
+      dst[bit] = uint8_t(0 - ((bits[fullWords] >> bit) & 1));
+    }
+  }
+}
+
+#define INSTANTIATE_UNPACK(W, H) \
+  template void PackedMask::unpack(const FixedShape<W, H> &, cv::Mat &) const;
+VISION_FIXED_FRAME_SHAPES(INSTANTIATE_UNPACK)
+template void PackedMask::unpack(const RuntimeShape &, cv::Mat &) const;
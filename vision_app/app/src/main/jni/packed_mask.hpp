@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "rle_mask.hpp"
+
+// Binary mask stored one bit per pixel, least significant bit first, in
+// 64-bit words. Each row starts on a new word and the padding bits past
+// width are always zero. 640x480 is 38 KB, small enough to stay in L2.
+struct PackedMask {
+  int width = 0;
+  int height = 0;
+  int words_per_row = 0;
+  std::vector<uint64_t> words;
+
+  // Sets the size and clears every bit
+  void create(int width, int height);
+
+  uint64_t *row(int y) { return &words[y * words_per_row]; }
+  const uint64_t *row(int y) const { return &words[y * words_per_row]; }
+
+  // Number of set pixels inside box
+  int countBox(const cv::Rect &box) const;
+
+  // Appends the runs of set pixels in rows [first_row, end_row), in raster
+  // order. end_row < 0 means the last row.
+  void extractRuns(std::vector<MaskRun> *runs, int first_row = 0,
+                   int end_row = -1) const;
+  void setRuns(const std::vector<MaskRun> &runs, int width, int height);
+
+  // Conversions to and from 8-bit masks (0/255; any nonzero byte is set)
+  void pack(const cv::Mat &mask);
+  void unpack(cv::Mat &mask) const;
+  // unpack() compiled for a frame shape (frame_shape.hpp) matching the mask
+  template <class Shape>
+  void unpack(const Shape &shape, cv::Mat &mask) const;
+};
@@ -0,0 +1,88 @@
+#include "perf_counters.hpp"
+
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+
+#include "common.hpp"
+
+static int openCounter(uint64_t config, int group_fd) {
+#ifdef __NR_perf_event_open
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = group_fd < 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+#else
+  return -1;
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  if (leader_fd_ >= 0) {
+    close(leader_fd_);
+  }
+}
+
+bool PerfCounters::open() {
+  if (available()) {
+    return true;
+  }
+  int leader = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (leader < 0) {
+    LOGD("Hardware counters unavailable, timing only");
+    return false;
+  }
+  static const uint64_t kMembers[3] = {PERF_COUNT_HW_INSTRUCTIONS,
+                                       PERF_COUNT_HW_CACHE_MISSES,
+                                       PERF_COUNT_HW_BRANCH_MISSES};
+  for (int i = 0; i < 3; ++i) {
+    fds_[i] = openCounter(kMembers[i], leader);
+    if (fds_[i] < 0) {
+      // All or nothing, so IPC and misses always come from the same run
+      LOGD("Hardware counter %d unavailable, timing only", i);
+      for (int j = 0; j < i; ++j) {
+        close(fds_[j]);
+        fds_[j] = -1;
+      }
+      close(leader);
+      return false;
+    }
+  }
+  ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  leader_fd_ = leader;
+  return true;
+}
+
+void PerfCounters::read(PerfCounts *counts) const {
+  if (!available()) {
+    *counts = PerfCounts();
+    return;
+  }
+  // PERF_FORMAT_GROUP: the number of counters, then each value in the order
+  // they were added to the group
+  uint64_t values[5];
+  if (::read(leader_fd_, values, sizeof(values)) != ssize_t(sizeof(values)) ||
+      values[0] != 4) {
+    *counts = PerfCounts();
+    return;
+  }
+  counts->cycles = values[1];
+  counts->instructions = values[2];
+  counts->cache_misses = values[3];
+  counts->branch_misses = values[4];
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+// Hardware event counts over some stretch of code
+struct PerfCounts {
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t cache_misses = 0;
+  uint64_t branch_misses = 0;
+
+  double ipc() const { return cycles > 0 ? double(instructions) / cycles : 0; }
+
+  PerfCounts &operator+=(const PerfCounts &other) {
+    cycles += other.cycles;
+    instructions += other.instructions;
+    cache_misses += other.cache_misses;
+    branch_misses += other.branch_misses;
+    return *this;
+  }
+};
+
+static inline PerfCounts operator-(const PerfCounts &a, const PerfCounts &b) {
+  PerfCounts d;
+  d.cycles = a.cycles - b.cycles;
+  d.instructions = a.instructions - b.instructions;
+  d.cache_misses = a.cache_misses - b.cache_misses;
+  d.branch_misses = a.branch_misses - b.branch_misses;
+  return d;
+}
+
+// Cycles, instructions, cache misses and branch misses of the calling thread
+// (user space only), read through perf_event_open as one group so the
+// counts line up. Many VMs and some Android kernels don't allow this
+// (perf_event_paranoid, no PMU); open() then returns false and read() leaves
+// everything at 0, so callers can just fall back to wall-clock time.
+//
+// Counting is per thread: create, open and read on the thread that does the
+// work.
+class PerfCounters {
+ public:
+  PerfCounters() {}
+  ~PerfCounters();
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  bool open();
+  bool available() const { return leader_fd_ >= 0; }
+
+  // Running totals since open()
+  void read(PerfCounts *counts) const;
+
+ private:
+  int leader_fd_ = -1;
+  int fds_[3] = {-1, -1, -1};
+};
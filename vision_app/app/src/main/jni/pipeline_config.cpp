@@ -0,0 +1,215 @@
+#include "pipeline_config.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sstream>
+
+PipelineConfig defaultPipelineConfig() {
+  PipelineConfig config;
+  config.thresholds = {0, 255, 0, 255, 0, 255};
+  config.candidates = kDefaultCandidateFilter;
+  config.peg = kDefaultPegParams;
+  config.boiler = kDefaultBoilerParams;
+  config.lut.build(config.thresholds);
+  config.version = 0;
+  return config;
+}
+
+std::vector<PipelineConfigField> pipelineConfigFields(PipelineConfig *c) {
+  return {
+    {"h_min", &c->thresholds.h_min, nullptr},
+    {"h_max", &c->thresholds.h_max, nullptr},
+    {"s_min", &c->thresholds.s_min, nullptr},
+    {"s_max", &c->thresholds.s_max, nullptr},
+    {"v_min", &c->thresholds.v_min, nullptr},
+    {"v_max", &c->thresholds.v_max, nullptr},
+    {"candidate.min_width", nullptr, &c->candidates.min_width},
+    {"candidate.max_width", nullptr, &c->candidates.max_width},
+    {"candidate.min_height", nullptr, &c->candidates.min_height},
+    {"candidate.max_height", nullptr, &c->candidates.max_height},
+    {"candidate.min_fullness", nullptr, &c->candidates.min_fullness},
+    {"candidate.max_fullness", nullptr, &c->candidates.max_fullness},
+    {"peg.min_aspect", nullptr, &c->peg.min_aspect},
+    {"peg.max_aspect", nullptr, &c->peg.max_aspect},
+    {"peg.split_width_error", nullptr, &c->peg.split_width_error},
+    {"peg.split_x_error", nullptr, &c->peg.split_x_error},
+    {"peg.min_split_aspect", nullptr, &c->peg.min_split_aspect},
+    {"peg.max_split_aspect", nullptr, &c->peg.max_split_aspect},
+    {"peg.altitude_error", nullptr, &c->peg.altitude_error},
+    {"peg.min_spacing", nullptr, &c->peg.min_spacing},
+    {"peg.max_spacing", nullptr, &c->peg.max_spacing},
+    {"boiler.min_aspect", nullptr, &c->boiler.min_aspect},
+    {"boiler.max_aspect", nullptr, &c->boiler.max_aspect},
+    {"boiler.width_error", nullptr, &c->boiler.width_error},
+    {"boiler.x_error", nullptr, &c->boiler.x_error},
+    {"boiler.min_spacing", nullptr, &c->boiler.min_spacing},
+    {"boiler.max_spacing", nullptr, &c->boiler.max_spacing},
+    {"boiler.min_height_ratio", nullptr, &c->boiler.min_height_ratio},
+    {"boiler.max_height_ratio", nullptr, &c->boiler.max_height_ratio},
+  };
+}
+
+static bool parseValue(const std::string &text, const PipelineConfigField &field) {
+  const char *begin = text.c_str();
+  char *end;
+  if (field.int_value != nullptr) {
+    long value = strtol(begin, &end, 10);
+    if (end == begin || *end != '\0') {
+      return false;
+    }
+    *field.int_value = int(value);
+  } else {
+    double value = strtod(begin, &end);
+    if (end == begin || *end != '\0' || !isfinite(value)) {
+      return false;
+    }
+    *field.double_value = value;
+  }
+  return true;
+}
+
+static std::string lineError(int number, const char *what, const std::string &name) {
+  char prefix[32];
+  snprintf(prefix, sizeof(prefix), "line %d: ", number);
+  return prefix + std::string(what) + name;
+}
+
+bool parsePipelineConfig(const std::string &text, PipelineConfig *config,
+                         std::string *error) {
+  PipelineConfig parsed = *config;
+  std::vector<PipelineConfigField> fields = pipelineConfigFields(&parsed);
+  std::istringstream lines(text);
+  std::string line;
+  for (int number = 1; std::getline(lines, line); ++number) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    std::string name, value, extra;
+    if (!(words >> name)) {
+      continue;
+    }
+    const PipelineConfigField *field = nullptr;
+    for (const auto &f : fields) {
+      if (name == f.name) {
+        field = &f;
+      }
+    }
+    if (field == nullptr) {
+      *error = lineError(number, "unknown parameter ", name);
+      return false;
+    }
+    if (!(words >> value) || (words >> extra) || !parseValue(value, *field)) {
+      *error = lineError(number, "bad value for ", name);
+      return false;
+    }
+  }
+  *config = parsed;
+  return true;
+}
+
+bool loadPipelineConfig(const std::string &path, PipelineConfig *config,
+                        std::string *error) {
+  FILE *file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    *error = "could not open " + path;
+    return false;
+  }
+  std::string text;
+  char buffer[1024];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    text.append(buffer, n);
+  }
+  fclose(file);
+  if (!parsePipelineConfig(text, config, error)) {
+    *error = path + ": " + *error;
+    return false;
+  }
+  return true;
+}
+
+std::string formatPipelineConfig(const PipelineConfig &config) {
+  PipelineConfig copy = config;
+  std::string text;
+  char line[96];
+  for (const auto &field : pipelineConfigFields(&copy)) {
+    if (field.int_value != nullptr) {
+      snprintf(line, sizeof(line), "%s %d\n", field.name, *field.int_value);
+    } else {
+      // The shortest form that reads back as the same double, so hand-edited
+      // and tuned values stay readable
+      double value = *field.double_value;
+      for (int digits = 6; digits <= 17; ++digits) {
+        snprintf(line, sizeof(line), "%s %.*g\n", field.name, digits, value);
+        if (strtod(line + strlen(field.name) + 1, nullptr) == value) {
+          break;
+        }
+      }
+    }
+    text += line;
+  }
+  return text;
+}
+
+ConfigChannel::ConfigChannel()
+    : current_(new PipelineConfig(defaultPipelineConfig())),
+      hazard_(nullptr),
+      next_version_(1) {
+}
+
+ConfigChannel::~ConfigChannel() {
+  delete current_.load();
+  for (PipelineConfig *config : retired_) {
+    delete config;
+  }
+}
+
+uint64_t ConfigChannel::publish(const PipelineConfig &config) {
+  // Built before it is visible, so the reader never sees a partial table
+  PipelineConfig *snapshot = new PipelineConfig(config);
+  snapshot->lut.build(snapshot->thresholds);
+  std::lock_guard<std::mutex> lock(mutex_);
+  snapshot->version = next_version_++;
+  retired_.push_back(current_.exchange(snapshot));
+  freeRetired();
+  return snapshot->version;
+}
+
+PipelineConfig ConfigChannel::latest() const {
+  // Only publishers free snapshots, so holding their lock keeps this one
+  std::lock_guard<std::mutex> lock(mutex_);
+  return *current_.load();
+}
+
+const PipelineConfig *ConfigChannel::acquire() {
+  // Announce, then check the snapshot is still current. If a publisher
+  // swapped it out in between, it may already have looked at the hazard and
+  // freed it, so try again with the new one.
+  PipelineConfig *config = current_.load();
+  for (;;) {
+    hazard_.store(config);
+    PipelineConfig *check = current_.load();
+    if (check == config) {
+      return config;
+    }
+    config = check;
+  }
+}
+
+void ConfigChannel::freeRetired() {
+  // All seq_cst: the reader's announcement either happened before the
+  // exchange in publish(), and is seen here, or the reader's check sees the
+  // new snapshot and it moves on
+  PipelineConfig *inUse = hazard_.load();
+  size_t kept = 0;
+  for (PipelineConfig *config : retired_) {
+    if (config == inUse) {
+      retired_[kept++] = config;
+    } else {
+      delete config;
+    }
+  }
+  retired_.resize(kept);
+}
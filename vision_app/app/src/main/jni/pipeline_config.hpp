@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "blob_extractor.hpp"
+#include "hsv_threshold.hpp"
+#include "target_matcher.hpp"
+
+// Every tunable detection parameter, as one snapshot. Snapshots are never
+// changed once published; a change is a new snapshot.
+struct PipelineConfig {
+  HsvThresholds thresholds;
+  CandidateFilter candidates;
+  PegParams peg;
+  BoilerParams boiler;
+
+  // Derived from the parameters when the snapshot is published
+  HsvLut lut;
+  uint64_t version;  // grows with every publish on a channel
+};
+
+// Thresholds 0-255 and the kDefault* filter parameters
+PipelineConfig defaultPipelineConfig();
+
+// The text form is one "name value" pair per line, with # comments, using the
+// names formatPipelineConfig() writes (h_min, candidate.min_width,
+// peg.altitude_error, ...). Names not in the text keep their value in
+// *config. Returns false and describes the first bad line in *error on an
+// unknown name or a value that doesn't parse, leaving *config unchanged.
+bool parsePipelineConfig(const std::string &text, PipelineConfig *config,
+                         std::string *error);
+bool loadPipelineConfig(const std::string &path, PipelineConfig *config,
+                        std::string *error);
+std::string formatPipelineConfig(const PipelineConfig &config);
+
+// One named parameter of a config, as used in the text form; exactly one of
+// the pointers is set
+struct PipelineConfigField {
+  const char *name;
+  int *int_value;
+  double *double_value;
+};
+
+// Every parameter of *config, in formatPipelineConfig() order
+std::vector<PipelineConfigField> pipelineConfigFields(PipelineConfig *config);
+
+// Passes PipelineConfig snapshots from any number of publishing threads to
+// one reading thread (the vision thread) without locking the reader.
+//
+// publish() swaps in a new snapshot with an atomic exchange. The reader
+// announces the snapshot it is using in a hazard pointer, and a replaced
+// snapshot is only freed once no reader announces it, so the reader never
+// sees one disappear under it. Reading costs two atomic loads and a store
+// per frame; publishers take a mutex among themselves.
+class ConfigChannel {
+ public:
+  // Starts with defaultPipelineConfig()
+  ConfigChannel();
+  ~ConfigChannel();
+
+  // Any thread. Builds the derived tables and returns the new version.
+  uint64_t publish(const PipelineConfig &config);
+  // Any thread: a copy of the newest snapshot, to change and publish
+  PipelineConfig latest() const;
+
+  // The reading thread only. The snapshot stays valid until the next call.
+  const PipelineConfig *acquire();
+
+ private:
+  void freeRetired();
+
+  std::atomic<PipelineConfig *> current_;
+  std::atomic<PipelineConfig *> hazard_;
+  mutable std::mutex mutex_;  // publishers
+  std::vector<PipelineConfig *> retired_;
+  uint64_t next_version_;
+
+  ConfigChannel(const ConfigChannel &) = delete;
+  ConfigChannel &operator=(const ConfigChannel &) = delete;
+};
@@ -0,0 +1,195 @@
+#include "replay_format.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.hpp"
+
+static uint64_t alignUp(uint64_t value) {
+  return (value + kReplayAlignment - 1) / kReplayAlignment * kReplayAlignment;
+}
+
+ReplayWriter::ReplayWriter() : file_(nullptr), ok_(false) {
+  memset(&header_, 0, sizeof(header_));
+}
+
+ReplayWriter::~ReplayWriter() {
+  if (file_ != nullptr) {
+    close();
+  }
+}
+
+bool ReplayWriter::open(const std::string &path, PixelFormat format,
+                        int width, int height) {
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    LOGE("Could not create %s", path.c_str());
+    return false;
+  }
+  memset(&header_, 0, sizeof(header_));
+  header_.magic = kReplayMagic;
+  header_.version = kReplayVersion;
+  header_.pixel_format = format;
+  header_.width = width;
+  header_.height = height;
+  header_.frame_size = frameBytes(format, width, height);
+  header_.frame_stride = alignUp(header_.frame_size);
+  header_.frames_offset = alignUp(sizeof(ReplayHeader));
+  metas_.clear();
+
+  // Placeholder until close(); frame_count stays 0 if we never get there
+  ok_ = fwrite(&header_, sizeof(header_), 1, file_) == 1;
+  return ok_;
+}
+
+bool ReplayWriter::append(const cv::Mat &frame, const ReplayFrameMeta &meta) {
+  if (file_ == nullptr) {
+    return false;
+  }
+  PixelFormat format = static_cast<PixelFormat>(header_.pixel_format);
+  int expectedRows = frameRows(format, header_.height);
+  int expectedType = format == PIXEL_NV21 ? CV_8UC1 : CV_8UC4;
+  if (frame.cols != int(header_.width) || frame.rows != expectedRows ||
+      frame.type() != expectedType) {
+    LOGE("Frame is %dx%d type %d, expected %dx%d type %d", frame.cols,
+         frame.rows, frame.type(), header_.width, expectedRows, expectedType);
+    return false;
+  }
+
+  uint64_t offset = header_.frames_offset + metas_.size() * header_.frame_stride;
+  if (fseeko(file_, offset, SEEK_SET) != 0) {
+    ok_ = false;
+    return false;
+  }
+  size_t rowBytes = frame.cols * frame.elemSize();
+  for (int row = 0; row < frame.rows; ++row) {
+    if (fwrite(frame.ptr(row), rowBytes, 1, file_) != 1) {
+      ok_ = false;
+      return false;
+    }
+  }
+  metas_.push_back(meta);
+  return true;
+}
+
+bool ReplayWriter::close() {
+  if (file_ == nullptr) {
+    return false;
+  }
+  uint64_t count = metas_.size();
+  header_.frame_count = count;
+  header_.meta_offset = header_.frames_offset + count * header_.frame_stride;
+  header_.index_offset = header_.meta_offset + count * sizeof(ReplayFrameMeta);
+
+  std::vector<ReplayIndexEntry> index(count);
+  for (uint64_t i = 0; i < count; ++i) {
+    index[i].frame_offset = header_.frames_offset + i * header_.frame_stride;
+    index[i].meta_offset = header_.meta_offset + i * sizeof(ReplayFrameMeta);
+  }
+
+  bool ok = ok_;
+  ok = ok && fseeko(file_, header_.meta_offset, SEEK_SET) == 0;
+  ok = ok && (count == 0 ||
+              fwrite(metas_.data(), sizeof(ReplayFrameMeta), count, file_) == count);
+  ok = ok && (count == 0 ||
+              fwrite(index.data(), sizeof(ReplayIndexEntry), count, file_) == count);
+  ok = ok && fseeko(file_, 0, SEEK_SET) == 0;
+  ok = ok && fwrite(&header_, sizeof(header_), 1, file_) == 1;
+  ok = (fclose(file_) == 0) && ok;
+  file_ = nullptr;
+  return ok;
+}
+
+ReplayReader::ReplayReader() : base_(nullptr), length_(0), index_(nullptr) {
+  memset(&header_, 0, sizeof(header_));
+}
+
+ReplayReader::~ReplayReader() {
+  close();
+}
+
+bool ReplayReader::open(const std::string &path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOGE("Could not open %s", path.c_str());
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(ReplayHeader)) {
+    LOGE("%s is too short to be a replay file", path.c_str());
+    ::close(fd);
+    return false;
+  }
+  void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    LOGE("Could not map %s", path.c_str());
+    return false;
+  }
+  base_ = static_cast<uint8_t *>(mapped);
+  length_ = st.st_size;
+  memcpy(&header_, base_, sizeof(header_));
+
+  uint64_t frameSize = frameBytes(pixelFormat(), header_.width, header_.height);
+  bool valid = header_.magic == kReplayMagic &&
+               header_.version == kReplayVersion &&
+               header_.frame_count > 0 &&
+               header_.frame_size == frameSize &&
+               header_.frame_stride >= frameSize &&
+               header_.index_offset + header_.frame_count * sizeof(ReplayIndexEntry) <= length_;
+  if (!valid) {
+    LOGE("%s is not a complete replay file", path.c_str());
+    close();
+    return false;
+  }
+  index_ = reinterpret_cast<const ReplayIndexEntry *>(base_ + header_.index_offset);
+  for (uint64_t i = 0; i < header_.frame_count; ++i) {
+    if (index_[i].frame_offset + frameSize > length_ ||
+        index_[i].meta_offset + sizeof(ReplayFrameMeta) > length_) {
+      LOGE("%s: index entry %d is out of range", path.c_str(), int(i));
+      close();
+      return false;
+    }
+  }
+  // Replay reads frames in order
+  madvise(base_, length_, MADV_SEQUENTIAL);
+  return true;
+}
+
+void ReplayReader::close() {
+  if (base_ != nullptr) {
+    munmap(base_, length_);
+  }
+  base_ = nullptr;
+  length_ = 0;
+  index_ = nullptr;
+  memset(&header_, 0, sizeof(header_));
+}
+
+cv::Mat ReplayReader::frame(int i) const {
+  uint8_t *data = base_ + index_[i].frame_offset;
+  PixelFormat format = pixelFormat();
+  return cv::Mat(frameRows(format, header_.height), header_.width,
+                 format == PIXEL_NV21 ? CV_8UC1 : CV_8UC4, data);
+}
+
+const ReplayFrameMeta &ReplayReader::meta(int i) const {
+  return *reinterpret_cast<const ReplayFrameMeta *>(base_ + index_[i].meta_offset);
+}
+
+void ReplayReader::prefetch(int first, int count) const {
+  if (first < 0 || first >= frameCount()) {
+    return;
+  }
+  count = std::min(count, frameCount() - first);
+  uint8_t *start = base_ + index_[first].frame_offset;
+  size_t bytes = (count - 1) * header_.frame_stride + header_.frame_size;
+  madvise(start, bytes, MADV_WILLNEED);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "frame_format.hpp"
+
+// Replay container (.vrpl): raw frames laid out so they can be mmap'ed and
+// handed to the pipeline without decoding or copying.
+//
+//   ReplayHeader                      at 0
+//   frame 0 .. frame N-1              at frames_offset, frame_stride apart
+//   ReplayFrameMeta[N]                at meta_offset
+//   ReplayIndexEntry[N]               at index_offset (trailing index)
+//
+// frames_offset and frame_stride are multiples of the page size, so every
+// frame starts page aligned. All fields are little endian. The header is
+// written last; a file whose frame_count is 0 was not closed properly.
+
+static const uint32_t kReplayMagic = 0x4c505256;  // "VRPL"
+static const uint32_t kReplayVersion = 1;
+static const uint64_t kReplayAlignment = 4096;
+static const int kMaxReplayTargets = 8;
+
+struct ReplayHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t pixel_format;  // PixelFormat
+  uint32_t width;
+  uint32_t height;
+  uint32_t reserved0;
+  uint64_t frame_size;    // bytes of pixel data per frame
+  uint64_t frame_stride;  // frame_size rounded up to kReplayAlignment
+  uint64_t frame_count;
+  uint64_t frames_offset;
+  uint64_t meta_offset;
+  uint64_t index_offset;
+  uint64_t reserved1[4];
+};
+
+struct ReplayTarget {
+  int32_t type;
+  float centroid_x, centroid_y;
+  float width, height;
+  float leftToRightRatio;
+};
+
+struct ReplayFrameMeta {
+  int64_t timestamp_ns;
+  int32_t h_min, h_max, s_min, s_max, v_min, v_max;
+  int32_t mode;
+  int32_t num_expected;
+  ReplayTarget expected[kMaxReplayTargets];
+};
+
+struct ReplayIndexEntry {
+  uint64_t frame_offset;
+  uint64_t meta_offset;
+};
+
+// Appends frames to a new replay file. Frames go straight to disk; only the
+// (small) metadata is held in memory until close().
+class ReplayWriter {
+ public:
+  ReplayWriter();
+  ~ReplayWriter();
+
+  bool open(const std::string &path, PixelFormat format, int width,
+            int height);
+  // frame must have the shape given by frameRows() for the file's format
+  bool append(const cv::Mat &frame, const ReplayFrameMeta &meta);
+  // Writes metadata, index and header. Returns false if anything failed.
+  bool close();
+
+  uint64_t frameCount() const { return metas_.size(); }
+
+ private:
+  FILE *file_;
+  ReplayHeader header_;
+  std::vector<ReplayFrameMeta> metas_;
+  bool ok_;
+};
+
+// Read-only view of a replay file through mmap. Frames are returned as Mat
+// headers pointing into the mapping, so nothing is copied until a page is
+// first touched. The mapping is read-only, so consumers must copy a frame
+// before drawing on it (VisionPipeline::setInput() does).
+class ReplayReader {
+ public:
+  ReplayReader();
+  ~ReplayReader();
+
+  bool open(const std::string &path);
+  void close();
+
+  int frameCount() const { return int(header_.frame_count); }
+  int width() const { return header_.width; }
+  int height() const { return header_.height; }
+  PixelFormat pixelFormat() const {
+    return static_cast<PixelFormat>(header_.pixel_format);
+  }
+
+  // Random access by frame number
+  cv::Mat frame(int i) const;
+  const ReplayFrameMeta &meta(int i) const;
+
+  // Hint that frames [first, first + count) will be needed soon
+  void prefetch(int first, int count) const;
+
+ private:
+  uint8_t *base_;
+  size_t length_;
+  ReplayHeader header_;
+  const ReplayIndexEntry *index_;
+};
@@ -0,0 +1,272 @@
+#include "rle_mask.hpp"
+
+#include <string.h>
+
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common.hpp"
+#include "writer_thread.hpp"
+
+// Masks queued between the vision thread and the writer; a second of video
+static const int kMaskBuffers = 30;
+
+void RleMask::encode(const cv::Mat &mask) {
+  CV_Assert(mask.type() == CV_8UC1);
+  width = mask.cols;
+  height = mask.rows;
+  runs.clear();
+  for (int y = 0; y < mask.rows; ++y) {
+    const uint8_t *row = mask.ptr<uint8_t>(y);
+    int x = 0;
+    while (x < width) {
+      // Most of the mask is empty, so skip zeros eight at a time
+      while (x + 8 <= width) {
+        uint64_t word;
+        memcpy(&word, row + x, sizeof(word));
+        if (word != 0) {
+          break;
+        }
+        x += 8;
+      }
+      while (x < width && row[x] == 0) {
+        ++x;
+      }
+      if (x == width) {
+        break;
+      }
+      int start = x;
+      while (x < width && row[x] != 0) {
+        ++x;
+      }
+      MaskRun run;
+      run.y = uint16_t(y);
+      run.x = uint16_t(start);
+      run.length = uint16_t(x - start);
+      runs.push_back(run);
+    }
+  }
+}
+
+void RleMask::decode(cv::Mat &mask) const {
+  mask.create(height, width, CV_8UC1);
+  mask.setTo(cv::Scalar(0));
+  for (auto &run : runs) {
+    memset(mask.ptr<uint8_t>(run.y) + run.x, 255, run.length);
+  }
+}
+
+MaskRecorder::MaskRecorder()
+    : file_(nullptr), width_(0), height_(0), recorded_(0), dropped_(0),
+      stop_(false) {
+}
+
+MaskRecorder::~MaskRecorder() {
+  stop();
+}
+
+bool MaskRecorder::start(const std::string &path, int width, int height) {
+  stop();
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    LOGE("Could not create %s", path.c_str());
+    return false;
+  }
+  uint32_t header[4] = {kMaskMagic, kMaskVersion, uint32_t(width),
+                        uint32_t(height)};
+  if (fwrite(header, sizeof(header), 1, file_) != 1) {
+    LOGE("Could not write %s", path.c_str());
+    fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+
+  width_ = width;
+  height_ = height;
+  // Reserve enough runs for a busy frame so encoding doesn't allocate
+  buffers_.resize(kMaskBuffers);
+  free_.clear();
+  queued_.clear();
+  for (int i = 0; i < kMaskBuffers; ++i) {
+    buffers_[i].mask.runs.reserve(4096);
+    free_.push_back(i);
+  }
+  recorded_ = 0;
+  dropped_ = 0;
+  stop_ = false;
+  writer_ = std::thread(&MaskRecorder::writerLoop, this);
+  return true;
+}
+
+void MaskRecorder::stop() {
+  if (!writer_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  // The writer drains the queue before exiting
+  writer_.join();
+  fclose(file_);
+  file_ = nullptr;
+  LOGI("Mask recording stopped: %lld frames, %lld dropped",
+       (long long)recorded_.load(), (long long)dropped_.load());
+}
+
+void stopInBackground(std::unique_ptr<MaskRecorder> recorder) {
+  if (!recorder) {
+    return;
+  }
+  MaskRecorder *stopping = recorder.release();
+  std::thread([stopping] { delete stopping; }).detach();
+}
+
+int MaskRecorder::acquireBuffer() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_.empty()) {
+    ++dropped_;
+    return -1;
+  }
+  int index = free_.back();
+  free_.pop_back();
+  return index;
+}
+
+void MaskRecorder::queueBuffer(int index, const MaskFrameHeader &header) {
+  Buffer &buffer = buffers_[index];
+  buffer.header = header;
+  buffer.header.num_runs = uint32_t(buffer.mask.runs.size());
+  buffer.header.reserved = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_.push_back(index);
+  }
+  wake_.notify_one();
+}
+
+void MaskRecorder::record(const cv::Mat &mask, const MaskFrameHeader &header) {
+  if (mask.cols != width_ || mask.rows != height_) {
+    ++dropped_;
+    return;
+  }
+  int index = acquireBuffer();
+  if (index < 0) {
+    return;
+  }
+  // Encode outside the lock; the buffer belongs to this thread until queued
+  buffers_[index].mask.encode(mask);
+  queueBuffer(index, header);
+}
+
+void MaskRecorder::record(const std::vector<MaskRun> &runs,
+                          const MaskFrameHeader &header) {
+  int index = acquireBuffer();
+  if (index < 0) {
+    return;
+  }
+  RleMask &mask = buffers_[index].mask;
+  mask.width = width_;
+  mask.height = height_;
+  mask.runs.assign(runs.begin(), runs.end());
+  queueBuffer(index, header);
+}
+
+void MaskRecorder::writerLoop() {
+  if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), kWriterNice) != 0) {
+    LOGE("Could not lower mask recorder priority: %d", errno);
+  }
+
+  std::vector<int> batch;
+  bool ok = true;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this] { return stop_ || !queued_.empty(); });
+    if (queued_.empty()) {
+      break;  // stopping and drained
+    }
+    batch.swap(queued_);
+    lock.unlock();
+
+    for (int index : batch) {
+      const Buffer &buffer = buffers_[index];
+      if (ok) {
+        size_t numRuns = buffer.mask.runs.size();
+        ok = fwrite(&buffer.header, sizeof(buffer.header), 1, file_) == 1 &&
+             (numRuns == 0 ||
+              fwrite(buffer.mask.runs.data(), sizeof(MaskRun), numRuns, file_) == numRuns);
+        if (!ok) {
+          LOGE("Mask recording write failed, discarding the rest");
+        }
+      }
+      if (ok) {
+        ++recorded_;
+      } else {
+        ++dropped_;
+      }
+    }
+
+    lock.lock();
+    free_.insert(free_.end(), batch.begin(), batch.end());
+    batch.clear();
+  }
+  lock.unlock();
+  fflush(file_);
+}
+
+bool MaskReplay::open(const std::string &path) {
+  frames_.clear();
+  runs_.clear();
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    LOGE("Could not open %s", path.c_str());
+    return false;
+  }
+  uint32_t header[4];
+  if (fread(header, sizeof(header), 1, file) != 1 ||
+      header[0] != kMaskMagic || header[1] != kMaskVersion) {
+    LOGE("%s is not a mask recording", path.c_str());
+    fclose(file);
+    return false;
+  }
+  width_ = int(header[2]);
+  height_ = int(header[3]);
+
+  Frame frame;
+  while (fread(&frame.header, sizeof(frame.header), 1, file) == 1) {
+    size_t numRuns = frame.header.num_runs;
+    frame.first_run = runs_.size();
+    runs_.resize(frame.first_run + numRuns);
+    if (numRuns > 0 &&
+        fread(&runs_[frame.first_run], sizeof(MaskRun), numRuns, file) != numRuns) {
+      // Truncated last frame, e.g. the app was killed mid-write
+      runs_.resize(frame.first_run);
+      break;
+    }
+    bool valid = true;
+    for (size_t r = frame.first_run; r < runs_.size(); ++r) {
+      const MaskRun &run = runs_[r];
+      valid = valid && run.y < height_ && run.x + run.length <= width_;
+    }
+    if (!valid) {
+      LOGE("%s: frame %d has runs outside the mask", path.c_str(),
+           int(frames_.size()));
+      runs_.resize(frame.first_run);
+      break;
+    }
+    frames_.push_back(frame);
+  }
+  fclose(file);
+  return !frames_.empty();
+}
+
+void MaskReplay::mask(int i, RleMask *out) const {
+  const Frame &frame = frames_[i];
+  out->width = width_;
+  out->height = height_;
+  out->runs.assign(runs_.begin() + frame.first_run,
+                   runs_.begin() + frame.first_run + frame.header.num_runs);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// One horizontal run of set pixels
+struct MaskRun {
+  uint16_t y;
+  uint16_t x;
+  uint16_t length;
+};
+
+// Run-length encoded binary mask. A typical arena frame is a few hundred
+// runs, against 300 KB for the 8-bit mask at 640x480.
+struct RleMask {
+  int width;
+  int height;
+  std::vector<MaskRun> runs;  // sorted by y, then x
+
+  // Encodes an 8-bit mask where any nonzero byte is set
+  void encode(const cv::Mat &mask);
+  // Writes 255 for set pixels and 0 elsewhere; mask is (re)allocated to size
+  void decode(cv::Mat &mask) const;
+};
+
+// Metadata stored with every recorded mask
+struct MaskFrameHeader {
+  int64_t timestamp_ns;
+  int32_t h_min, h_max, s_min, s_max, v_min, v_max;
+  uint32_t num_runs;
+  uint32_t reserved;
+};
+
+// Mask recording file (.vrle):
+//
+//   uint32 magic, uint32 version, uint32 width, uint32 height
+//   then per frame: MaskFrameHeader followed by num_runs MaskRuns
+//
+// Frames are appended as they come, so a recording cut short by a crash is
+// still readable up to the last complete frame.
+static const uint32_t kMaskMagic = 0x454c5256;  // "VRLE"
+static const uint32_t kMaskVersion = 1;
+
+// Records every frame's mask at camera rate. The vision thread encodes into
+// one of a fixed set of buffers and queues it; a low-priority writer thread
+// appends queued masks to the file. If the writer falls behind and all
+// buffers are queued, frames are dropped instead of blocking.
+class MaskRecorder {
+ public:
+  MaskRecorder();
+  ~MaskRecorder();
+
+  bool start(const std::string &path, int width, int height);
+  void stop();
+
+  // Vision thread only
+  void record(const cv::Mat &mask, const MaskFrameHeader &header);
+  // Same, for a mask that is already run-length encoded
+  void record(const std::vector<MaskRun> &runs, const MaskFrameHeader &header);
+
+  int64_t recordedFrames() const { return recorded_.load(); }
+  int64_t droppedFrames() const { return dropped_.load(); }
+
+ private:
+  struct Buffer {
+    MaskFrameHeader header;
+    RleMask mask;
+  };
+
+  // Takes a free buffer for the vision thread to fill, or returns -1
+  int acquireBuffer();
+  void queueBuffer(int index, const MaskFrameHeader &header);
+  void writerLoop();
+
+  FILE *file_;
+  int width_, height_;
+  std::vector<Buffer> buffers_;
+  std::vector<int> free_;    // guarded by mutex_
+  std::vector<int> queued_;  // guarded by mutex_, oldest first
+
+  std::atomic<int64_t> recorded_;
+  std::atomic<int64_t> dropped_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+  std::thread writer_;
+};
+
+// Stops a recorder without waiting for it: the writer drains its queue and
+// closes the file on a thread of its own, so the vision thread never blocks
+// on the join.
+void stopInBackground(std::unique_ptr<MaskRecorder> recorder);
+
+// Loads a whole mask recording into memory for replay
+class MaskReplay {
+ public:
+  bool open(const std::string &path);
+
+  int frameCount() const { return int(frames_.size()); }
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  const MaskFrameHeader &header(int i) const { return frames_[i].header; }
+  // Expands frame i into an RleMask
+  void mask(int i, RleMask *out) const;
+
+ private:
+  struct Frame {
+    MaskFrameHeader header;
+    size_t first_run;
+  };
+
+  int width_ = 0, height_ = 0;
+  std::vector<Frame> frames_;
+  std::vector<MaskRun> runs_;
+};
@@ -0,0 +1,333 @@
+#include "robot_protocol.hpp"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+size_t jsonValue(const std::string &json, const char *key) {
+  size_t pos = json.find(std::string("\"") + key + "\"");
+  if (pos == std::string::npos) {
+    return pos;
+  }
+  pos = json.find_first_not_of(" \t", pos + strlen(key) + 2);
+  if (pos == std::string::npos || json[pos] != ':') {
+    return std::string::npos;
+  }
+  return json.find_first_not_of(" \t", pos + 1);
+}
+
+bool jsonString(const std::string &json, const char *key, std::string *out) {
+  size_t pos = jsonValue(json, key);
+  if (pos == std::string::npos || json[pos] != '"') {
+    return false;
+  }
+  out->clear();
+  for (++pos; pos < json.size(); ++pos) {
+    char c = json[pos];
+    if (c == '"') {
+      return true;
+    }
+    if (c == '\\' && pos + 1 < json.size()) {
+      c = json[++pos];
+      if (c == 'n') {
+        c = '\n';
+      } else if (c == 't') {
+        c = '\t';
+      } else if (c == 'r') {
+        c = '\r';
+      }
+    }
+    out->push_back(c);
+  }
+  return false;
+}
+
+bool jsonNumber(const std::string &json, const char *key, double *out) {
+  size_t pos = jsonValue(json, key);
+  if (pos == std::string::npos) {
+    return false;
+  }
+  char *end;
+  *out = strtod(json.c_str() + pos, &end);
+  return end != json.c_str() + pos;
+}
+
+std::string jsonQuote(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c == '\r') {
+      out += "\\r";
+    } else if (c == '\t') {
+      out += "\\t";
+    } else {
+      out.push_back(c);
+    }
+  }
+  out.push_back('"');
+  return out;
+}
+
+std::string encodeLinkMessage(const LinkMessage &message) {
+  return "{\"type\":" + jsonQuote(message.type) +
+         ",\"message\":" + jsonQuote(message.message) + "}";
+}
+
+bool parseLinkMessage(const std::string &line, LinkMessage *message) {
+  return jsonString(line, "type", &message->type) &&
+         jsonString(line, "message", &message->message);
+}
+
+int listenTcp(int port, int rcvbuf) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (rcvbuf > 0) {
+    // Inherited by accepted sockets; has to be set before listen() to shape
+    // the advertised window
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  }
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, 1) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int localPort(int fd) {
+  sockaddr_in addr;
+  socklen_t length = sizeof(addr);
+  if (getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &length) != 0) {
+    return -1;
+  }
+  return ntohs(addr.sin_port);
+}
+
+int acceptTcp(int listener, int timeout_ms) {
+  pollfd p = {listener, POLLIN, 0};
+  if (poll(&p, 1, timeout_ms) <= 0) {
+    return -1;
+  }
+  return accept(listener, nullptr, nullptr);
+}
+
+int connectTcp(const char *host, int port) {
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *info;
+  char service[16];
+  snprintf(service, sizeof(service), "%d", port);
+  if (getaddrinfo(host, service, &hints, &info) != 0) {
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, info->ai_addr, info->ai_addrlen) != 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(info);
+  if (fd >= 0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+int bindUdp(int port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool resolveUdp(const char *host, int port, sockaddr_storage *addr,
+                unsigned *addr_length) {
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo *info;
+  char service[16];
+  snprintf(service, sizeof(service), "%d", port);
+  if (getaddrinfo(host, service, &hints, &info) != 0) {
+    return false;
+  }
+  memcpy(addr, info->ai_addr, info->ai_addrlen);
+  *addr_length = info->ai_addrlen;
+  freeaddrinfo(info);
+  return true;
+}
+
+bool UpdateSequencer::accept(int64_t session, int64_t seq, int64_t captured_ns,
+                             int64_t now_ns) {
+  // Whatever its session, an update must be newer than what the robot has
+  if (accepted_ > 0 && captured_ns <= newest_capture_ns_) {
+    ++out_of_order_;
+    return false;
+  }
+  double age_ms = (now_ns - captured_ns) / 1e6;
+  if (!started_ || session != session_) {
+    // A straggler from an earlier session must not take over again
+    if (started_ && age_ms > max_age_ms_) {
+      ++stale_;
+      return false;
+    }
+    started_ = true;
+    session_ = session;
+    last_seq_ = -1;
+    ++sessions_;
+  }
+  if (seq <= last_seq_) {
+    ++out_of_order_;
+    return false;
+  }
+  // A newer update replaces an older one even if it is itself too old to
+  // use, so a late straggler can't sneak in after it
+  last_seq_ = seq;
+  if (age_ms > max_age_ms_) {
+    ++stale_;
+    return false;
+  }
+  newest_capture_ns_ = captured_ns;
+  ++accepted_;
+  return true;
+}
+
+ClockOffsetEstimator::ClockOffsetEstimator(int window, int64_t max_rtt_ns)
+    : window_(window), max_rtt_ns_(max_rtt_ns), estimate_{false, 0, 0} {}
+
+bool ClockOffsetEstimator::addSample(int64_t t0, int64_t t1, int64_t t2, int64_t t3) {
+  int64_t rtt = (t3 - t0) - (t2 - t1);
+  if (t3 < t0 || t2 < t1 || rtt < 0 || rtt > max_rtt_ns_) {
+    return false;
+  }
+  Sample sample = {((t1 - t0) + (t2 - t3)) / 2, rtt};
+  samples_.push_back(sample);
+  if (samples_.size() > window_) {
+    samples_.pop_front();
+  }
+  const Sample *best = &samples_.front();
+  for (const Sample &s : samples_) {
+    if (s.rtt_ns < best->rtt_ns) {
+      best = &s;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  estimate_ = {true, best->offset_ns, best->rtt_ns};
+  return true;
+}
+
+void ClockOffsetEstimator::reset() {
+  samples_.clear();
+  std::lock_guard<std::mutex> lock(mutex_);
+  estimate_ = {false, 0, 0};
+}
+
+ClockEstimate ClockOffsetEstimator::estimate() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return estimate_;
+}
+
+void LineSocket::reset(int fd) {
+  close();
+  buffer_.clear();
+  fd_ = fd;
+}
+
+void LineSocket::close() {
+  int fd = fd_.exchange(-1);
+  if (fd >= 0) {
+    // shutdown() first so a thread blocked reading or writing wakes up
+    shutdown(fd, SHUT_RDWR);
+    ::close(fd);
+  }
+}
+
+LineResult LineSocket::readLine(int timeout_ms, std::string *line) {
+  while (true) {
+    size_t newline = buffer_.find('\n');
+    if (newline != std::string::npos) {
+      size_t length = newline;
+      if (length > 0 && buffer_[length - 1] == '\r') {
+        --length;
+      }
+      line->assign(buffer_, 0, length);
+      buffer_.erase(0, newline + 1);
+      return LINE_OK;
+    }
+    int fd = fd_;
+    if (fd < 0) {
+      return LINE_CLOSED;
+    }
+    pollfd p = {fd, POLLIN, 0};
+    int ready = poll(&p, 1, timeout_ms);
+    if (ready == 0) {
+      return LINE_TIMEOUT;
+    }
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return LINE_CLOSED;
+    }
+    char chunk[1024];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return LINE_CLOSED;
+    }
+    buffer_.append(chunk, n);
+  }
+}
+
+bool LineSocket::writeLine(const std::string &line) {
+  std::string data = line + "\r\n";
+  size_t sent = 0;
+  while (sent < data.size()) {
+    int fd = fd_;
+    if (fd < 0) {
+      return false;
+    }
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
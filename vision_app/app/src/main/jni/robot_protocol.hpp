@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+
+// The link between RobotConnection and the robot: newline-delimited JSON over
+// TCP, one object per line,
+//
+//   {"type":"heartbeat","message":"{}"}\r\n
+//
+// where message is itself JSON, sent as a string. These helpers only cover
+// the flat objects the protocol uses; they are for tools and tests, not a
+// general JSON parser.
+
+// Position just past `"key":` (and any spaces), or npos
+size_t jsonValue(const std::string &json, const char *key);
+// Value of "key": "..." unescaped. Escaped unicode is kept as is.
+bool jsonString(const std::string &json, const char *key, std::string *out);
+bool jsonNumber(const std::string &json, const char *key, double *out);
+// s as a JSON string literal, quotes included
+std::string jsonQuote(const std::string &s);
+
+struct LinkMessage {
+  std::string type;
+  std::string message;
+};
+
+// One line, without the line end
+std::string encodeLinkMessage(const LinkMessage &message);
+bool parseLinkMessage(const std::string &line, LinkMessage *message);
+
+// Listening socket on all interfaces; port 0 picks a free one. rcvbuf > 0
+// sets the receive buffer of accepted sockets. Returns -1 on error.
+int listenTcp(int port, int rcvbuf);
+int localPort(int fd);
+// Waits up to timeout_ms for a connection; -1 on timeout or error
+int acceptTcp(int listener, int timeout_ms);
+// Blocking connect with TCP_NODELAY set, as on the phone; -1 on error
+int connectTcp(const char *host, int port);
+
+// UDP socket bound to port on all interfaces (0 picks a free one); -1 on
+// error
+int bindUdp(int port);
+// Resolves host:port for sendto(); false if the host is unknown
+bool resolveUdp(const char *host, int port, struct sockaddr_storage *addr,
+                unsigned *addr_length);
+
+// Receiver side of a transport that can drop, reorder or delay target
+// updates (UDP): keeps only updates newer than the newest accepted one and
+// younger than max_age_ms. Every sender numbers its updates from 0 under a
+// random session id, so a new session (the app restarted, or the transport
+// was switched off and on) starts the numbering over. Sequence numbers only
+// order updates within a session; across sessions the capture time does, so
+// a late datagram of the old session can't follow a newer capture.
+class UpdateSequencer {
+ public:
+  explicit UpdateSequencer(double max_age_ms) : max_age_ms_(max_age_ms) {}
+
+  // captured_ns and now_ns are robot time. The capture time is
+  // capturedAtRobotNs when the phone has synced to the robot's clock, which
+  // includes the time in flight, otherwise now less the phone's
+  // capturedAgoMs.
+  bool accept(int64_t session, int64_t seq, int64_t captured_ns, int64_t now_ns);
+
+  int64_t accepted() const { return accepted_; }
+  int64_t outOfOrder() const { return out_of_order_; }
+  int64_t stale() const { return stale_; }
+  int64_t sessions() const { return sessions_; }
+
+ private:
+  double max_age_ms_;
+  bool started_ = false;
+  int64_t session_ = 0;
+  int64_t sessions_ = 0;
+  int64_t last_seq_ = -1;
+  int64_t newest_capture_ns_ = 0;  // of the newest accepted update
+  int64_t accepted_ = 0;
+  int64_t out_of_order_ = 0;
+  int64_t stale_ = 0;
+};
+
+// Phone-to-robot clock offset from NTP-style exchanges over the heartbeats.
+// The phone stamps a heartbeat when it sends it (t0); the robot echoes t0
+// with its own receive and reply times (t1, t2); the phone stamps the reply
+// when it arrives (t3):
+//
+//   {"type":"heartbeat","message":"{\"t0\":...,\"t1\":...,\"t2\":...}"}
+//
+// Each exchange gives offset = ((t1 - t0) + (t2 - t3)) / 2, which is exact
+// when the trip out takes as long as the trip back. Queueing delay rarely
+// hits both ways equally, so the estimate is the offset of the exchange with
+// the lowest round trip among the last `window`.
+//
+// addSample() and reset() must come from one thread; estimate() may be
+// called from any.
+struct ClockEstimate {
+  bool synced;
+  int64_t offset_ns;  // robot time = phone time + offset
+  int64_t rtt_ns;     // round trip of the exchange the offset comes from
+
+  int64_t toRobotTime(int64_t phone_ns) const { return phone_ns + offset_ns; }
+};
+
+class ClockOffsetEstimator {
+ public:
+  explicit ClockOffsetEstimator(int window = 32, int64_t max_rtt_ns = 100000000);
+
+  // All in ns; t0, t3 on the phone clock, t1, t2 on the robot's. Returns
+  // false for an impossible or too slow exchange, which is ignored.
+  bool addSample(int64_t t0, int64_t t1, int64_t t2, int64_t t3);
+  void reset();
+
+  // All three fields from the same update, never a mix of two
+  ClockEstimate estimate() const;
+
+ private:
+  struct Sample {
+    int64_t offset_ns;
+    int64_t rtt_ns;
+  };
+
+  const size_t window_;
+  const int64_t max_rtt_ns_;
+  std::deque<Sample> samples_;
+  mutable std::mutex mutex_;
+  ClockEstimate estimate_;  // guarded by mutex_
+};
+
+enum LineResult {
+  LINE_OK,
+  LINE_TIMEOUT,
+  LINE_CLOSED,
+};
+
+// Line framing over a connected socket. Owns the fd. One thread may read
+// while another writes; close() from either wakes the other up.
+class LineSocket {
+ public:
+  explicit LineSocket(int fd = -1) : fd_(fd) {}
+  ~LineSocket() { close(); }
+
+  void reset(int fd);
+  void close();
+  bool isOpen() const { return fd_ >= 0; }
+  int fd() const { return fd_; }
+
+  // Next line without its line end
+  LineResult readLine(int timeout_ms, std::string *line);
+  // Appends "\r\n"; blocks while the socket is backed up
+  bool writeLine(const std::string &line);
+
+ private:
+  LineSocket(const LineSocket &) = delete;
+  LineSocket &operator=(const LineSocket &) = delete;
+
+  std::atomic<int> fd_;
+  std::string buffer_;  // reader only
+};
@@ -0,0 +1,103 @@
+#include "run_labeler.hpp"
+
+#include <algorithm>
+
+int RunLabeler::find(int run) {
+  while (parent_[run] != run) {
+    // Path halving
+    parent_[run] = parent_[parent_[run]];
+    run = parent_[run];
+  }
+  return run;
+}
+
+void RunLabeler::unite(int a, int b) {
+  a = find(a);
+  b = find(b);
+  // The earlier run stays the root, which keeps the output in raster order
+  if (a < b) {
+    parent_[b] = a;
+  } else if (b < a) {
+    parent_[a] = b;
+  }
+}
+
+void RunLabeler::label(const std::vector<MaskRun> &runs,
+                       std::vector<Blob> *blobs) {
+  begin();
+  addRuns(runs.data(), int(runs.size()));
+  finish(blobs);
+}
+
+void RunLabeler::begin() {
+  runs_.clear();
+  parent_.clear();
+  prev_begin_ = 0;
+  prev_end_ = 0;
+}
+
+void RunLabeler::addRuns(const MaskRun *runs, int count) {
+  int rowBegin = int(runs_.size());
+  runs_.insert(runs_.end(), runs, runs + count);
+  int total = int(runs_.size());
+  parent_.resize(total);
+  for (int i = rowBegin; i < total; ++i) {
+    parent_[i] = i;
+  }
+
+  // [prev_begin_, prev_end_) are the runs of the row above the current one
+  while (rowBegin < total) {
+    int y = runs_[rowBegin].y;
+    int rowEnd = rowBegin;
+    while (rowEnd < total && runs_[rowEnd].y == y) {
+      ++rowEnd;
+    }
+    bool adjacent = prev_end_ > prev_begin_ && runs_[prev_begin_].y + 1 == y;
+    if (adjacent) {
+      int j = prev_begin_;
+      for (int i = rowBegin; i < rowEnd; ++i) {
+        int start = runs_[i].x;
+        int end = start + runs_[i].length;
+        // 8-connected: runs touch if they overlap or meet diagonally
+        while (j < prev_end_ && runs_[j].x + runs_[j].length < start) {
+          ++j;
+        }
+        for (int k = j; k < prev_end_ && runs_[k].x <= end; ++k) {
+          unite(i, k);
+        }
+      }
+    }
+    prev_begin_ = rowBegin;
+    prev_end_ = rowEnd;
+    rowBegin = rowEnd;
+  }
+}
+
+void RunLabeler::finish(std::vector<Blob> *blobs) {
+  const std::vector<MaskRun> &runs = runs_;
+  int count = int(runs.size());
+  blobs->clear();
+  blob_index_.assign(count, -1);
+  run_blob_.resize(count);
+  for (int i = 0; i < count; ++i) {
+    int root = find(i);
+    const MaskRun &run = runs[i];
+    if (blob_index_[root] < 0) {
+      blob_index_[root] = int(blobs->size());
+      run_blob_[i] = blob_index_[root];
+      Blob blob;
+      blob.box = cv::Rect(run.x, run.y, run.length, 1);
+      blob.pixels = run.length;
+      blobs->push_back(blob);
+      continue;
+    }
+    run_blob_[i] = blob_index_[root];
+    Blob &blob = (*blobs)[blob_index_[root]];
+    int left = std::min(blob.box.x, int(run.x));
+    int right = std::max(blob.box.x + blob.box.width, run.x + run.length);
+    blob.box.x = left;
+    blob.box.width = right - left;
+    blob.box.height = run.y + 1 - blob.box.y;
+    blob.pixels += run.length;
+  }
+}
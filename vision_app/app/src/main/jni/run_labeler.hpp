@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "rle_mask.hpp"
+
+// One 8-connected component of a mask
+struct Blob {
+  cv::Rect box;
+  int pixels;
+};
+
+// Connected component labeling over runs with union-find: each run is
+// joined to the runs it touches on the row above, so the cost depends on the
+// number of runs, not pixels.
+//
+// Differences from findContours(RETR_EXTERNAL) to keep in mind: a blob
+// inside the hole of another blob is reported on its own instead of being
+// dropped, pixels on the image border are kept (findContours clips them),
+// and blobs come out in raster order of their first pixel.
+class RunLabeler {
+ public:
+  // runs must be sorted by y, then x
+  void label(const std::vector<MaskRun> &runs, std::vector<Blob> *blobs);
+
+  // The same in pieces, for masks that arrive a few rows at a time. Runs
+  // are joined to the row above as they are added, so finish() only has to
+  // collect the blobs. Each call must continue in raster order and hold all
+  // of the runs of the rows it covers.
+  void begin();
+  void addRuns(const MaskRun *runs, int count);
+  void finish(std::vector<Blob> *blobs);
+
+  // Index into the last label() output of the blob each run belongs to
+  const std::vector<int> &runBlobs() const { return run_blob_; }
+
+ private:
+  int find(int run);
+  void unite(int a, int b);
+
+  std::vector<MaskRun> runs_;
+  std::vector<int> parent_;
+  int prev_begin_ = 0, prev_end_ = 0;
+  std::vector<int> blob_index_;
+  std::vector<int> run_blob_;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "common.hpp"
+#include "perf_counters.hpp"
+
+// Time source for anything that makes decisions based on timing, so the
+// decisions can be replayed on the host with a simulated clock
+class Clock {
+ public:
+  virtual ~Clock() {}
+  virtual int64_t nowNs() = 0;
+};
+
+// CLOCK_MONOTONIC, the same clock as System.nanoTime() on Android
+class SystemClock : public Clock {
+ public:
+  int64_t nowNs() override { return getTimeNs(); }
+
+  static SystemClock *instance() {
+    static SystemClock clock;
+    return &clock;
+  }
+};
+
+// Only moves when told to
+class ManualClock : public Clock {
+ public:
+  int64_t nowNs() override { return now_ns_; }
+  void advance(int64_t ns) { now_ns_ += ns; }
+  void set(int64_t ns) { now_ns_ = ns; }
+
+ private:
+  int64_t now_ns_ = 0;
+};
+
+enum Stage {
+  STAGE_THRESHOLD = 0,  // color conversion and threshold
+  STAGE_BLOBS,          // mask cleanup and blob extraction
+  STAGE_MATCH,          // pairing
+  STAGE_RENDER,         // visualization
+  NUM_STAGES
+};
+
+// Per-stage durations of one frame. begin() starts the frame and each mark()
+// ends the named stage; stages that are not marked count as 0 and end at 0.
+//
+// With enableCounters() it also keeps per-stage hardware event counts of the
+// calling thread. Work a stage hands to other threads (the tiled extractor)
+// shows up in its time but not in its counts.
+class StageTimer {
+ public:
+  explicit StageTimer(Clock *clock = SystemClock::instance()) : clock_(clock) {
+    begin();
+  }
+
+  void setClock(Clock *clock) { clock_ = clock; }
+  Clock *clock() const { return clock_; }
+
+  // Returns whether counters are running; false when turned off or when the
+  // kernel doesn't allow them, in which case only times are kept
+  bool enableCounters(bool enable) {
+    counters_.reset();
+    if (enable) {
+      counters_.reset(new PerfCounters());
+      if (!counters_->open()) {
+        counters_.reset();
+      }
+    }
+    begin();
+    return counters_ != nullptr;
+  }
+  bool countersEnabled() const { return counters_ != nullptr; }
+
+  void begin() {
+    start_ns_ = last_ns_ = clock_->nowNs();
+    for (int i = 0; i < NUM_STAGES; ++i) {
+      stage_ns_[i] = 0;
+      end_ns_[i] = 0;
+      stage_counts_[i] = PerfCounts();
+    }
+    if (counters_) {
+      counters_->read(&last_counts_);
+    }
+  }
+
+  void mark(Stage stage) {
+    int64_t now = clock_->nowNs();
+    stage_ns_[stage] += now - last_ns_;
+    end_ns_[stage] = now;
+    last_ns_ = now;
+    if (counters_) {
+      PerfCounts counts;
+      counters_->read(&counts);
+      stage_counts_[stage] += counts - last_counts_;
+      last_counts_ = counts;
+    }
+  }
+
+  // Time since begin(), including anything between the marks
+  int64_t elapsedNs() const { return clock_->nowNs() - start_ns_; }
+  int64_t stageNs(Stage stage) const { return stage_ns_[stage]; }
+  int64_t startNs() const { return start_ns_; }
+  // Clock time the stage was last marked, for lining stages up with
+  // timestamps taken outside the pipeline
+  int64_t stageEndNs(Stage stage) const { return end_ns_[stage]; }
+  // All 0 unless countersEnabled()
+  const PerfCounts &stageCounts(Stage stage) const { return stage_counts_[stage]; }
+
+ private:
+  Clock *clock_;
+  int64_t start_ns_;
+  int64_t last_ns_;
+  int64_t stage_ns_[NUM_STAGES];
+  int64_t end_ns_[NUM_STAGES];
+  std::unique_ptr<PerfCounters> counters_;
+  PerfCounts last_counts_;
+  PerfCounts stage_counts_[NUM_STAGES];
+};
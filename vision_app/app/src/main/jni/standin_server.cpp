@@ -0,0 +1,233 @@
+#include "standin_server.hpp"
+
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "common.hpp"
+
+
+bool StandinServer::start(int port, const StandinConfig &config) {
+  stop();
+  config_ = config;
+  listener_ = listenTcp(port, config.rcvbuf);
+  if (listener_ < 0) {
+    LOGE("Stand-in could not listen on port %d", port);
+    return false;
+  }
+  port_ = localPort(listener_);
+  udp_fd_ = bindUdp(port == 0 ? 0 : port + 1);
+  if (udp_fd_ < 0) {
+    LOGE("Stand-in could not bind UDP port %d", port + 1);
+    close(listener_);
+    listener_ = -1;
+    return false;
+  }
+  udp_port_ = localPort(udp_fd_);
+  // Fixed seeds, so a run with the same settings loses the same updates
+  tcp_rng_.seed(1);
+  udp_rng_.seed(2);
+  sequencer_ = UpdateSequencer(config.max_age_ms);
+  running_ = true;
+  thread_ = std::thread(&StandinServer::run, this);
+  udp_thread_ = std::thread(&StandinServer::runUdp, this);
+  return true;
+}
+
+void StandinServer::stop() {
+  running_ = false;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (udp_thread_.joinable()) {
+    udp_thread_.join();
+  }
+  if (listener_ >= 0) {
+    close(listener_);
+    listener_ = -1;
+  }
+  if (udp_fd_ >= 0) {
+    close(udp_fd_);
+    udp_fd_ = -1;
+  }
+}
+
+int64_t StandinServer::datagramsOutOfOrder() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sequencer_.outOfOrder();
+}
+
+int64_t StandinServer::datagramsStale() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sequencer_.stale();
+}
+
+int64_t StandinServer::datagramSessions() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sequencer_.sessions();
+}
+
+bool StandinServer::lose(std::mt19937 *rng) {
+  return config_.loss_percent > 0 &&
+         std::uniform_real_distribution<double>(0, 100)(*rng) < config_.loss_percent;
+}
+
+void StandinServer::takeArrivals(std::vector<StandinArrival> *arrivals) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  arrivals->insert(arrivals->end(), arrivals_.begin(), arrivals_.end());
+  arrivals_.clear();
+}
+
+void StandinServer::run() {
+  while (running_) {
+    int fd = acceptTcp(listener_, 100);
+    if (fd >= 0) {
+      ++connections_;
+      LineSocket phone(fd);
+      serve(&phone);
+    }
+  }
+}
+
+void StandinServer::serve(LineSocket *phone) {
+  pending_replies_.clear();
+  int64_t connected = getTimeNs();
+  int64_t nextStall = config_.stall_every_ms > 0
+                          ? connected + config_.stall_every_ms * 1000000LL : 0;
+  int64_t disconnectAt = config_.disconnect_every_ms > 0
+                             ? connected + config_.disconnect_every_ms * 1000000LL : 0;
+  std::string line;
+  while (running_) {
+    int64_t now = getTimeNs();
+    if (disconnectAt != 0 && now >= disconnectAt) {
+      return;
+    }
+    if (nextStall != 0 && now >= nextStall) {
+      // Nothing is read or answered, so the phone's writes back up
+      usleep(config_.stall_ms * 1000);
+      nextStall += config_.stall_every_ms * 1000000LL;
+      continue;
+    }
+    while (!pending_replies_.empty() && pending_replies_.front().due_ns <= now) {
+      LinkMessage reply;
+      reply.type = "heartbeat";
+      reply.message = pending_replies_.front().message;
+      if (reply.message != "{}") {
+        // t2 as late as possible, right before the write
+        char t2[40];
+        snprintf(t2, sizeof(t2), ",\"t2\":%lld", (long long)robotNow());
+        reply.message.insert(reply.message.size() - 1, t2);
+      }
+      pending_replies_.pop_front();
+      if (!phone->writeLine(encodeLinkMessage(reply))) {
+        return;
+      }
+    }
+
+    int timeout = 50;
+    if (!pending_replies_.empty()) {
+      timeout = std::min<int64_t>(timeout, (pending_replies_.front().due_ns - now) / 1000000 + 1);
+    }
+    LineResult result = phone->readLine(timeout, &line);
+    if (result == LINE_CLOSED) {
+      return;
+    }
+    if (result == LINE_OK) {
+      handleLine(line, getTimeNs());
+      if (config_.read_delay_ms > 0) {
+        usleep(config_.read_delay_ms * 1000);
+      }
+    }
+  }
+}
+
+void StandinServer::handleLine(const std::string &line, int64_t now) {
+  LinkMessage message;
+  if (!parseLinkMessage(line, &message)) {
+    ++other_;
+    return;
+  }
+  if (message.type == "heartbeat") {
+    ++heartbeats_;
+    PendingReply reply;
+    reply.due_ns = now + config_.reply_delay_ms * 1000000LL;
+    double t0;
+    if (jsonNumber(message.message, "t0", &t0)) {
+      // Echo t0 as sent; doubles hold nanosecond stamps exactly for ~100 days
+      char stamps[80];
+      snprintf(stamps, sizeof(stamps), "{\"t0\":%lld,\"t1\":%lld}", (long long)t0,
+               (long long)(now + config_.clock_offset_ns));
+      reply.message = stamps;
+    } else {
+      reply.message = "{}";
+    }
+    pending_replies_.push_back(reply);
+  } else if (message.type == "targets") {
+    if (lose(&tcp_rng_)) {
+      // Waiting for the retransmit blocks everything behind it
+      usleep(config_.retransmit_ms * 1000);
+      now = getTimeNs();
+    }
+    StandinArrival arrival;
+    parseArrival(message.message, now, false, &arrival);
+    std::lock_guard<std::mutex> lock(mutex_);
+    arrivals_.push_back(arrival);
+  } else {
+    ++other_;
+  }
+}
+
+bool StandinServer::parseArrival(const std::string &message, int64_t now,
+                                 bool udp, StandinArrival *arrival) {
+  arrival->arrival_ns = now;
+  arrival->udp = udp;
+  double session, seq;
+  arrival->session = jsonNumber(message, "session", &session) ? int64_t(session) : 0;
+  arrival->seq = jsonNumber(message, "seq", &seq) ? int64_t(seq) : -1;
+  if (!jsonNumber(message, "capturedAgoMs", &arrival->captured_ago_ms)) {
+    arrival->captured_ago_ms = -1;
+  }
+  double robotTime;
+  arrival->captured_at_robot_ns =
+      jsonNumber(message, "capturedAtRobotNs", &robotTime) ? int64_t(robotTime) : 0;
+  return arrival->seq >= 0;
+}
+
+void StandinServer::runUdp() {
+  char datagram[2048];
+  while (running_) {
+    pollfd p = {udp_fd_, POLLIN, 0};
+    if (poll(&p, 1, 100) <= 0) {
+      continue;
+    }
+    ssize_t n = recv(udp_fd_, datagram, sizeof(datagram), 0);
+    if (n <= 0) {
+      continue;
+    }
+    int64_t now = getTimeNs();
+    if (lose(&udp_rng_)) {
+      ++datagrams_lost_;
+      continue;
+    }
+    LinkMessage message;
+    StandinArrival arrival;
+    if (!parseLinkMessage(std::string(datagram, n), &message) ||
+        message.type != "targets" ||
+        !parseArrival(message.message, now, true, &arrival)) {
+      ++other_;
+      continue;
+    }
+    // The robot clock also counts the time the datagram spent in flight
+    int64_t robotTime = robotNow();
+    int64_t captured = arrival.captured_at_robot_ns != 0
+                           ? arrival.captured_at_robot_ns
+                           : robotTime - int64_t(arrival.captured_ago_ms * 1e6);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (sequencer_.accept(arrival.session, arrival.seq, captured, robotTime)) {
+      arrivals_.push_back(arrival);
+    }
+  }
+}
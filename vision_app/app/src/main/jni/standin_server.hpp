@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "robot_protocol.hpp"
+
+// Faults the stand-in robot injects into the link. All times in ms; 0 turns
+// a fault off.
+struct StandinConfig {
+  int reply_delay_ms;       // heartbeat replies leave this long after the request
+  int read_delay_ms;        // pause after every message, so the robot reads slowly
+  int stall_every_ms;       // every stall_every_ms, stop reading for stall_ms
+  int stall_ms;
+  int disconnect_every_ms;  // drop the phone this long after it connects
+  int rcvbuf;               // kernel receive buffer in bytes; 0 keeps the default
+  // Simulated packet loss, in percent of target updates. A lost datagram is
+  // gone; on TCP the retransmit holds up that update and everything behind
+  // it for retransmit_ms, the way head-of-line blocking does.
+  double loss_percent;
+  int retransmit_ms;
+  double max_age_ms;        // datagrams older than this are discarded
+  int64_t clock_offset_ns;  // robot clock = getTimeNs() + this
+};
+
+static const StandinConfig kDefaultStandinConfig = {0, 0, 0, 0, 0, 0, 0, 200, 100, 0};
+
+// A target update as the robot saw it
+struct StandinArrival {
+  int64_t arrival_ns;       // getTimeNs()
+  int64_t session;          // the update's "session" field, 0 if it has none
+  int64_t seq;              // the update's "seq" field, -1 if it has none
+  double captured_ago_ms;
+  int64_t captured_at_robot_ns;  // 0 until the phone's clock is synced
+  bool udp;
+};
+
+// Robot end of the link, on its own thread: accepts one phone at a time,
+// echoes heartbeats the way the robot does and logs target updates. Target
+// datagrams are taken on the next port up (3062 next to 3061, as
+// RobotConnection.K_ROBOT_UDP_PORT) and filtered through an UpdateSequencer.
+// Heartbeats carrying a t0 are answered with robot-clock t1/t2 stamps, see
+// ClockOffsetEstimator.
+class StandinServer {
+ public:
+  StandinServer()
+      : running_(false), port_(-1), listener_(-1), udp_port_(-1), udp_fd_(-1),
+        sequencer_(0) {}
+  ~StandinServer() { stop(); }
+
+  // port 0 picks a free one; see port()
+  bool start(int port, const StandinConfig &config);
+  void stop();
+  int port() const { return port_; }
+  int udpPort() const { return udp_port_; }
+
+  // Moves the arrivals since the last call into arrivals
+  void takeArrivals(std::vector<StandinArrival> *arrivals);
+
+  int connections() const { return connections_; }
+  int heartbeats() const { return heartbeats_; }
+  int otherMessages() const { return other_; }
+  // Datagrams dropped by the loss simulation, and by the sequencer
+  int datagramsLost() const { return datagrams_lost_; }
+  int64_t datagramsOutOfOrder();
+  int64_t datagramsStale();
+  // Sender sessions the sequencer has switched to
+  int64_t datagramSessions();
+
+ private:
+  StandinServer(const StandinServer &) = delete;
+  StandinServer &operator=(const StandinServer &) = delete;
+
+  void run();
+  void serve(LineSocket *phone);
+  void handleLine(const std::string &line, int64_t now);
+  void runUdp();
+  bool parseArrival(const std::string &message, int64_t now, bool udp,
+                    StandinArrival *arrival);
+  bool lose(std::mt19937 *rng);
+  int64_t robotNow() const { return getTimeNs() + config_.clock_offset_ns; }
+
+  StandinConfig config_;
+  std::atomic<bool> running_;
+  int port_;
+  int listener_;
+  std::thread thread_;
+  int udp_port_;
+  int udp_fd_;
+  std::thread udp_thread_;
+  std::mt19937 tcp_rng_;
+  std::mt19937 udp_rng_;
+
+  struct PendingReply {
+    int64_t due_ns;
+    std::string message;  // t1 filled in, t2 added when sent
+  };
+  std::deque<PendingReply> pending_replies_;  // server thread only
+
+  std::mutex mutex_;
+  std::vector<StandinArrival> arrivals_;
+  UpdateSequencer sequencer_;
+  std::atomic<int> connections_{0};
+  std::atomic<int> heartbeats_{0};
+  std::atomic<int> other_{0};
+  std::atomic<int> datagrams_lost_{0};
+};
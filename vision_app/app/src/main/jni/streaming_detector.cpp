@@ -0,0 +1,43 @@
+#include "streaming_detector.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+
+void StreamingDetector::begin(int width, int height, const HsvLut &lut) {
+  lut_ = lut;
+  next_row_ = 0;
+  if (mask_.width != width || mask_.height != height) {
+    mask_.create(width, height);
+  }
+  runs_.clear();
+  blobs_.clear();
+  labeler_.begin();
+}
+
+void StreamingDetector::pushRows(int first, int count, const uint8_t *data,
+                                 size_t stride) {
+  if (first != next_row_ || count <= 0 || first + count > mask_.height) {
+    LOGE("Rows %d..%d pushed out of order (expected %d)", first,
+         first + count, next_row_);
+    return;
+  }
+  cv::Mat rgba(count, mask_.width, CV_8UC4, const_cast<uint8_t *>(data), stride);
+  // RGB2HSV takes 4-channel input directly, skipping the RGBA2RGB pass
+  cv::cvtColor(rgba, hsv_, CV_RGB2HSV);
+  thresholdPackedRows(hsv_, lut_, &mask_, first);
+
+  size_t firstRun = runs_.size();
+  mask_.extractRuns(&runs_, first, first + count);
+  labeler_.addRuns(runs_.data() + firstRun, int(runs_.size() - firstRun));
+  next_row_ = first + count;
+}
+
+bool StreamingDetector::finish() {
+  if (next_row_ != mask_.height) {
+    LOGE("Frame finished after %d of %d rows", next_row_, mask_.height);
+    return false;
+  }
+  labeler_.finish(&blobs_);
+  return true;
+}
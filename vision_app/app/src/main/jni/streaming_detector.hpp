@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "hsv_threshold.hpp"
+#include "packed_mask.hpp"
+#include "run_labeler.hpp"
+
+// Thresholds and labels a frame while it is still arriving. Each pushRows()
+// converts, thresholds and labels the rows it is given right away, so once
+// the last rows are in, finish() only has to collect the blobs. This takes
+// everything but pairing out of the time between the last pixel arriving
+// and the targets being ready.
+//
+// Produces the same mask, runs and blobs as RunLabeler on the whole frame.
+class StreamingDetector {
+ public:
+  void begin(int width, int height, const HsvLut &lut);
+
+  // RGBA rows [first, first + count). Rows must arrive top to bottom without
+  // gaps; stride is the distance between rows in bytes.
+  void pushRows(int first, int count, const uint8_t *data, size_t stride);
+
+  // Returns false (and leaves the results incomplete) if rows are missing
+  bool finish();
+
+  int nextRow() const { return next_row_; }
+  const PackedMask &mask() const { return mask_; }
+  PackedMask &mask() { return mask_; }
+  const std::vector<MaskRun> &runs() const { return runs_; }
+  const std::vector<Blob> &blobs() const { return blobs_; }
+
+ private:
+  HsvLut lut_;
+  int next_row_ = 0;
+  PackedMask mask_;
+  cv::Mat hsv_;
+  std::vector<MaskRun> runs_;
+  RunLabeler labeler_;
+  std::vector<Blob> blobs_;
+};
@@ -0,0 +1,107 @@
+#include "target_drawing.hpp"
+
+#include <string.h>
+
+#include <opencv2/imgproc.hpp>
+
+// Color used to draw each TargetType
+static const cv::Scalar kTargetColors[NUM_TARGET_TYPES] = {
+  cv::Scalar(10, 255, 10),
+  cv::Scalar(255, 190, 0)
+};
+
+// Line widths, shared with OverlayUndo so it saves what gets drawn over
+static const int kPartThickness = 1;
+static const int kTargetThickness = 2;
+static const int kCentroidRadius = 5;
+static const int kCentroidThickness = 3;
+
+void drawCandidates(cv::Mat &vis, const std::vector<TargetInfo> &parts,
+                    const std::vector<TargetInfo> &rejected) {
+  for (auto &target : parts) {
+      cv::rectangle(vis, target.box, cv::Scalar(200, 20, 200), kPartThickness);
+  }
+  for (auto &target : rejected) {
+      cv::rectangle(vis, target.box, cv::Scalar(255, 10, 0), kPartThickness);
+  }
+}
+
+void drawTargets(cv::Mat &vis, const std::vector<TargetInfo> &targets) {
+  for (auto &target : targets) {
+      cv::circle(vis, cv::Point(target.centroid_x, target.centroid_y), kCentroidRadius,
+                 cv::Scalar(0, 190, 255), kCentroidThickness);
+      cv::rectangle(vis, target.box, kTargetColors[target.type], kTargetThickness);
+  }
+}
+
+void OverlayUndo::saveCandidates(const cv::Mat &vis, const std::vector<TargetInfo> &parts,
+                                 const std::vector<TargetInfo> &rejected) {
+  // Thick lines spread half their width either side; one more pixel covers
+  // the rounding
+  for (auto &target : parts) {
+    saveOutline(vis, target.box, kPartThickness + 1);
+  }
+  for (auto &target : rejected) {
+    saveOutline(vis, target.box, kPartThickness + 1);
+  }
+}
+
+void OverlayUndo::saveTargets(const cv::Mat &vis, const std::vector<TargetInfo> &targets) {
+  for (auto &target : targets) {
+    int reach = kCentroidRadius + kCentroidThickness;
+    saveArea(vis, cv::Rect(int(target.centroid_x) - reach, int(target.centroid_y) - reach,
+                           2 * reach + 1, 2 * reach + 1));
+    saveOutline(vis, target.box, kTargetThickness + 1);
+  }
+}
+
+void OverlayUndo::saveOutline(const cv::Mat &vis, const cv::Rect &box, int margin) {
+  cv::Rect outer(box.x - margin, box.y - margin, box.width + 2 * margin,
+                 box.height + 2 * margin);
+  cv::Rect inner(box.x + margin, box.y + margin, box.width - 2 * margin,
+                 box.height - 2 * margin);
+  if (inner.width <= 0 || inner.height <= 0) {
+    saveArea(vis, outer);
+    return;
+  }
+  saveArea(vis, cv::Rect(outer.x, outer.y, outer.width, inner.y - outer.y));
+  saveArea(vis, cv::Rect(outer.x, inner.br().y, outer.width, outer.br().y - inner.br().y));
+  saveArea(vis, cv::Rect(outer.x, inner.y, inner.x - outer.x, inner.height));
+  saveArea(vis, cv::Rect(inner.br().x, inner.y, outer.br().x - inner.br().x, inner.height));
+}
+
+void OverlayUndo::saveArea(const cv::Mat &vis, cv::Rect area) {
+  area &= cv::Rect(0, 0, vis.cols, vis.rows);
+  if (area.area() <= 0) {
+    return;
+  }
+  size_t rowBytes = area.width * vis.elemSize();
+  size_t offset = pixels_.size();
+  pixels_.resize(offset + rowBytes * area.height);
+  for (int y = 0; y < area.height; ++y) {
+    memcpy(&pixels_[offset + y * rowBytes], vis.ptr(area.y + y, area.x), rowBytes);
+  }
+  areas_.push_back(area);
+}
+
+void OverlayUndo::restore(cv::Mat &frame) const {
+  size_t offset = 0;
+  for (const auto &area : areas_) {
+    size_t rowBytes = area.width * frame.elemSize();
+    for (int y = 0; y < area.height; ++y) {
+      memcpy(frame.ptr(area.y + y, area.x), &pixels_[offset], rowBytes);
+      offset += rowBytes;
+    }
+  }
+}
+
+void OverlayUndo::clear() {
+  // Keeps the capacity, so steady state doesn't allocate
+  areas_.clear();
+  pixels_.clear();
+}
+
+void OverlayUndo::swap(OverlayUndo &other) {
+  areas_.swap(other.areas_);
+  pixels_.swap(other.pixels_);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "targets.hpp"
+
+// Overlays for the visualization. Both draw into vis in place.
+
+// Outlines of the candidate strips and of the blobs the filters rejected
+void drawCandidates(cv::Mat &vis, const std::vector<TargetInfo> &parts,
+                    const std::vector<TargetInfo> &rejected);
+
+// Matched targets, in the color of their TargetType
+void drawTargets(cv::Mat &vis, const std::vector<TargetInfo> &targets);
+
+// The pixels the overlays above are about to cover, saved so the frame can
+// be drawn on in place and still be put back clean later. Only the outlines
+// are saved, a few KB where copying the frame would be a MB or more.
+class OverlayUndo {
+ public:
+  // Call before the matching draw function, on the same image
+  void saveCandidates(const cv::Mat &vis, const std::vector<TargetInfo> &parts,
+                      const std::vector<TargetInfo> &rejected);
+  void saveTargets(const cv::Mat &vis, const std::vector<TargetInfo> &targets);
+
+  // Writes the saved pixels back into frame, which must have the size and
+  // type of the image they were saved from
+  void restore(cv::Mat &frame) const;
+
+  void clear();
+  void swap(OverlayUndo &other);
+  bool empty() const { return areas_.empty(); }
+
+ private:
+  // Saves the band of width margin on either side of box's outline
+  void saveOutline(const cv::Mat &vis, const cv::Rect &box, int margin);
+  void saveArea(const cv::Mat &vis, cv::Rect area);
+
+  std::vector<cv::Rect> areas_;
+  std::vector<uint8_t> pixels_;  // rows of every area, back to back
+};
@@ -0,0 +1,220 @@
+#include "target_matcher.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "common.hpp"
+
+bool PegMatcher::shapeOk(const TargetInfo &target) const {
+  double actualVertOverHorizontal = target.height/target.width;
+  return actualVertOverHorizontal > params_.min_aspect && actualVertOverHorizontal < params_.max_aspect;
+}
+
+void PegMatcher::match(const std::vector<TargetInfo> &candidates,
+                       std::vector<TargetInfo> *targets) {
+  target_parts_.clear();
+
+  // Filter based on expected proportions
+  for (const auto &target : candidates) {
+    if (shapeOk(target)) {
+      target_parts_.push_back(target);
+    }
+  }
+
+  // Look for pairs that are aligned vertically, and may represent two halves of a target, separated by the lift.
+  int target_parts_len;
+  double min_altitude, max_altitude;
+  double max_width, max_height;
+  double proportions;
+
+  target_parts_len = target_parts_.size();
+  for(int i=0; i<target_parts_len; ++i)
+    for(int j=i+1; j<target_parts_len; ++j)
+    {
+
+        const auto &target1 = target_parts_[i];
+        const auto &target2 = target_parts_[j];
+
+        max_width = std::max(target1.width, target2.width);
+        if ((std::abs(target1.width-target2.width)/max_width) < params_.split_width_error)//If widths within 15%
+        {
+          if ((std::abs(target1.centroid_x-target2.centroid_x)/std::max(target1.centroid_x, target2.centroid_x)) < params_.split_x_error)//If horizontally aligned within 15%
+          {
+            min_altitude = std::min(target1.box.tl().y, target2.box.tl().y);
+            max_altitude = std::max(target1.box.br().y, target2.box.br().y);
+            max_height = max_altitude-min_altitude;
+            proportions = max_height/max_width;
+            if ((proportions<params_.max_split_aspect)&&(proportions>params_.min_split_aspect))//If [max_height - min_height]/width in range [2.0,6.0]
+            {
+              TargetInfo newTargetPair;
+              newTargetPair.isGeneratedPair = true;
+              newTargetPair.box = cv::Rect(std::min(target1.box.tl().x,target2.box.tl().x),min_altitude,max_width,max_height);
+              newTargetPair.box.width = max_width;
+              newTargetPair.box.height= max_height;
+              newTargetPair.centroid_x = (newTargetPair.box.tl().x + newTargetPair.box.br().x)/2.0;
+              newTargetPair.centroid_y = (newTargetPair.box.tl().y + newTargetPair.box.br().y)/2.0;
+              // push_back may reallocate, so target1/target2 must not be used after this
+              target_parts_.push_back(std::move(newTargetPair));//Add new target part to target_parts (appending to end is ok, since target_parts.size is saved, not calculated)
+            }
+          }
+        }
+    }
+
+  target_parts_len = target_parts_.size(); //Recalculate, since we have possibly added some partial pairs
+  double altitude_err_top, altitude_err_bottom;
+  double width;
+  for(int i=0; i<target_parts_len; ++i)
+    for(int j=i+1; j<target_parts_len; ++j)
+    {
+      const auto &target1 = target_parts_[i];
+      const auto &target2 = target_parts_[j];
+      if ((target1.box & target2.box).area() == 0)//If boxes do not overlap (Look for area of the intersection of the rects)
+      {
+        altitude_err_top = double(std::abs(target1.box.tl().y - target2.box.tl().y)) / double(std::max(target1.height, target2.height));
+        altitude_err_bottom = double(std::abs(target1.box.br().y - target2.box.br().y)) / double(std::max(target1.height, target2.height));
+        LOGD("Altitude Err: %.2lf, %.2lf", altitude_err_top, altitude_err_bottom);
+        if (altitude_err_top < params_.altitude_error && altitude_err_bottom < params_.altitude_error)// If bottom and top of boxes align within 12.5%
+        {
+          max_height = std::max(target1.box.br().y, target2.box.br().y) - std::min(target1.box.tl().y, target2.box.tl().y);//max_height = max(target1.top, target2.top) - min(target1.bottom, target2.bottom);
+          width = std::abs(target1.centroid_x - target2.centroid_x);
+          LOGD("max_height: %.2lf, width: %.2lf", max_height, width);
+          if ((params_.min_spacing*max_height)<width && width < (params_.max_spacing*max_height) ) //if (width in range(.5*max_height, 1.75*max_height)
+          {
+            TargetInfo full_target;//Generate combined target
+            full_target.type = TARGET_PEG;
+            full_target.box = target1.box | target2.box; //Rectangle that encloses both smaller rects
+            full_target.height = full_target.box.height;
+            full_target.width = full_target.box.width;
+            full_target.centroid_x = full_target.box.x + (full_target.box.width/2);
+            full_target.centroid_y = full_target.box.y + (full_target.box.height/2);
+            if (target1.box.x < target2.box.x) //Is target1 on the left?
+            {
+                full_target.leftToRightRatio = target1.box.area() * 1.0 / target2.box.area();
+            }
+            else
+            {
+                full_target.leftToRightRatio = target2.box.area() * 1.0 / target1.box.area();
+            }
+            LOGE("Found target at %.2lf, %.2lf...size %.2lf, %.2lf... ratio %.2lf",
+            full_target.centroid_x, full_target.centroid_y, full_target.width, full_target.height, full_target.leftToRightRatio);//*/
+            targets->push_back(std::move(full_target));// We found a target
+          }
+        }
+      }
+    }
+}
+
+void PegMatcher::appendGeneratedParts(std::vector<TargetInfo> *parts) const {
+  for (const auto &part : target_parts_) {
+    if (part.isGeneratedPair) {
+      parts->push_back(part);
+    }
+  }
+}
+
+// The strips wrap around the boiler, so they are much wider than tall
+bool BoilerMatcher::shapeOk(const TargetInfo &target) const {
+  double actualVertOverHorizontal = target.height/target.width;
+  return actualVertOverHorizontal > params_.min_aspect && actualVertOverHorizontal < params_.max_aspect;
+}
+
+void BoilerMatcher::match(const std::vector<TargetInfo> &candidates,
+                          std::vector<TargetInfo> *targets) {
+  strips_.clear();
+  for (const auto &target : candidates) {
+    if (shapeOk(target)) {
+      strips_.push_back(&target);
+    }
+  }
+
+  // The upper strip is 4" tall, the lower one 2" tall, with a 2" gap between
+  // them, so the centers are 5" (1.25 upper heights) apart.
+
+  int strips_len = strips_.size();
+  for (int i = 0; i < strips_len; ++i)
+    for (int j = 0; j < strips_len; ++j)
+    {
+      if (i == j) {
+        continue;
+      }
+      const TargetInfo &upper = *strips_[i];
+      const TargetInfo &lower = *strips_[j];
+      if (upper.centroid_y >= lower.centroid_y) {
+        continue;
+      }
+
+      double max_width = std::max(upper.width, lower.width);
+      if (std::abs(upper.width - lower.width)/max_width >= params_.width_error) {
+        continue;
+      }
+      if (std::abs(upper.centroid_x - lower.centroid_x)/max_width >= params_.x_error) {
+        continue;
+      }
+      double spacing = (lower.centroid_y - upper.centroid_y)/upper.height;
+      if (spacing <= params_.min_spacing || spacing >= params_.max_spacing) {
+        continue;
+      }
+      double heightRatio = upper.height/lower.height;
+      if (heightRatio <= params_.min_height_ratio || heightRatio >= params_.max_height_ratio) {
+        continue;
+      }
+
+      TargetInfo full_target;
+      full_target.type = TARGET_BOILER;
+      full_target.box = upper.box | lower.box;
+      full_target.height = full_target.box.height;
+      full_target.width = full_target.box.width;
+      full_target.centroid_x = full_target.box.x + (full_target.box.width/2);
+      full_target.centroid_y = full_target.box.y + (full_target.box.height/2);
+      LOGD("Found boiler at %.2lf, %.2lf...size %.2lf, %.2lf",
+           full_target.centroid_x, full_target.centroid_y, full_target.width, full_target.height);
+      targets->push_back(std::move(full_target));
+    }
+}
+
+MatcherSet::MatcherSet() : peg_(new PegMatcher()), boiler_(new BoilerMatcher()) {
+  // Indexed by TargetType
+  matchers_.emplace_back(peg_);
+  matchers_.emplace_back(boiler_);
+}
+
+void MatcherSet::setParams(const PegParams &peg, const BoilerParams &boiler) {
+  peg_->setParams(peg);
+  boiler_->setParams(boiler);
+}
+
+void MatcherSet::filterShapes(int enabledMask, std::vector<TargetInfo> *candidates,
+                              std::vector<TargetInfo> *rejected) const {
+  size_t kept = 0;
+  for (size_t i = 0; i < candidates->size(); ++i) {
+    TargetInfo &target = (*candidates)[i];
+    bool wanted = false;
+    for (const auto &matcher : matchers_) {
+      wanted = wanted || ((enabledMask & (1 << matcher->type())) && matcher->shapeOk(target));
+    }
+    if (!wanted) {
+      LOGD("Rejecting target due to shape: proportions = %.2lf", target.height/target.width);
+      rejected->push_back(std::move(target));
+    } else if (kept++ != i) {
+      (*candidates)[kept - 1] = std::move(target);
+    }
+  }
+  candidates->resize(kept);
+}
+
+void MatcherSet::appendGeneratedParts(int enabledMask, std::vector<TargetInfo> *parts) const {
+  for (const auto &matcher : matchers_) {
+    if (enabledMask & (1 << matcher->type())) {
+      matcher->appendGeneratedParts(parts);
+    }
+  }
+}
+
+void MatcherSet::match(int enabledMask, const std::vector<TargetInfo> &candidates,
+                       std::vector<TargetInfo> *targets) {
+  for (auto &matcher : matchers_) {
+    if (enabledMask & (1 << matcher->type())) {
+      matcher->match(candidates, targets);
+    }
+  }
+}
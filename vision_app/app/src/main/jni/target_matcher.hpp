@@ -0,0 +1,117 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "targets.hpp"
+
+// A matcher looks at the candidate strips found once per frame and pairs them
+// up into one kind of field target. Every enabled matcher sees the same
+// candidate array, so adding a matcher only costs its own pairing logic; the
+// pixel work is not repeated.
+class TargetMatcher {
+ public:
+  virtual ~TargetMatcher() { }
+
+  virtual TargetType type() const = 0;
+  virtual const char* name() const = 0;
+
+  // Whether a candidate has a shape this matcher could use. Candidates no
+  // enabled matcher wants are shown as rejected.
+  virtual bool shapeOk(const TargetInfo &candidate) const = 0;
+
+  // Appends any targets found among candidates to targets.
+  virtual void match(const std::vector<TargetInfo> &candidates,
+                     std::vector<TargetInfo> *targets) = 0;
+
+  // Appends the intermediate parts the last match() built from several
+  // candidates (isGeneratedPair), for display
+  virtual void appendGeneratedParts(std::vector<TargetInfo> * /*parts*/) const { }
+};
+
+// Peg matcher tolerances. Aspects are height / width; errors are fractions.
+struct PegParams {
+  double min_aspect, max_aspect;  // one strip (0.3 allows a split strip)
+  double split_width_error;       // halves of a split strip: widths
+  double split_x_error;           // and horizontal centers
+  double min_split_aspect, max_split_aspect;  // the rejoined strip
+  double altitude_error;          // top and bottom of the two strips
+  double min_spacing, max_spacing;  // center distance / height
+};
+
+static const PegParams kDefaultPegParams = {0.3, 6.0, 0.075, 0.04, 2.0, 6.0,
+                                            0.25, 0.5, 2.25};
+
+// Boiler matcher tolerances, in the same terms
+struct BoilerParams {
+  double min_aspect, max_aspect;
+  double width_error;               // of the two strips
+  double x_error;                   // center offset / width
+  double min_spacing, max_spacing;  // center distance / upper height
+  double min_height_ratio, max_height_ratio;  // upper / lower
+};
+
+static const BoilerParams kDefaultBoilerParams = {0.05, 1.0, 0.2, 0.1, 0.8, 2.0,
+                                                  1.2, 3.5};
+
+// 2017 gear peg: two vertical strips side by side, either of which may be
+// split in half by the peg itself.
+class PegMatcher : public TargetMatcher {
+ public:
+  TargetType type() const override { return TARGET_PEG; }
+  const char* name() const override { return "peg"; }
+  bool shapeOk(const TargetInfo &candidate) const override;
+  void match(const std::vector<TargetInfo> &candidates,
+             std::vector<TargetInfo> *targets) override;
+  void appendGeneratedParts(std::vector<TargetInfo> *parts) const override;
+
+  void setParams(const PegParams &params) { params_ = params; }
+
+ private:
+  PegParams params_ = kDefaultPegParams;
+  // Scratch space, kept between frames to avoid reallocating
+  std::vector<TargetInfo> target_parts_;
+};
+
+// 2017 boiler: two horizontal strips stacked on top of each other, the upper
+// one twice as tall as the lower one.
+class BoilerMatcher : public TargetMatcher {
+ public:
+  TargetType type() const override { return TARGET_BOILER; }
+  const char* name() const override { return "boiler"; }
+  bool shapeOk(const TargetInfo &candidate) const override;
+  void match(const std::vector<TargetInfo> &candidates,
+             std::vector<TargetInfo> *targets) override;
+
+  void setParams(const BoilerParams &params) { params_ = params; }
+
+ private:
+  BoilerParams params_ = kDefaultBoilerParams;
+  std::vector<const TargetInfo*> strips_;
+};
+
+// Mask with one bit per TargetType
+static const int kAllMatchers = (1 << NUM_TARGET_TYPES) - 1;
+static const int kDefaultMatchers = 1 << TARGET_PEG;
+
+// Holds one instance of every matcher and runs the ones enabled in the mask.
+class MatcherSet {
+ public:
+  MatcherSet();
+
+  // Moves candidates that no enabled matcher has a use for to rejected,
+  // keeping the order of the rest
+  void filterShapes(int enabledMask, std::vector<TargetInfo> *candidates,
+                    std::vector<TargetInfo> *rejected) const;
+  void match(int enabledMask, const std::vector<TargetInfo> &candidates,
+             std::vector<TargetInfo> *targets);
+  // The enabled matchers' generated parts from the last match()
+  void appendGeneratedParts(int enabledMask, std::vector<TargetInfo> *parts) const;
+
+  void setParams(const PegParams &peg, const BoilerParams &boiler);
+
+ private:
+  std::vector<std::unique_ptr<TargetMatcher>> matchers_;
+  PegMatcher *peg_;
+  BoilerMatcher *boiler_;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Kinds of field target a matcher can emit. Values are shared with
+// NativePart.java and double as bit positions in the enabled-matcher mask.
+enum TargetType {
+  TARGET_PEG = 0,
+  TARGET_BOILER = 1,
+  NUM_TARGET_TYPES
+};
+
+struct TargetInfo {
+  TargetInfo(): leftToRightRatio(0), isGeneratedPair(false), type(TARGET_PEG) { }
+  double centroid_x;
+  double centroid_y;
+  double width;
+  double height;
+  double leftToRightRatio;
+  bool isGeneratedPair;
+  TargetType type;
+  cv::Rect box;
+  std::vector<cv::Point> contour;
+};
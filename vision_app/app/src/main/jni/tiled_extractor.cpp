@@ -0,0 +1,163 @@
+#include "tiled_extractor.hpp"
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+// 16 rows of 640 RGBA pixels is 40 KB in and 30 KB of HSV out
+static const int kStripRows = 16;
+
+class TiledExtractor::BandWorker : public cv::ParallelLoopBody {
+ public:
+  BandWorker(const cv::Mat &rgba, const HsvLut &lut, bool label,
+             PackedMask *mask, std::vector<Band> *bands)
+      : rgba_(rgba), lut_(lut), label_(label), mask_(mask), bands_(bands) {
+  }
+
+  void operator()(const cv::Range &range) const override {
+    for (int i = range.start; i < range.end; ++i) {
+      processBand(rgba_, lut_, label_, mask_, &(*bands_)[i]);
+    }
+  }
+
+ private:
+  const cv::Mat &rgba_;
+  const HsvLut &lut_;
+  bool label_;
+  PackedMask *mask_;
+  std::vector<Band> *bands_;
+};
+
+void TiledExtractor::setupBands(int rows) {
+  int strips = (rows + kStripRows - 1) / kStripRows;
+  int count = std::max(1, std::min(cv::getNumThreads(), strips));
+  bands_.resize(count);
+  // Whole strips per band, spread as evenly as possible
+  for (int i = 0; i < count; ++i) {
+    bands_[i].first_row = std::min(rows, strips * i / count * kStripRows);
+    bands_[i].end_row = std::min(rows, strips * (i + 1) / count * kStripRows);
+  }
+}
+
+void TiledExtractor::processBand(const cv::Mat &rgba, const HsvLut &lut,
+                                 bool label, PackedMask *mask, Band *band) {
+  band->runs.clear();
+  for (int row = band->first_row; row < band->end_row; row += kStripRows) {
+    int end = std::min(row + kStripRows, band->end_row);
+    // RGB2HSV takes 4-channel input directly, skipping the RGBA2RGB pass
+    cv::cvtColor(rgba.rowRange(row, end), band->hsv, CV_RGB2HSV);
+    thresholdPackedRows(band->hsv, lut, mask, row);
+    if (label) {
+      mask->extractRuns(&band->runs, row, end);
+    }
+  }
+  if (label) {
+    band->labeler.label(band->runs, &band->blobs);
+  }
+}
+
+void TiledExtractor::threshold(const cv::Mat &rgba, const HsvLut &lut,
+                               PackedMask *mask) {
+  CV_Assert(rgba.type() == CV_8UC4);
+  if (mask->width != rgba.cols || mask->height != rgba.rows) {
+    mask->create(rgba.cols, rgba.rows);
+  }
+  setupBands(rgba.rows);
+  cv::parallel_for_(cv::Range(0, int(bands_.size())),
+                    BandWorker(rgba, lut, false, mask, &bands_));
+}
+
+void TiledExtractor::run(const cv::Mat &rgba, const HsvLut &lut,
+                         PackedMask *mask, std::vector<MaskRun> *runs,
+                         std::vector<Blob> *blobs) {
+  CV_Assert(rgba.type() == CV_8UC4);
+  if (mask->width != rgba.cols || mask->height != rgba.rows) {
+    mask->create(rgba.cols, rgba.rows);
+  }
+  setupBands(rgba.rows);
+  cv::parallel_for_(cv::Range(0, int(bands_.size())),
+                    BandWorker(rgba, lut, true, mask, &bands_));
+
+  if (runs != nullptr) {
+    runs->clear();
+    for (auto &band : bands_) {
+      runs->insert(runs->end(), band.runs.begin(), band.runs.end());
+    }
+  }
+  joinSeams(blobs);
+}
+
+int TiledExtractor::find(int blob) {
+  while (parent_[blob] != blob) {
+    parent_[blob] = parent_[parent_[blob]];
+    blob = parent_[blob];
+  }
+  return blob;
+}
+
+void TiledExtractor::joinSeams(std::vector<Blob> *blobs) {
+  // Blobs are numbered band by band, so every band's blobs stay in raster
+  // order and the earliest blob of a joined group is its root
+  std::vector<int> offsets(bands_.size());
+  int total = 0;
+  for (size_t b = 0; b < bands_.size(); ++b) {
+    offsets[b] = total;
+    total += int(bands_[b].blobs.size());
+  }
+  parent_.resize(total);
+  for (int i = 0; i < total; ++i) {
+    parent_[i] = i;
+  }
+
+  for (size_t b = 1; b < bands_.size(); ++b) {
+    const Band &above = bands_[b - 1];
+    const Band &below = bands_[b];
+    int seam = below.first_row;
+    // Runs on the last row of the band above and the first row of this one
+    int i = int(above.runs.size());
+    while (i > 0 && above.runs[i - 1].y == seam - 1) {
+      --i;
+    }
+    int aboveEnd = int(above.runs.size());
+    int belowEnd = 0;
+    while (belowEnd < int(below.runs.size()) && below.runs[belowEnd].y == seam) {
+      ++belowEnd;
+    }
+
+    // Same 8-connected overlap test as RunLabeler
+    int j = i;
+    for (int k = 0; k < belowEnd; ++k) {
+      int start = below.runs[k].x;
+      int end = start + below.runs[k].length;
+      while (j < aboveEnd && above.runs[j].x + above.runs[j].length < start) {
+        ++j;
+      }
+      for (int m = j; m < aboveEnd && above.runs[m].x <= end; ++m) {
+        int a = find(offsets[b - 1] + above.labeler.runBlobs()[m]);
+        int c = find(offsets[b] + below.labeler.runBlobs()[k]);
+        if (a < c) {
+          parent_[c] = a;
+        } else if (c < a) {
+          parent_[a] = c;
+        }
+      }
+    }
+  }
+
+  blobs->clear();
+  out_index_.assign(total, -1);
+  for (size_t b = 0; b < bands_.size(); ++b) {
+    for (size_t i = 0; i < bands_[b].blobs.size(); ++i) {
+      const Blob &blob = bands_[b].blobs[i];
+      int root = find(offsets[b] + int(i));
+      if (out_index_[root] < 0) {
+        out_index_[root] = int(blobs->size());
+        blobs->push_back(blob);
+      } else {
+        Blob &merged = (*blobs)[out_index_[root]];
+        merged.box |= blob.box;
+        merged.pixels += blob.pixels;
+      }
+    }
+  }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "hsv_threshold.hpp"
+#include "packed_mask.hpp"
+#include "run_labeler.hpp"
+
+// Runs color conversion, thresholding, run extraction and labeling in one
+// pass over the frame instead of one full-frame pass per stage.
+//
+// The frame is split into horizontal bands, one per worker thread, and each
+// band is walked in strips of kStripRows rows: the RGBA strip is converted to
+// HSV in a strip-sized buffer, thresholded into its rows of the packed mask
+// and turned into runs while all of it is still in cache. Each band labels
+// its own runs; components that cross a band seam are then joined by
+// comparing the runs on either side of it.
+//
+// Produces the same blobs, in the same order, as RunLabeler on the whole
+// frame.
+class TiledExtractor {
+ public:
+  // rgba must be CV_8UC4. runs, if not null, receives every run of the mask
+  // in raster order.
+  void run(const cv::Mat &rgba, const HsvLut &lut, PackedMask *mask,
+           std::vector<MaskRun> *runs, std::vector<Blob> *blobs);
+
+  // Only the fused color conversion and threshold, for when a later stage
+  // (morphology) needs the whole mask before runs can be extracted
+  void threshold(const cv::Mat &rgba, const HsvLut &lut, PackedMask *mask);
+
+ private:
+  struct Band {
+    int first_row;
+    int end_row;
+    cv::Mat hsv;  // one strip
+    std::vector<MaskRun> runs;
+    RunLabeler labeler;
+    std::vector<Blob> blobs;
+  };
+  class BandWorker;
+
+  void setupBands(int rows);
+  static void processBand(const cv::Mat &rgba, const HsvLut &lut, bool label,
+                          PackedMask *mask, Band *band);
+  void joinSeams(std::vector<Blob> *blobs);
+  int find(int blob);
+
+  std::vector<Band> bands_;
+  std::vector<int> parent_;
+  std::vector<int> out_index_;
+};
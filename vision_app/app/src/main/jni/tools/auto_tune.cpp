@@ -0,0 +1,540 @@
+// Searches the detection parameters for the values that find the labeled
+// targets of a replay corpus best, and writes them as a config file the app
+// loads (files/pipeline.cfg, see pipeline_config.hpp).
+//
+//   auto_tune <file.vrpl | dir> ... [--out FILE] [--config FILE]
+//             [--tune GROUPS] [--samples N] [--passes N] [--hsv-step N]
+//             [--beta B] [--matchers MASK] [--blobs contours|runs]
+//             [--stride N] [--threads N] [--seed S]
+//
+// The labels are each frame's expected targets: the true targets for
+// scene_gen output, or whatever was stored when the file was made. A target
+// counts as found when a detection of the same type has its centroid within
+// half the expected width; anything else detected is a false positive. The
+// score is the F-measure over the whole corpus (--beta 2 weights recall
+// more, 0.5 precision).
+//
+// The search starts from the defaults with the first frame's recorded
+// thresholds, or from --config, and tunes the --tune groups (hsv, candidate,
+// peg, boiler or single parameter names; hsv,candidate,peg by default).
+// --samples random perturbations of the best config so far come first, then
+// coordinate descent: every parameter is moved by one and two steps, the
+// best move is kept, and the step halves when no move helps. Thresholds move
+// in --hsv-step units, the rest by a tenth of their starting value.
+//
+// Every frame is converted to HSV once and kept in memory (--stride N keeps
+// every Nth frame of large corpora), and the threshold masks are cached per
+// frame by thresholds, so moves that only change the blob filters or target
+// geometry skip thresholding. Frames are split across --threads workers (all
+// cores by default), each with its own pipeline and caches. Candidates go
+// through VisionPipeline::processMask() with the app's findContours path, so
+// the scores are what the phone would get.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include "../common.hpp"
+#include "../pipeline_config.hpp"
+#include "../replay_format.hpp"
+#include "../vision_pipeline.hpp"
+#include "replay_corpus.hpp"
+
+// Masks kept per frame; a search revisits few threshold sets at a time
+static const size_t kMaxCachedMasks = 32;
+
+// Detection counts over a set of frames
+struct TuneScore {
+  int64_t found = 0;
+  int64_t false_positives = 0;
+  int64_t missed = 0;
+
+  void add(const TuneScore &other) {
+    found += other.found;
+    false_positives += other.false_positives;
+    missed += other.missed;
+  }
+  double precision() const {
+    return found + false_positives > 0 ? double(found) / (found + false_positives) : 1;
+  }
+  double recall() const {
+    return found + missed > 0 ? double(found) / (found + missed) : 1;
+  }
+  double fMeasure(double beta) const {
+    double p = precision(), r = recall(), b2 = beta * beta;
+    return p + r > 0 ? (1 + b2) * p * r / (b2 * p + r) : 0;
+  }
+};
+
+struct TuneFrame {
+  std::string file;
+  cv::Mat hsv;
+  std::vector<ReplayTarget> expected;
+  std::map<uint64_t, RleMask> masks;  // by thresholdKey()
+};
+
+static uint64_t thresholdKey(const HsvThresholds &t) {
+  int values[6] = {t.h_min, t.h_max, t.s_min, t.s_max, t.v_min, t.v_max};
+  uint64_t key = 0;
+  for (int v : values) {
+    // Anything outside 0-255 thresholds the same as the clamped value
+    key = key << 9 | uint64_t(std::min(std::max(v, -1), 256) + 1);
+  }
+  return key;
+}
+
+// Matches detections to the expected targets of one frame
+static void scoreFrame(const std::vector<TargetInfo> &targets,
+                       const std::vector<ReplayTarget> &expected, TuneScore *score) {
+  std::vector<bool> used(targets.size(), false);
+  for (const auto &want : expected) {
+    int best = -1;
+    double bestError = want.width / 2;
+    for (size_t i = 0; i < targets.size(); ++i) {
+      double error = hypot(targets[i].centroid_x - want.centroid_x,
+                           targets[i].centroid_y - want.centroid_y);
+      if (!used[i] && targets[i].type == want.type && error < bestError) {
+        best = int(i);
+        bestError = error;
+      }
+    }
+    if (best >= 0) {
+      used[best] = true;
+      ++score->found;
+    } else {
+      ++score->missed;
+    }
+  }
+  score->false_positives += std::count(used.begin(), used.end(), false);
+}
+
+// Evaluates configs on its share of the corpus. Each worker runs on its own
+// thread with its own pipeline, so nothing is shared while evaluating.
+class TuneWorker {
+ public:
+  TuneWorker(int matchers, BlobExtraction blobs) {
+    pipeline_.setEnabledMatchers(matchers);
+    pipeline_.setBlobExtraction(blobs);
+    pipeline_.setDisplayMode(DISP_MODE_RAW);
+  }
+
+  std::vector<TuneFrame> &frames() { return frames_; }
+  int64_t maskHits() const { return mask_hits_; }
+  int64_t maskMisses() const { return mask_misses_; }
+
+  // scores[i] is configs[i] over this worker's frames; per_file adds the
+  // same counts by file name
+  void evaluate(const std::vector<PipelineConfig> &configs, std::vector<TuneScore> *scores,
+                std::map<std::string, TuneScore> *per_file = nullptr) {
+    scores->assign(configs.size(), TuneScore());
+    for (size_t c = 0; c < configs.size(); ++c) {
+      pipeline_.setConfig(configs[c]);
+      for (auto &frame : frames_) {
+        TuneScore score;
+        scoreFrame(pipeline_.processMask(mask(&frame, configs[c].thresholds)),
+                   frame.expected, &score);
+        (*scores)[c].add(score);
+        if (per_file != nullptr) {
+          (*per_file)[frame.file].add(score);
+        }
+      }
+    }
+  }
+
+ private:
+  const RleMask &mask(TuneFrame *frame, const HsvThresholds &thresholds) {
+    uint64_t key = thresholdKey(thresholds);
+    auto it = frame->masks.find(key);
+    if (it != frame->masks.end()) {
+      ++mask_hits_;
+      return it->second;
+    }
+    ++mask_misses_;
+    if (frame->masks.size() >= kMaxCachedMasks) {
+      frame->masks.clear();
+    }
+    lut_.build(thresholds);
+    thresholdPacked(frame->hsv, lut_, &packed_);
+    RleMask &mask = frame->masks[key];
+    mask.width = frame->hsv.cols;
+    mask.height = frame->hsv.rows;
+    packed_.extractRuns(&mask.runs);
+    return mask;
+  }
+
+  VisionPipeline pipeline_;
+  std::vector<TuneFrame> frames_;
+  HsvLut lut_;
+  PackedMask packed_;
+  int64_t mask_hits_ = 0;
+  int64_t mask_misses_ = 0;
+};
+
+// Scores configs over the whole corpus, one thread per worker
+static std::vector<TuneScore> evaluateAll(std::vector<std::unique_ptr<TuneWorker>> &workers,
+                                          const std::vector<PipelineConfig> &configs) {
+  std::vector<std::vector<TuneScore>> partial(workers.size());
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < workers.size(); ++w) {
+    threads.emplace_back([&, w] { workers[w]->evaluate(configs, &partial[w]); });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::vector<TuneScore> scores(configs.size());
+  for (const auto &part : partial) {
+    for (size_t c = 0; c < configs.size(); ++c) {
+      scores[c].add(part[c]);
+    }
+  }
+  return scores;
+}
+
+// A parameter being tuned: its index in pipelineConfigFields() and how far
+// one step moves it
+struct Tunable {
+  size_t field;
+  bool integer;
+  double step;
+  double lo, hi;
+};
+
+static double getValue(PipelineConfig *config, const Tunable &t) {
+  PipelineConfigField field = pipelineConfigFields(config)[t.field];
+  return field.int_value != nullptr ? *field.int_value : *field.double_value;
+}
+
+// Sets the parameter, clamped to its range. Doubles are rounded to 3
+// decimals so the output stays readable. Returns false if nothing changed.
+static bool setValue(PipelineConfig *config, const Tunable &t, double value) {
+  PipelineConfigField field = pipelineConfigFields(config)[t.field];
+  value = std::min(std::max(value, t.lo), t.hi);
+  if (field.int_value != nullptr) {
+    int rounded = int(lround(value));
+    bool changed = rounded != *field.int_value;
+    *field.int_value = rounded;
+    return changed;
+  }
+  value = round(value * 1000) / 1000;
+  bool changed = value != *field.double_value;
+  *field.double_value = value;
+  return changed;
+}
+
+static bool inGroup(const std::string &name, const std::string &group) {
+  if (group == "hsv") {
+    return name.size() == 5 && strchr("hsv", name[0]) != nullptr && name[1] == '_';
+  }
+  if (group == "candidate" || group == "peg" || group == "boiler") {
+    return name.compare(0, group.size() + 1, group + ".") == 0;
+  }
+  return name == group;
+}
+
+static bool selectTunables(const std::string &groups, int hsvStep, PipelineConfig *start,
+                           std::vector<Tunable> *tunables) {
+  std::vector<PipelineConfigField> fields = pipelineConfigFields(start);
+  size_t begin = 0;
+  while (begin <= groups.size()) {
+    size_t end = groups.find(',', begin);
+    if (end == std::string::npos) {
+      end = groups.size();
+    }
+    std::string group = groups.substr(begin, end - begin);
+    bool any = false;
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (!inGroup(fields[i].name, group)) {
+        continue;
+      }
+      any = true;
+      bool known = false;
+      for (const auto &t : *tunables) {
+        known = known || t.field == i;
+      }
+      if (known) {
+        continue;
+      }
+      Tunable t;
+      t.field = i;
+      t.integer = fields[i].int_value != nullptr;
+      if (t.integer) {
+        t.step = hsvStep;
+        t.lo = 0;
+        t.hi = 255;
+      } else {
+        t.step = std::max(std::fabs(*fields[i].double_value) / 10, 0.01);
+        t.lo = 0;
+        t.hi = 1e6;
+      }
+      tunables->push_back(t);
+    }
+    if (!any) {
+      fprintf(stderr, "Nothing to tune matches \"%s\"\n", group.c_str());
+      return false;
+    }
+    begin = end + 1;
+  }
+  return true;
+}
+
+static void printScore(const char *label, const TuneScore &s, double beta) {
+  printf("%s: F %.4f  precision %.4f  recall %.4f  (found %lld, false %lld, missed %lld)\n",
+         label, s.fMeasure(beta), s.precision(), s.recall(), (long long)s.found,
+         (long long)s.false_positives, (long long)s.missed);
+}
+
+static int usage() {
+  fprintf(stderr,
+          "usage: auto_tune <file.vrpl | dir> ... [--out FILE] [--config FILE] "
+          "[--tune GROUPS] [--samples N] [--passes N] [--hsv-step N] [--beta B] "
+          "[--matchers MASK] [--blobs contours|runs] [--stride N] [--threads N] "
+          "[--seed S]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> inputs;
+  std::string outPath, configPath, groups = "hsv,candidate,peg";
+  int samples = 256, passes = 40, hsvStep = 4, stride = 1, matchers = kDefaultMatchers;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  double beta = 1;
+  uint64_t seed = 3061;
+  BlobExtraction blobs = BLOB_CONTOURS;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--out" && hasValue) {
+      outPath = argv[++i];
+    } else if (arg == "--config" && hasValue) {
+      configPath = argv[++i];
+    } else if (arg == "--tune" && hasValue) {
+      groups = argv[++i];
+    } else if (arg == "--samples" && hasValue) {
+      samples = std::max(0, atoi(argv[++i]));
+    } else if (arg == "--passes" && hasValue) {
+      passes = std::max(0, atoi(argv[++i]));
+    } else if (arg == "--hsv-step" && hasValue) {
+      hsvStep = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--beta" && hasValue) {
+      beta = atof(argv[++i]);
+    } else if (arg == "--matchers" && hasValue) {
+      matchers = strtol(argv[++i], nullptr, 0);
+    } else if (arg == "--blobs" && hasValue) {
+      std::string method = argv[++i];
+      if (method == "runs") {
+        blobs = BLOB_RUNS;
+      } else if (method != "contours") {
+        return usage();
+      }
+    } else if (arg == "--stride" && hasValue) {
+      stride = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--threads" && hasValue) {
+      threads = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--seed" && hasValue) {
+      seed = strtoull(argv[++i], nullptr, 0);
+    } else if (arg.compare(0, 2, "--") == 0) {
+      return usage();
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  std::vector<std::string> files;
+  if (inputs.empty() || !listReplayFiles(inputs, &files)) {
+    return usage();
+  }
+  if (files.empty()) {
+    fprintf(stderr, "No .vrpl files found\n");
+    return 1;
+  }
+
+  // Load the corpus as HSV, dealing frames out to the workers in turn
+  std::vector<std::unique_ptr<TuneWorker>> workers;
+  for (int w = 0; w < threads; ++w) {
+    workers.emplace_back(new TuneWorker(matchers, blobs));
+  }
+  PipelineConfig start = defaultPipelineConfig();
+  bool haveThresholds = false;
+  int frames = 0, labeled = 0;
+  cv::Mat rgb;
+  int64_t loadStart = getTimeNs();
+  for (const auto &path : files) {
+    ReplayReader replay;
+    if (!replay.open(path)) {
+      return 1;
+    }
+    replay.prefetch(0, replay.frameCount());
+    for (int i = 0; i < replay.frameCount(); i += stride) {
+      const ReplayFrameMeta &meta = replay.meta(i);
+      if (!haveThresholds) {
+        start.thresholds = {meta.h_min, meta.h_max, meta.s_min, meta.s_max,
+                            meta.v_min, meta.v_max};
+        haveThresholds = true;
+      }
+      TuneFrame frame;
+      frame.file = path;
+      // The same conversion as VisionPipeline::process()
+      cv::cvtColor(replay.frame(i), rgb, replay.pixelFormat() == PIXEL_NV21
+                                             ? CV_YUV2RGB_NV21 : CV_RGBA2RGB);
+      cv::cvtColor(rgb, frame.hsv, CV_RGB2HSV);
+      int expected = std::min(std::max(meta.num_expected, 0), kMaxReplayTargets);
+      frame.expected.assign(meta.expected, meta.expected + expected);
+      labeled += expected > 0;
+      workers[frames % threads]->frames().push_back(std::move(frame));
+      ++frames;
+    }
+  }
+  if (frames == 0) {
+    fprintf(stderr, "No frames in the corpus\n");
+    return 1;
+  }
+  if (!configPath.empty()) {
+    std::string error;
+    if (!loadPipelineConfig(configPath, &start, &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+  }
+  if (labeled == 0) {
+    fprintf(stderr, "No frame has expected targets; tuning would only remove detections\n");
+    return 1;
+  }
+  std::vector<Tunable> tunables;
+  if (!selectTunables(groups, hsvStep, &start, &tunables)) {
+    return usage();
+  }
+  printf("%d files, %d frames (%d with targets) loaded in %.1f s, %d threads, "
+         "tuning %d parameters\n",
+         int(files.size()), frames, labeled, (getTimeNs() - loadStart) / 1e9, threads,
+         int(tunables.size()));
+
+  PipelineConfig best = start;
+  TuneScore bestScore = evaluateAll(workers, {start})[0];
+  TuneScore startScore = bestScore;
+  printScore("start", startScore, beta);
+  int64_t evaluations = 1;
+  int64_t searchStart = getTimeNs();
+
+  // Random search around the best config so far, a batch per round
+  cv::RNG rng(seed);
+  size_t batch = std::max(16, 2 * threads);
+  for (int done = 0; done < samples;) {
+    std::vector<PipelineConfig> configs;
+    for (; configs.size() < batch && done < samples; ++done) {
+      PipelineConfig config = best;
+      for (const auto &t : tunables) {
+        if (rng.uniform(0, 2) == 0) {
+          setValue(&config, t, getValue(&config, t) + rng.gaussian(2 * t.step));
+        }
+      }
+      configs.push_back(config);
+    }
+    std::vector<TuneScore> scores = evaluateAll(workers, configs);
+    evaluations += configs.size();
+    for (size_t c = 0; c < configs.size(); ++c) {
+      if (scores[c].fMeasure(beta) > bestScore.fMeasure(beta)) {
+        best = configs[c];
+        bestScore = scores[c];
+      }
+    }
+  }
+  if (samples > 0) {
+    printScore("random search", bestScore, beta);
+  }
+
+  // Coordinate descent: try every single-parameter move, keep the best
+  double scale = 1;
+  for (int pass = 0; pass < passes && scale >= 1.0 / 8; ++pass) {
+    std::vector<PipelineConfig> configs;
+    for (const auto &t : tunables) {
+      // Thresholds never move by less than one
+      double step = t.integer ? std::max(1.0, round(t.step * scale)) : t.step * scale;
+      for (int k : {-2, -1, 1, 2}) {
+        PipelineConfig config = best;
+        if (setValue(&config, t, getValue(&config, t) + k * step)) {
+          configs.push_back(config);
+        }
+      }
+    }
+    std::vector<TuneScore> scores = evaluateAll(workers, configs);
+    evaluations += configs.size();
+    int bestMove = -1;
+    for (size_t c = 0; c < configs.size(); ++c) {
+      double f = scores[c].fMeasure(beta);
+      if (f > (bestMove >= 0 ? scores[bestMove] : bestScore).fMeasure(beta)) {
+        bestMove = int(c);
+      }
+    }
+    if (bestMove >= 0) {
+      best = configs[bestMove];
+      bestScore = scores[bestMove];
+    } else {
+      scale /= 2;
+    }
+  }
+  printScore("refined", bestScore, beta);
+
+  double seconds = (getTimeNs() - searchStart) / 1e9;
+  int64_t hits = 0, misses = 0;
+  for (const auto &worker : workers) {
+    hits += worker->maskHits();
+    misses += worker->maskMisses();
+  }
+  printf("%lld evaluations in %.1f s (%.0f frames/s), mask cache %.1f%% hits\n",
+         (long long)evaluations, seconds, evaluations * frames / std::max(seconds, 1e-9),
+         hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+
+  // Per file, so a gain on one file bought with a loss on another shows
+  std::map<std::string, TuneScore> before, after;
+  std::vector<TuneScore> unused;
+  for (auto &worker : workers) {
+    worker->evaluate({start}, &unused, &before);
+    worker->evaluate({best}, &unused, &after);
+  }
+  for (const auto &path : files) {
+    printf("  %s: F %.4f -> %.4f\n", path.c_str(), before[path].fMeasure(beta),
+           after[path].fMeasure(beta));
+  }
+
+  // Only what differs from the start is news; the file holds everything
+  PipelineConfig bestCopy = best, startCopy = start;
+  std::vector<PipelineConfigField> bestFields = pipelineConfigFields(&bestCopy);
+  std::vector<PipelineConfigField> startFields = pipelineConfigFields(&startCopy);
+  for (size_t i = 0; i < bestFields.size(); ++i) {
+    const PipelineConfigField &b = bestFields[i], &s = startFields[i];
+    if (b.int_value != nullptr && *b.int_value != *s.int_value) {
+      printf("  %s %d -> %d\n", b.name, *s.int_value, *b.int_value);
+    } else if (b.double_value != nullptr && *b.double_value != *s.double_value) {
+      printf("  %s %g -> %g\n", b.name, *s.double_value, *b.double_value);
+    }
+  }
+
+  char header[256];
+  snprintf(header, sizeof(header),
+           "# auto_tune: %d files, %d frames, F%g %.4f (precision %.4f, recall %.4f), "
+           "from %.4f\n",
+           int(files.size()), frames, beta, bestScore.fMeasure(beta), bestScore.precision(),
+           bestScore.recall(), startScore.fMeasure(beta));
+  std::string text = header + formatPipelineConfig(best);
+  if (outPath.empty()) {
+    fputs(text.c_str(), stdout);
+    return 0;
+  }
+  FILE *out = fopen(outPath.c_str(), "w");
+  if (out == nullptr || fputs(text.c_str(), out) < 0 || fclose(out) != 0) {
+    fprintf(stderr, "Could not write %s\n", outPath.c_str());
+    return 1;
+  }
+  printf("Wrote %s\n", outPath.c_str());
+  return 0;
+}
@@ -0,0 +1,311 @@
+// Runs a replay corpus through one pipeline per core for throughput, and
+// measures how that scales with the number of cores.
+//
+//   batch_eval <file.vrpl | dir> ... [--workers N] [--repeat K] [--mode M]
+//              [--matchers MASK] [--blobs contours|runs|tiled]
+//              [--morph OP[:WxH]] [--config FILE] [--dump]
+//
+// The corpus is run with 1, 2, 4, ... and finally N workers (all cores by
+// default). Each worker is a thread with its own VisionPipeline, so its own
+// buffers and config; workers take chunks of frames from a shared counter
+// and store each frame's results by frame number. The results therefore
+// come out in corpus order however the frames were shared out. Every run is
+// checked against the single-worker run, frame by frame. No state carries
+// from one frame to the next with the latency governor off, so any
+// difference is a bug.
+//
+// Each run reports frames per second over the whole machine, the speedup
+// over one worker and the scaling efficiency (speedup / workers), along with
+// the per-frame time; a per-frame time that grows with the worker count
+// means the workers are fighting over memory bandwidth or caches.
+// --dump prints the merged targets of the last run, one line per frame.
+//
+// Frames are read from the mapped replay files without copying; modes that
+// draw overlays draw them on the pipeline's own copy. --blobs tiled spreads
+// every frame over the cores by itself, so with more than one worker it
+// mostly competes with them.
+//
+// Exits 1 if any run differs from the single-worker one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common.hpp"
+#include "../pipeline_config.hpp"
+#include "../replay_format.hpp"
+#include "../vision_pipeline.hpp"
+#include "bench_stats.hpp"
+#include "replay_corpus.hpp"
+
+// Frames a worker takes at a time: enough to keep the shared counter cold,
+// few enough that the last chunks still even out the load
+static const int kChunkFrames = 8;
+
+struct CorpusFrame {
+  int file;
+  const ReplayReader *replay;
+  int index;
+};
+
+// Everything a run keeps about one frame
+struct FrameResult {
+  std::vector<TargetInfo> targets;
+  int candidates;
+  int rejected;
+  int64_t process_ns;
+};
+
+struct BatchOptions {
+  int mode;
+  int matchers;
+  BlobExtraction blobs;
+  MorphConfig morph;
+  bool use_config;  // config instead of each frame's recorded thresholds
+  PipelineConfig config;
+};
+
+static bool sameTargets(const std::vector<TargetInfo> &a,
+                        const std::vector<TargetInfo> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    const TargetInfo &x = a[i], &y = b[i];
+    if (x.type != y.type || x.box != y.box || x.centroid_x != y.centroid_x ||
+        x.centroid_y != y.centroid_y || x.width != y.width || x.height != y.height ||
+        x.leftToRightRatio != y.leftToRightRatio ||
+        x.isGeneratedPair != y.isGeneratedPair) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// One worker: processes chunks of frames until the corpus runs out
+static void runWorker(const BatchOptions &options, const std::vector<CorpusFrame> &frames,
+                      std::atomic<int> *next, std::vector<FrameResult> *results) {
+  VisionPipeline pipeline;
+  pipeline.setEnabledMatchers(options.matchers);
+  pipeline.setBlobExtraction(options.blobs);
+  pipeline.setMorphology(options.morph);
+  if (options.use_config) {
+    pipeline.setConfig(options.config);
+  }
+  int total = int(frames.size());
+  for (;;) {
+    int first = next->fetch_add(kChunkFrames);
+    if (first >= total) {
+      break;
+    }
+    int last = std::min(first + kChunkFrames, total);
+    for (int i = first; i < last; ++i) {
+      const ReplayReader &replay = *frames[i].replay;
+      const ReplayFrameMeta &meta = replay.meta(frames[i].index);
+      if (!options.use_config) {
+        pipeline.setThresholds({meta.h_min, meta.h_max, meta.s_min, meta.s_max,
+                                meta.v_min, meta.v_max});
+      }
+      DisplayMode mode = static_cast<DisplayMode>(options.mode >= 0 ? options.mode : meta.mode);
+      pipeline.setDisplayMode(mode);
+
+      pipeline.setInput(replay.frame(frames[i].index), replay.pixelFormat());
+      int64_t start = getTimeNs();
+      const std::vector<TargetInfo> &targets = pipeline.process(meta.timestamp_ns);
+
+      FrameResult &result = (*results)[i];
+      result.process_ns = getTimeNs() - start;
+      result.targets = targets;
+      result.candidates = int(pipeline.candidates().size());
+      result.rejected = int(pipeline.rejected().size());
+    }
+  }
+}
+
+// Runs the whole corpus once with `workers` threads; returns the wall time
+static int64_t runBatch(const BatchOptions &options, const std::vector<CorpusFrame> &frames,
+                        int workers, std::vector<FrameResult> *results) {
+  results->assign(frames.size(), FrameResult());
+  std::atomic<int> next(0);
+  int64_t start = getTimeNs();
+  std::vector<std::thread> threads;
+  for (int w = 0; w < workers; ++w) {
+    threads.emplace_back(runWorker, std::cref(options), std::cref(frames), &next, results);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return getTimeNs() - start;
+}
+
+static int usage() {
+  fprintf(stderr,
+          "usage: batch_eval <file.vrpl | dir> ... [--workers N] [--repeat K] [--mode M] "
+          "[--matchers MASK] [--blobs contours|runs|tiled] [--morph OP[:WxH]] "
+          "[--config FILE] [--dump]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> inputs;
+  int maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+  int repeat = 1;
+  std::string configPath;
+  bool dump = false;
+  BatchOptions options;
+  options.mode = DISP_MODE_RAW;
+  options.matchers = kDefaultMatchers;
+  options.blobs = BLOB_CONTOURS;
+  options.morph = {MORPH_OP_NONE, 3, 3};
+  options.use_config = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--workers" && hasValue) {
+      maxWorkers = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--repeat" && hasValue) {
+      repeat = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--mode" && hasValue) {
+      options.mode = atoi(argv[++i]);
+    } else if (arg == "--matchers" && hasValue) {
+      options.matchers = strtol(argv[++i], nullptr, 0);
+    } else if (arg == "--blobs" && hasValue) {
+      std::string method = argv[++i];
+      if (method == "runs") {
+        options.blobs = BLOB_RUNS;
+      } else if (method == "tiled") {
+        options.blobs = BLOB_TILED;
+      } else if (method != "contours") {
+        return usage();
+      }
+    } else if (arg == "--morph" && hasValue) {
+      if (!parseMorphology(argv[++i], &options.morph)) {
+        return usage();
+      }
+    } else if (arg == "--config" && hasValue) {
+      configPath = argv[++i];
+    } else if (arg == "--dump") {
+      dump = true;
+    } else if (arg.compare(0, 2, "--") == 0) {
+      return usage();
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  std::vector<std::string> files;
+  if (inputs.empty() || !listReplayFiles(inputs, &files)) {
+    return usage();
+  }
+  if (!configPath.empty()) {
+    options.use_config = true;
+    options.config = defaultPipelineConfig();
+    std::string error;
+    if (!loadPipelineConfig(configPath, &options.config, &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+  }
+
+  // Every file stays mapped for the whole run; frames are shared read-only
+  std::vector<std::unique_ptr<ReplayReader>> replays;
+  std::vector<CorpusFrame> frames;
+  for (const auto &path : files) {
+    std::unique_ptr<ReplayReader> replay(new ReplayReader());
+    if (!replay->open(path)) {
+      return 1;
+    }
+    replay->prefetch(0, replay->frameCount());
+    for (int i = 0; i < replay->frameCount(); ++i) {
+      frames.push_back({int(replays.size()), replay.get(), i});
+    }
+    replays.push_back(std::move(replay));
+  }
+  if (frames.empty()) {
+    fprintf(stderr, "No frames in the corpus\n");
+    return 1;
+  }
+
+  std::vector<int> workerCounts;
+  for (int w = 1; w < maxWorkers; w *= 2) {
+    workerCounts.push_back(w);
+  }
+  workerCounts.push_back(maxWorkers);
+
+  printf("%d files, %d frames, %d cores, x%d per run\n", int(files.size()),
+         int(frames.size()), int(std::thread::hardware_concurrency()), repeat);
+  printf("workers  frames/s  speedup  efficiency  frame median ms  p99 ms  results\n");
+
+  // A warm-up pass faults the mapped frames in, so the first run isn't
+  // charged for reading the files
+  std::vector<FrameResult> reference, results;
+  runBatch(options, frames, maxWorkers, &results);
+
+  double baseRate = 0;
+  int differentRuns = 0;
+  for (int workers : workerCounts) {
+    int64_t wallNs = 0;
+    std::vector<int64_t> samples;
+    int differentFrames = 0;
+    for (int r = 0; r < repeat; ++r) {
+      wallNs += runBatch(options, frames, workers, &results);
+      for (size_t i = 0; i < results.size(); ++i) {
+        samples.push_back(results[i].process_ns);
+        if (reference.empty()) {
+          continue;
+        }
+        const FrameResult &a = reference[i], &b = results[i];
+        if (a.candidates != b.candidates || a.rejected != b.rejected ||
+            !sameTargets(a.targets, b.targets)) {
+          if (differentFrames == 0) {
+            printf("  first difference at frame %d (%d workers)\n", int(i), workers);
+          }
+          ++differentFrames;
+        }
+      }
+      if (reference.empty()) {
+        reference = results;
+      }
+    }
+    double rate = double(frames.size()) * repeat / (wallNs / 1e9);
+    if (baseRate == 0) {
+      baseRate = rate;
+    }
+    TimingSummary summary = summarize(samples);
+    double speedup = rate / baseRate;
+    printf("%7d %9.1f %8.2f %10.1f%% %16.3f %7.3f  %s\n", workers, rate, speedup,
+           100 * speedup / workers, summary.median_ms, summary.p99_ms,
+           workers == 1 ? "reference"
+                        : differentFrames == 0 ? "identical" : "DIFFERENT");
+    if (differentFrames > 0) {
+      printf("  %d frames differ from 1 worker\n", differentFrames);
+      ++differentRuns;
+    }
+  }
+
+  int64_t totalTargets = 0, totalCandidates = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    totalTargets += results[i].targets.size();
+    totalCandidates += results[i].candidates;
+    if (!dump) {
+      continue;
+    }
+    printf("frame %d %s:%d candidates %d targets %d", int(i), files[frames[i].file].c_str(),
+           frames[i].index, results[i].candidates, int(results[i].targets.size()));
+    for (const auto &t : results[i].targets) {
+      printf(" [type %d x %.1f y %.1f w %.1f h %.1f]", t.type, t.centroid_x,
+             t.centroid_y, t.width, t.height);
+    }
+    printf("\n");
+  }
+  printf("%lld targets, %.2f candidates/frame\n", (long long)totalTargets,
+         double(totalCandidates) / results.size());
+  return differentRuns > 0 ? 1 : 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+// Summary of a set of per-frame timings, in milliseconds
+struct TimingSummary {
+  int count;
+  double mean_ms;
+  double median_ms;
+  double p99_ms;
+  double max_ms;
+};
+
+// p in [0, 1]; samples must be sorted
+static inline double percentile(const std::vector<int64_t> &sorted_ns, double p) {
+  if (sorted_ns.empty()) {
+    return 0;
+  }
+  size_t i = std::min(sorted_ns.size() - 1, size_t(p * (sorted_ns.size() - 1) + 0.5));
+  return sorted_ns[i] / 1e6;
+}
+
+static inline TimingSummary summarize(std::vector<int64_t> samples_ns) {
+  TimingSummary summary = {0, 0, 0, 0, 0};
+  if (samples_ns.empty()) {
+    return summary;
+  }
+  std::sort(samples_ns.begin(), samples_ns.end());
+  double total = 0;
+  for (int64_t sample : samples_ns) {
+    total += sample;
+  }
+  summary.count = samples_ns.size();
+  summary.mean_ms = total / samples_ns.size() / 1e6;
+  summary.median_ms = percentile(samples_ns, 0.5);
+  summary.p99_ms = percentile(samples_ns, 0.99);
+  summary.max_ms = samples_ns.back() / 1e6;
+  return summary;
+}
@@ -0,0 +1,345 @@
+// Regression check for detection output and speed. Runs the pipeline over
+// every replay file in a corpus directory and compares each frame's
+// candidates, rejected blobs and targets with the golden file stored next to
+// it (FILE.vrpl -> FILE.golden). Any difference fails the run; goldens only
+// change when regenerated with --update.
+//
+//   golden_check <corpus dir> [--update] [--matchers MASK]
+//                [--blobs contours|runs|tiled] [--morph OP[:WxH]]
+//                [--repeat K] [--baseline FILE] [--save-baseline]
+//                [--max-regress PCT]
+//
+// The same run times every frame (--repeat times, 5 by default) and fails if
+// the median or p99 is more than --max-regress percent (10 by default) over
+// the stored baseline. Baselines are only comparable on the same machine, so
+// the default is <corpus dir>/baseline-<hostname>.txt; --save-baseline
+// writes it. Without a baseline only the goldens are checked.
+//
+// Every pass reuses the same mapped frames, so the first pass also checks
+// that processing leaves each frame's bytes as they were; overlays belong in
+// the pipeline's own buffer.
+//
+// Exits 0 when everything matches, 1 on a difference, a modified frame or a
+// regression.
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../common.hpp"
+#include "../replay_format.hpp"
+#include "../vision_pipeline.hpp"
+#include "bench_stats.hpp"
+
+static const int kMaxReportedDiffs = 20;
+
+// FNV-1a over a frame's bytes
+static uint64_t frameHash(const cv::Mat &frame) {
+  uint64_t hash = 14695981039346656037ULL;
+  size_t rowBytes = frame.cols * frame.elemSize();
+  for (int r = 0; r < frame.rows; ++r) {
+    const uint8_t *p = frame.ptr(r);
+    for (size_t i = 0; i < rowBytes; ++i) {
+      hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+  }
+  return hash;
+}
+
+static bool endsWith(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static void appendLine(std::vector<std::string> *lines, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void appendLine(std::vector<std::string> *lines, const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  lines->push_back(buffer);
+}
+
+static void appendBoxes(std::vector<std::string> *lines, const char *tag,
+                        const std::vector<TargetInfo> &targets) {
+  for (const auto &t : targets) {
+    appendLine(lines, "%s %d %d %d %d", tag, t.box.x, t.box.y, t.box.width, t.box.height);
+  }
+}
+
+// One frame's results as golden file lines. Doubles are printed to 4
+// decimals, well below anything a real change would move.
+static void appendFrame(std::vector<std::string> *lines, int frame,
+                        const VisionPipeline &pipeline) {
+  appendLine(lines, "frame %d candidates %d rejected %d targets %d", frame,
+             int(pipeline.candidates().size()), int(pipeline.rejected().size()),
+             int(pipeline.targets().size()));
+  appendBoxes(lines, "c", pipeline.candidates());
+  appendBoxes(lines, "r", pipeline.rejected());
+  for (const auto &t : pipeline.targets()) {
+    appendLine(lines, "t type %d box %d %d %d %d centroid %.4f %.4f size %.4f %.4f "
+               "ratio %.4f pair %d",
+               t.type, t.box.x, t.box.y, t.box.width, t.box.height, t.centroid_x,
+               t.centroid_y, t.width, t.height, t.leftToRightRatio,
+               t.isGeneratedPair ? 1 : 0);
+  }
+}
+
+static bool readLines(const std::string &path, std::vector<std::string> *lines) {
+  FILE *file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return false;
+  }
+  lines->clear();
+  char buffer[512];
+  while (fgets(buffer, sizeof(buffer), file)) {
+    std::string line = buffer;
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+      line.pop_back();
+    }
+    lines->push_back(line);
+  }
+  fclose(file);
+  return true;
+}
+
+static bool writeLines(const std::string &path, const std::vector<std::string> &lines) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Could not write %s\n", path.c_str());
+    return false;
+  }
+  for (const auto &line : lines) {
+    fprintf(file, "%s\n", line.c_str());
+  }
+  return fclose(file) == 0;
+}
+
+// Reports differing lines, with the frame they belong to
+static int compareLines(const std::string &name, const std::vector<std::string> &golden,
+                        const std::vector<std::string> &actual) {
+  int diffs = 0;
+  std::string frame = "header";
+  size_t n = std::max(golden.size(), actual.size());
+  for (size_t i = 0; i < n; ++i) {
+    const std::string &want = i < golden.size() ? golden[i] : "<missing>";
+    const std::string &got = i < actual.size() ? actual[i] : "<missing>";
+    if (want.compare(0, 6, "frame ") == 0) {
+      frame = want.substr(0, want.find(' ', 6));
+    }
+    if (want != got) {
+      if (diffs < kMaxReportedDiffs) {
+        printf("%s %s line %d:\n  golden: %s\n  actual: %s\n", name.c_str(),
+               frame.c_str(), int(i + 1), want.c_str(), got.c_str());
+      }
+      ++diffs;
+    }
+  }
+  if (diffs > kMaxReportedDiffs) {
+    printf("%s: %d more differences\n", name.c_str(), diffs - kMaxReportedDiffs);
+  }
+  return diffs;
+}
+
+static bool readBaseline(const std::string &path, double *median_ms, double *p99_ms) {
+  FILE *file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return false;
+  }
+  bool ok = fscanf(file, "median_ms %lf p99_ms %lf", median_ms, p99_ms) == 2;
+  fclose(file);
+  return ok;
+}
+
+static int usage() {
+  fprintf(stderr,
+          "usage: golden_check <corpus dir> [--update] [--matchers MASK] "
+          "[--blobs contours|runs|tiled] [--morph OP[:WxH]] [--repeat K] "
+          "[--baseline FILE] [--save-baseline] [--max-regress PCT]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    return usage();
+  }
+  std::string dir = argv[1];
+  bool update = false, saveBaseline = false;
+  int matchers = kAllMatchers, repeat = 5;
+  BlobExtraction blobs = BLOB_CONTOURS;
+  std::string blobsName = "contours", morphName = "none";
+  MorphConfig morph = {MORPH_OP_NONE, 3, 3};
+  std::string baselinePath;
+  double maxRegressPct = 10;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--update") {
+      update = true;
+    } else if (arg == "--matchers" && hasValue) {
+      matchers = strtol(argv[++i], nullptr, 0);
+    } else if (arg == "--blobs" && hasValue) {
+      blobsName = argv[++i];
+      if (blobsName == "runs") {
+        blobs = BLOB_RUNS;
+      } else if (blobsName == "tiled") {
+        blobs = BLOB_TILED;
+      } else if (blobsName != "contours") {
+        return usage();
+      }
+    } else if (arg == "--morph" && hasValue) {
+      morphName = argv[++i];
+      if (!parseMorphology(morphName, &morph)) {
+        return usage();
+      }
+    } else if (arg == "--repeat" && hasValue) {
+      repeat = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--baseline" && hasValue) {
+      baselinePath = argv[++i];
+    } else if (arg == "--save-baseline") {
+      saveBaseline = true;
+    } else if (arg == "--max-regress" && hasValue) {
+      maxRegressPct = atof(argv[++i]);
+    } else {
+      return usage();
+    }
+  }
+  if (baselinePath.empty()) {
+    char host[128] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    baselinePath = dir + "/baseline-" + host + ".txt";
+  }
+
+  std::vector<std::string> files;
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) {
+    fprintf(stderr, "Could not open %s\n", dir.c_str());
+    return 1;
+  }
+  while (struct dirent *entry = readdir(d)) {
+    if (endsWith(entry->d_name, ".vrpl")) {
+      files.push_back(entry->d_name);
+    }
+  }
+  closedir(d);
+  std::sort(files.begin(), files.end());
+  if (files.empty()) {
+    fprintf(stderr, "No .vrpl files in %s\n", dir.c_str());
+    return 1;
+  }
+
+  // The settings are part of the golden, so a check with other settings
+  // fails on the first line rather than on every frame
+  char header[160];
+  snprintf(header, sizeof(header), "# golden_check v1 matchers 0x%x blobs %s morph %s",
+           matchers, blobsName.c_str(), morphName.c_str());
+
+  VisionPipeline pipeline;
+  pipeline.setEnabledMatchers(matchers);
+  pipeline.setBlobExtraction(blobs);
+  pipeline.setMorphology(morph);
+  std::vector<int64_t> samples;
+  int failedFiles = 0, frames = 0, modifiedFrames = 0;
+  for (const auto &name : files) {
+    ReplayReader replay;
+    if (!replay.open(dir + "/" + name)) {
+      ++failedFiles;
+      continue;
+    }
+    std::vector<std::string> lines;
+    lines.push_back(header);
+    for (int r = 0; r < repeat; ++r) {
+      replay.prefetch(0, replay.frameCount());
+      for (int i = 0; i < replay.frameCount(); ++i) {
+        const ReplayFrameMeta &meta = replay.meta(i);
+        pipeline.setThresholds({meta.h_min, meta.h_max, meta.s_min, meta.s_max,
+                                meta.v_min, meta.v_max});
+        pipeline.setDisplayMode(static_cast<DisplayMode>(meta.mode));
+        cv::Mat frame = replay.frame(i);
+        uint64_t before = r == 0 ? frameHash(frame) : 0;
+        pipeline.setInput(frame, replay.pixelFormat());
+        int64_t start = getTimeNs();
+        pipeline.process(meta.timestamp_ns);
+        samples.push_back(getTimeNs() - start);
+        if (r == 0) {
+          appendFrame(&lines, i, pipeline);
+          if (frameHash(frame) != before) {
+            printf("%s: frame %d was modified by processing\n", name.c_str(), i);
+            ++modifiedFrames;
+          }
+        }
+      }
+    }
+    frames += replay.frameCount();
+
+    std::string goldenPath = dir + "/" + name.substr(0, name.size() - 5) + ".golden";
+    if (update) {
+      if (!writeLines(goldenPath, lines)) {
+        ++failedFiles;
+      }
+      continue;
+    }
+    std::vector<std::string> golden;
+    if (!readLines(goldenPath, &golden)) {
+      printf("%s: no golden file (run with --update to create it)\n", name.c_str());
+      ++failedFiles;
+      continue;
+    }
+    int diffs = compareLines(name, golden, lines);
+    printf("%s: %d frames, %s\n", name.c_str(), replay.frameCount(),
+           diffs == 0 ? "ok" : "DIFFERENT");
+    if (diffs > 0) {
+      ++failedFiles;
+    }
+  }
+
+  TimingSummary summary = summarize(samples);
+  printf("%d files, %d frames x%d: median %.3f ms  p99 %.3f ms\n", int(files.size()),
+         frames, repeat, summary.median_ms, summary.p99_ms);
+  bool regressed = false;
+  if (saveBaseline) {
+    FILE *file = fopen(baselinePath.c_str(), "w");
+    if (file == nullptr) {
+      fprintf(stderr, "Could not write %s\n", baselinePath.c_str());
+      return 1;
+    }
+    fprintf(file, "median_ms %.4f p99_ms %.4f\n", summary.median_ms, summary.p99_ms);
+    fclose(file);
+    printf("baseline saved to %s\n", baselinePath.c_str());
+  } else {
+    double baseMedian, baseP99;
+    if (readBaseline(baselinePath, &baseMedian, &baseP99)) {
+      double limit = 1 + maxRegressPct / 100;
+      bool slowMedian = summary.median_ms > baseMedian * limit;
+      bool slowP99 = summary.p99_ms > baseP99 * limit;
+      printf("baseline median %.3f ms (%+.1f%%)  p99 %.3f ms (%+.1f%%)  limit +%.0f%%\n",
+             baseMedian, 100 * (summary.median_ms / baseMedian - 1), baseP99,
+             100 * (summary.p99_ms / baseP99 - 1), maxRegressPct);
+      regressed = slowMedian || slowP99;
+      if (regressed) {
+        printf("REGRESSION: %s over the baseline\n",
+               slowMedian && slowP99 ? "median and p99" : slowMedian ? "median" : "p99");
+      }
+    } else {
+      printf("no baseline at %s, timing not checked\n", baselinePath.c_str());
+    }
+  }
+  if (update) {
+    printf("goldens updated\n");
+  }
+  if (modifiedFrames > 0) {
+    printf("%d frames modified by processing; later passes did not time the recorded input\n",
+           modifiedFrames);
+  }
+  return failedFiles > 0 || modifiedFrames > 0 || regressed ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+// Runs the latency governor against a synthetic load on a simulated clock and
+// prints every level change. Nothing here reads the real clock, so a given
+// profile always produces the same output; use it to tune GovernorConfig and
+// to check that a change to the governor still degrades and recovers where
+// it used to.
+//
+//   governor_sim [--target MS] [--degrade N] [--recover N] [--fraction F]
+//                [--profile FRAMESxMS,...]
+//
+// The profile lists segments of FRAMES frames that cost MS each at
+// GOV_FULL; the default is a quiet field, a cluttered stretch, then quiet
+// again. The cost model below splits that into stages and scales them by
+// level roughly the way the pipeline does.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "../latency_governor.hpp"
+#include "../stage_timer.hpp"
+
+struct LoadSegment {
+  int frames;
+  double full_ms;
+};
+
+// Share of a GOV_FULL frame spent in each stage
+static const double kStageShare[NUM_STAGES] = {0.45, 0.3, 0.05, 0.2};
+
+// Scale of each stage at each level: decimation quarters the pixels, the ROI
+// is assumed to cover about a tenth of the frame
+static const double kLevelScale[NUM_GOVERNOR_LEVELS][NUM_STAGES] = {
+    {1, 1, 1, 1},           // GOV_FULL
+    {1, 1, 1, 0},           // GOV_NO_VIS
+    {0.3, 0.3, 1, 0},       // GOV_DECIMATED
+    {0.12, 0.12, 1, 0},     // GOV_ROI_ONLY
+    {0.12, 0.12, 1, 0},     // GOV_FRAME_SKIP
+};
+
+static const char *kLevelNames[NUM_GOVERNOR_LEVELS] = {
+    "full", "no_vis", "decimated", "roi_only", "frame_skip"};
+
+static bool parseProfile(const std::string &text, std::vector<LoadSegment> *profile) {
+  profile->clear();
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find(',', pos);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    LoadSegment segment;
+    if (sscanf(text.substr(pos, end - pos).c_str(), "%dx%lf", &segment.frames,
+               &segment.full_ms) != 2 || segment.frames <= 0 || segment.full_ms < 0) {
+      return false;
+    }
+    profile->push_back(segment);
+    pos = end + 1;
+  }
+  return !profile->empty();
+}
+
+static int usage() {
+  fprintf(stderr,
+          "usage: governor_sim [--target MS] [--degrade N] [--recover N] "
+          "[--fraction F] [--profile FRAMESxMS,...]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  GovernorConfig config = kDefaultGovernorConfig;
+  std::vector<LoadSegment> profile;
+  parseProfile("60x8,90x30,120x8", &profile);
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--target" && hasValue) {
+      config.target_ns = int64_t(atof(argv[++i]) * 1e6);
+    } else if (arg == "--degrade" && hasValue) {
+      config.degrade_frames = atoi(argv[++i]);
+    } else if (arg == "--recover" && hasValue) {
+      config.recover_frames = atoi(argv[++i]);
+    } else if (arg == "--fraction" && hasValue) {
+      config.recover_fraction = atof(argv[++i]);
+    } else if (arg == "--profile" && hasValue) {
+      if (!parseProfile(argv[++i], &profile)) {
+        return usage();
+      }
+    } else {
+      return usage();
+    }
+  }
+  if (config.target_ns <= 0) {
+    fprintf(stderr, "--target must be positive\n");
+    return 2;
+  }
+
+  ManualClock clock;
+  StageTimer timer(&clock);
+  LatencyGovernor governor;
+  governor.configure(config);
+
+  int frame = 0, processed = 0;
+  int framesAt[NUM_GOVERNOR_LEVELS] = {0};
+  GovernorLevel last = governor.level();
+  for (const auto &segment : profile) {
+    for (int i = 0; i < segment.frames; ++i, ++frame) {
+      GovernorLevel level = governor.level();
+      ++framesAt[level];
+      if (!governor.shouldProcess()) {
+        continue;
+      }
+      ++processed;
+      timer.begin();
+      for (int stage = 0; stage < NUM_STAGES; ++stage) {
+        double ms = segment.full_ms * kStageShare[stage] * kLevelScale[level][stage];
+        clock.advance(int64_t(ms * 1e6));
+        timer.mark(static_cast<Stage>(stage));
+      }
+      int64_t elapsed = timer.elapsedNs();
+      governor.update(elapsed);
+      if (governor.level() != last) {
+        printf("frame %4d  %6.2f ms  %s -> %s\n", frame, elapsed / 1e6,
+               kLevelNames[last], kLevelNames[governor.level()]);
+        last = governor.level();
+      }
+    }
+  }
+
+  printf("frames %d  processed %d  misses %lld\n", frame, processed,
+         (long long)governor.misses());
+  for (int level = 0; level < NUM_GOVERNOR_LEVELS; ++level) {
+    printf("  %-10s %d frames\n", kLevelNames[level], framesAt[level]);
+  }
+  return 0;
+}
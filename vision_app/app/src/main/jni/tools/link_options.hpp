@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "../standin_server.hpp"
+
+// Fault injection options shared by robot_standin and link_rig. Returns true
+// and advances i if argv[i] is one of them; sets *bad on a malformed value.
+static inline bool parseStandinOption(int argc, char **argv, int *i,
+                                      StandinConfig *config, bool *bad) {
+  std::string arg = argv[*i];
+  if (*i + 1 >= argc) {
+    return false;
+  }
+  const char *value = argv[*i + 1];
+  if (arg == "--reply-delay") {
+    config->reply_delay_ms = atoi(value);
+  } else if (arg == "--read-delay") {
+    config->read_delay_ms = atoi(value);
+  } else if (arg == "--stall") {
+    *bad = sscanf(value, "%d:%d", &config->stall_every_ms, &config->stall_ms) != 2;
+  } else if (arg == "--disconnect-every") {
+    config->disconnect_every_ms = atoi(value);
+  } else if (arg == "--rcvbuf") {
+    config->rcvbuf = atoi(value);
+  } else if (arg == "--loss") {
+    config->loss_percent = atof(value);
+  } else if (arg == "--retransmit") {
+    config->retransmit_ms = atoi(value);
+  } else if (arg == "--max-age") {
+    config->max_age_ms = atof(value);
+  } else if (arg == "--clock-offset") {
+    config->clock_offset_ns = int64_t(atof(value) * 1e6);
+  } else {
+    return false;
+  }
+  ++*i;
+  return true;
+}
+
+#define STANDIN_OPTIONS_USAGE \
+  "[--reply-delay MS] [--read-delay MS] [--stall EVERY_MS:MS] " \
+  "[--disconnect-every MS] [--rcvbuf BYTES] [--loss PCT] " \
+  "[--retransmit MS] [--max-age MS] [--clock-offset MS]"
@@ -0,0 +1,506 @@
+// Load and latency rig for the robot link, runnable on any Linux box. Starts
+// a stand-in robot (see robot_standin) in-process and drives it with a phone
+// side that behaves like RobotConnection: target updates at a fixed rate,
+// heartbeats every 100 ms, the 800 ms heartbeat timeout and reconnects every
+// 250 ms. Both ends share one clock, so it can measure the whole trip from
+// capture to the robot reading the update.
+//
+//   link_rig [--seconds N] [--rate HZ] [--late MS] [--queue | --udp]
+//            [--reply-delay MS] [--read-delay MS] [--stall EVERY_MS:MS]
+//            [--disconnect-every MS] [--rcvbuf BYTES] [--sndbuf BYTES]
+//            [--loss PCT] [--retransmit MS] [--max-age MS]
+//            [--restart-every MS]
+//
+// Targets go through a latest-value slot as in the app; --queue uses the old
+// ordered queue of 30 instead, and --udp sends one datagram per update, for
+// comparison. --late sets the latency above which an update counts as late
+// (default 100 ms). --sndbuf shrinks the phone side kernel send buffer.
+//
+// --loss drops that percentage of target updates. Over TCP a loss becomes a
+// --retransmit (default 200 ms) stall of the stream; over UDP the datagram
+// is simply gone. Comparing the latency tail of the two at the same --loss
+// shows what head-of-line blocking costs.
+//
+// --restart-every (with --udp) starts a new sender session that often, as a
+// restarted app would, and sends the old session's last datagrams again
+// right after the new session's first one, as if they had been held up in
+// the network. Their captures are older than what the robot already has, so
+// "out of order" in the arrivals must stay 0.
+//
+// Heartbeats carry NTP-style timestamps and the phone side estimates the
+// robot's clock offset from them, as RobotConnection does. --clock-offset
+// puts the stand-in's clock that far from the phone's; the rig reports the
+// estimate and how far the robot-time capture stamps are off.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common.hpp"
+#include "../robot_protocol.hpp"
+#include "../standin_server.hpp"
+#include "bench_stats.hpp"
+#include "link_options.hpp"
+
+// Mirrors RobotConnection
+static const int kHeartbeatPeriodMs = 100;
+static const int kHeartbeatThresholdMs = 800;
+static const int kReconnectDelayMs = 250;
+static const size_t kQueueSize = 30;
+// Datagrams of the old session that --restart-every delivers late
+static const size_t kStragglers = 2;
+
+struct Outgoing {
+  bool heartbeat;
+  int64_t seq;
+};
+
+class PhoneSide {
+ public:
+  PhoneSide(int port, int udp_port, bool queue_mode, bool udp, int sndbuf)
+      : port_(port), queue_mode_(queue_mode), sndbuf_(sndbuf), udp_fd_(-1),
+        session_(getTimeNs() & 0x7fffffff) {
+    session_first_seq_[session_] = 0;
+    if (udp) {
+      udp_fd_ = bindUdp(0);
+      resolveUdp("127.0.0.1", udp_port, &udp_addr_, &udp_addr_length_);
+    }
+  }
+
+  ~PhoneSide() {
+    if (udp_fd_ >= 0) {
+      close(udp_fd_);
+    }
+  }
+
+  void start() {
+    running_ = true;
+    writer_ = std::thread(&PhoneSide::writeLoop, this);
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+      wake_.notify_all();
+    }
+    socket_.close();
+    writer_.join();
+  }
+
+  // Called at the frame rate
+  void sendTargets(int64_t seq, int64_t capture_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (size_t(seq) >= capture_ns_.size()) {
+      capture_ns_.resize(seq + 1, 0);
+    }
+    capture_ns_[seq] = capture_ns;
+    if (udp_fd_ >= 0) {
+      // Sent right away by the caller. UdpTargetSender hands it to its own
+      // thread first, which adds a wakeup but no queueing.
+      std::string datagram = encodeTargets(seq - session_first_seq_[session_], getTimeNs());
+      sendDatagram(datagram);
+      for (const auto &late : stragglers_) {
+        sendDatagram(late);
+      }
+      stragglers_.clear();
+      recent_.push_back(datagram);
+      if (recent_.size() > kStragglers) {
+        recent_.pop_front();
+      }
+      return;
+    }
+    if (queue_mode_) {
+      if (ordered_.size() >= kQueueSize) {
+        ++queue_dropped_;
+        return;
+      }
+      ordered_.push_back({false, seq});
+    } else {
+      if (has_latest_) {
+        ++superseded_;
+      }
+      latest_ = seq;
+      has_latest_ = true;
+    }
+    wake_.notify_one();
+  }
+
+  // UDP only: the next update, seq, starts a new session, as from a new
+  // UdpTargetSender
+  void restartSession(int64_t seq) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++session_;
+    session_first_seq_[session_] = seq;
+    stragglers_.swap(recent_);
+    recent_.clear();
+  }
+
+  void sendHeartbeat() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ordered_.size() < kQueueSize) {
+      ordered_.push_back({true, 0});
+      wake_.notify_one();
+    }
+  }
+
+  int64_t captureNs(int64_t seq) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return seq >= 0 && size_t(seq) < capture_ns_.size() ? capture_ns_[seq] : 0;
+  }
+
+  // Of an update as numbered on the wire
+  int64_t captureNs(int64_t session, int64_t seq) {
+    int64_t first;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = session_first_seq_.find(session);
+      if (found == session_first_seq_.end()) {
+        return 0;
+      }
+      first = found->second;
+    }
+    return captureNs(first + seq);
+  }
+
+  int64_t lastHeartbeatReply() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_reply_ns_;
+  }
+
+  std::vector<int64_t> heartbeatRtts() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rtts_;
+  }
+
+  int64_t written() const { return written_; }
+  int64_t superseded() const { return superseded_; }
+  int64_t queueDropped() const { return queue_dropped_; }
+  int connects() const { return connects_; }
+  const ClockOffsetEstimator &clock() const { return clock_; }
+
+ private:
+  // As TargetUpdateMessage does once the clock offset is known
+  std::string robotStamp(int64_t capture_ns) const {
+    ClockEstimate clock = clock_.estimate();
+    if (!clock.synced) {
+      return "";
+    }
+    char stamp[48];
+    snprintf(stamp, sizeof(stamp), "\"capturedAtRobotNs\":%lld,",
+             (long long)clock.toRobotTime(capture_ns));
+    return stamp;
+  }
+
+  std::string encodeTargets(int64_t seq, int64_t capture_ns) {
+    char body[256];
+    snprintf(body, sizeof(body),
+             "{\"capturedAgoMs\":%lld,\"session\":%lld,\"seq\":%lld,%s\"targets\":"
+             "[{\"x\":85.3,\"y\":0.0123,\"z\":-0.0456,\"theta\":0.98,\"type\":0}]}",
+             (long long)((getTimeNs() - capture_ns) / 1000000), (long long)session_,
+             (long long)seq,
+             robotStamp(capture_ns).c_str());
+    LinkMessage message;
+    message.type = "targets";
+    message.message = body;
+    return encodeLinkMessage(message);
+  }
+
+  void sendDatagram(const std::string &datagram) {
+    if (sendto(udp_fd_, datagram.data(), datagram.size(), 0,
+               reinterpret_cast<sockaddr *>(&udp_addr_), udp_addr_length_) > 0) {
+      ++written_;
+    }
+  }
+
+  bool takeNext(Outgoing *next) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (ordered_.empty() && !has_latest_) {
+      wake_.wait_for(lock, std::chrono::milliseconds(250));
+    }
+    if (!ordered_.empty()) {
+      *next = ordered_.front();
+      ordered_.pop_front();
+      return true;
+    }
+    if (has_latest_) {
+      *next = {false, latest_};
+      has_latest_ = false;
+      return true;
+    }
+    return false;
+  }
+
+  void writeLoop() {
+    std::thread reader;
+    while (running_) {
+      if (!socket_.isOpen()) {
+        if (reader.joinable()) {
+          reader.join();
+        }
+        int fd = connectTcp("127.0.0.1", port_);
+        if (fd < 0) {
+          usleep(kReconnectDelayMs * 1000);
+          continue;
+        }
+        if (sndbuf_ > 0) {
+          setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf_, sizeof(sndbuf_));
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          heartbeat_sent_ns_.clear();
+        }
+        socket_.reset(fd);
+        ++connects_;
+        reader = std::thread(&PhoneSide::readLoop, this);
+      }
+
+      Outgoing next;
+      if (!takeNext(&next)) {
+        continue;
+      }
+      std::string line;
+      if (next.heartbeat) {
+        int64_t now = getTimeNs();
+        LinkMessage message;
+        message.type = "heartbeat";
+        char stamp[40];
+        snprintf(stamp, sizeof(stamp), "{\"t0\":%lld}", (long long)now);
+        message.message = stamp;
+        line = encodeLinkMessage(message);
+        std::lock_guard<std::mutex> lock(mutex_);
+        heartbeat_sent_ns_.push_back(now);
+      } else {
+        // Serialized at write time, like TargetUpdateMessage
+        line = encodeTargets(next.seq, captureNs(next.seq));
+      }
+      if (!socket_.writeLine(line)) {
+        socket_.close();
+        usleep(kReconnectDelayMs * 1000);
+      } else if (!next.heartbeat) {
+        ++written_;
+      }
+    }
+    socket_.close();
+    if (reader.joinable()) {
+      reader.join();
+    }
+  }
+
+  void readLoop() {
+    std::string line;
+    LinkMessage message;
+    // New connection, maybe a rebooted robot: its clock starts over
+    clock_.reset();
+    while (true) {
+      LineResult result = socket_.readLine(100, &line);
+      if (result == LINE_CLOSED) {
+        socket_.close();
+        return;
+      }
+      if (result == LINE_OK && parseLinkMessage(line, &message) &&
+          message.type == "heartbeat") {
+        int64_t now = getTimeNs();
+        double t0, t1, t2;
+        if (jsonNumber(message.message, "t0", &t0) && jsonNumber(message.message, "t1", &t1) &&
+            jsonNumber(message.message, "t2", &t2)) {
+          clock_.addSample(int64_t(t0), int64_t(t1), int64_t(t2), now);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_reply_ns_ = now;
+        if (!heartbeat_sent_ns_.empty()) {
+          rtts_.push_back(now - heartbeat_sent_ns_.front());
+          heartbeat_sent_ns_.pop_front();
+        }
+      }
+    }
+  }
+
+  const int port_;
+  const bool queue_mode_;
+  const int sndbuf_;
+  int udp_fd_;
+  sockaddr_storage udp_addr_;
+  unsigned udp_addr_length_ = 0;
+  int64_t session_;  // as UdpTargetSender: new for every sender
+  std::atomic<bool> running_{false};
+  std::thread writer_;
+  LineSocket socket_;
+  ClockOffsetEstimator clock_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<Outgoing> ordered_;
+  bool has_latest_ = false;
+  int64_t latest_ = 0;
+  std::vector<int64_t> capture_ns_;
+  std::map<int64_t, int64_t> session_first_seq_;
+  std::deque<std::string> recent_;      // last datagrams of this session
+  std::deque<std::string> stragglers_;  // of the last one, still to send
+  std::deque<int64_t> heartbeat_sent_ns_;
+  std::vector<int64_t> rtts_;
+  int64_t last_reply_ns_ = 0;
+
+  std::atomic<int64_t> written_{0};
+  std::atomic<int64_t> superseded_{0};
+  std::atomic<int64_t> queue_dropped_{0};
+  std::atomic<int> connects_{0};
+};
+
+static void printSummary(const char *name, const std::vector<int64_t> &samples) {
+  TimingSummary summary = summarize(samples);
+  printf("%-14s n %6d  median %7.2f ms  p99 %7.2f ms  max %7.2f ms\n", name,
+         summary.count, summary.median_ms, summary.p99_ms, summary.max_ms);
+}
+
+static int usage() {
+  fprintf(stderr,
+          "usage: link_rig [--seconds N] [--rate HZ] [--late MS] [--queue | --udp] "
+          "[--sndbuf BYTES] [--restart-every MS] " STANDIN_OPTIONS_USAGE "\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  int seconds = 10, sndbuf = 0, restartEveryMs = 0;
+  double rate = 30, lateMs = 100;
+  bool queueMode = false, udp = false;
+  StandinConfig config = kDefaultStandinConfig;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    bool bad = false;
+    if (arg == "--seconds" && hasValue) {
+      seconds = atoi(argv[++i]);
+    } else if (arg == "--rate" && hasValue) {
+      rate = atof(argv[++i]);
+    } else if (arg == "--late" && hasValue) {
+      lateMs = atof(argv[++i]);
+    } else if (arg == "--sndbuf" && hasValue) {
+      sndbuf = atoi(argv[++i]);
+    } else if (arg == "--restart-every" && hasValue) {
+      restartEveryMs = atoi(argv[++i]);
+    } else if (arg == "--queue") {
+      queueMode = true;
+    } else if (arg == "--udp") {
+      udp = true;
+    } else if (!parseStandinOption(argc, argv, &i, &config, &bad) || bad) {
+      return usage();
+    }
+  }
+  if (rate <= 0 || seconds <= 0 || restartEveryMs < 0 || (restartEveryMs > 0 && !udp)) {
+    return usage();
+  }
+
+  StandinServer robot;
+  if (!robot.start(0, config)) {
+    return 1;
+  }
+  PhoneSide phone(robot.port(), robot.udpPort(), queueMode, udp, sndbuf);
+  phone.start();
+
+  // Frames and heartbeats on one schedule; heartbeat timeouts are checked
+  // on the heartbeat period, as the connection monitor does
+  int64_t start = getTimeNs();
+  int64_t end = start + seconds * 1000000000LL;
+  int64_t framePeriod = int64_t(1e9 / rate);
+  int64_t nextFrame = start, nextHeartbeat = start;
+  int64_t restartPeriod = restartEveryMs * 1000000LL;
+  int64_t nextRestart = restartPeriod > 0 ? start + restartPeriod : 0;
+  int64_t seq = 0;
+  int timeouts = 0;
+  bool linkUp = false;
+  while (true) {
+    int64_t now = getTimeNs();
+    if (now >= end) {
+      break;
+    }
+    if (nextRestart != 0 && now >= nextRestart) {
+      phone.restartSession(seq);
+      nextRestart += restartPeriod;
+    }
+    if (now >= nextFrame) {
+      phone.sendTargets(seq++, now);
+      nextFrame += framePeriod;
+    }
+    if (now >= nextHeartbeat) {
+      phone.sendHeartbeat();
+      nextHeartbeat += kHeartbeatPeriodMs * 1000000LL;
+      bool fresh = now - phone.lastHeartbeatReply() < kHeartbeatThresholdMs * 1000000LL;
+      if (linkUp && !fresh) {
+        ++timeouts;
+      }
+      linkUp = fresh;
+    }
+    int64_t wake = std::min(nextFrame, nextHeartbeat) - getTimeNs();
+    if (wake > 0) {
+      usleep(wake / 1000);
+    }
+  }
+  // Let whatever is in flight land
+  usleep(500000);
+  phone.stop();
+  robot.stop();
+
+  std::vector<StandinArrival> arrivals;
+  robot.takeArrivals(&arrivals);
+  std::vector<int64_t> latencies, ages, stampErrors;
+  int late = 0, outOfOrder = 0;
+  int64_t lastCapture = 0;
+  for (const auto &arrival : arrivals) {
+    int64_t capture = phone.captureNs(arrival.session, arrival.seq);
+    if (capture == 0) {
+      continue;
+    }
+    int64_t latency = arrival.arrival_ns - capture;
+    latencies.push_back(latency);
+    if (arrival.captured_at_robot_ns != 0) {
+      stampErrors.push_back(
+          llabs(arrival.captured_at_robot_ns - config.clock_offset_ns - capture));
+    }
+    ages.push_back(int64_t(arrival.captured_ago_ms * 1e6));
+    if (latency > lateMs * 1e6) {
+      ++late;
+    }
+    if (capture <= lastCapture) {
+      ++outOfOrder;
+    }
+    lastCapture = capture;
+  }
+
+  printf("%s, %.0f Hz for %d s\n",
+         udp ? "udp datagrams" : queueMode ? "ordered queue" : "latest-value slot",
+         rate, seconds);
+  printf("generated %lld  superseded %lld  queue full %lld  written %lld  "
+         "received %d  never read %lld\n",
+         (long long)seq, (long long)phone.superseded(), (long long)phone.queueDropped(),
+         (long long)phone.written(), int(arrivals.size()),
+         (long long)(phone.written() - int64_t(arrivals.size())));
+  printf("late (> %.0f ms) %d  out of order %d  connects %d  heartbeat timeouts %d\n",
+         lateMs, late, outOfOrder, phone.connects(), timeouts);
+  if (udp) {
+    printf("datagrams lost %d  out of order %lld  stale %lld  sessions %lld\n",
+           robot.datagramsLost(), (long long)robot.datagramsOutOfOrder(),
+           (long long)robot.datagramsStale(), (long long)robot.datagramSessions());
+  }
+  printSummary("capture->robot", latencies);
+  printSummary("capturedAgoMs", ages);
+  printSummary("heartbeat rtt", phone.heartbeatRtts());
+  printSummary("|stamp error|", stampErrors);
+  ClockEstimate clock = phone.clock().estimate();
+  if (clock.synced) {
+    printf("clock offset estimate %.3f ms (true %.3f ms) from a %.3f ms round trip\n",
+           clock.offset_ns / 1e6, config.clock_offset_ns / 1e6, clock.rtt_ns / 1e6);
+  } else {
+    printf("clock offset not estimated\n");
+  }
+  return 0;
+}
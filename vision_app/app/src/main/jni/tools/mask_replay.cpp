@@ -0,0 +1,130 @@
+// Replays a mask recording (.vrle) through blob extraction and pairing only.
+// Masks are recorded for every frame of a match, so this is the cheap way to
+// check a change to the filtering or pairing logic against a whole match.
+//
+//   mask_replay <file.vrle> [--from N] [--to N] [--repeat K]
+//               [--matchers MASK] [--blobs contours|runs|tiled]
+//               [--morph OP[:WxH]] [--dump]
+//
+// Masks have no color stage to fuse, so --blobs tiled behaves like runs.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "../common.hpp"
+#include "../rle_mask.hpp"
+#include "../vision_pipeline.hpp"
+#include "bench_stats.hpp"
+
+static int usage() {
+  fprintf(stderr,
+          "usage: mask_replay <file.vrle> [--from N] [--to N] [--repeat K] "
+          "[--matchers MASK] [--blobs contours|runs|tiled] [--morph OP[:WxH]] "
+          "[--dump]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    return usage();
+  }
+  int from = 0, to = -1, repeat = 1, matchers = kDefaultMatchers;
+  BlobExtraction blobs = BLOB_CONTOURS;
+  MorphConfig morph = {MORPH_OP_NONE, 3, 3};
+  bool dump = false;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--from" && hasValue) {
+      from = atoi(argv[++i]);
+    } else if (arg == "--to" && hasValue) {
+      to = atoi(argv[++i]);
+    } else if (arg == "--repeat" && hasValue) {
+      repeat = atoi(argv[++i]);
+    } else if (arg == "--matchers" && hasValue) {
+      matchers = strtol(argv[++i], nullptr, 0);
+    } else if (arg == "--blobs" && hasValue) {
+      std::string method = argv[++i];
+      if (method == "runs") {
+        blobs = BLOB_RUNS;
+      } else if (method == "tiled") {
+        blobs = BLOB_TILED;
+      } else if (method != "contours") {
+        return usage();
+      }
+    } else if (arg == "--morph" && hasValue) {
+      if (!parseMorphology(argv[++i], &morph)) {
+        return usage();
+      }
+    } else if (arg == "--dump") {
+      dump = true;
+    } else {
+      return usage();
+    }
+  }
+
+  MaskReplay replay;
+  if (!replay.open(argv[1])) {
+    return 1;
+  }
+  if (to < 0 || to > replay.frameCount()) {
+    to = replay.frameCount();
+  }
+  if (from < 0 || from >= to) {
+    fprintf(stderr, "Empty frame range %d..%d\n", from, to);
+    return 1;
+  }
+  printf("%s: %d masks %dx%d, running %d..%d x%d\n", argv[1],
+         replay.frameCount(), replay.width(), replay.height(), from, to, repeat);
+
+  VisionPipeline pipeline;
+  pipeline.setEnabledMatchers(matchers);
+  pipeline.setBlobExtraction(blobs);
+  pipeline.setMorphology(morph);
+  RleMask mask;
+  std::vector<int64_t> samples;
+  samples.reserve((to - from) * repeat);
+  int totalTargets = 0;
+  int64_t totalBlobs = 0, totalCandidates = 0;
+  int64_t totalRuns = 0;
+  for (int r = 0; r < repeat; ++r) {
+    for (int i = from; i < to; ++i) {
+      replay.mask(i, &mask);
+
+      int64_t start = getTimeNs();
+      const auto &targets = pipeline.processMask(mask);
+      samples.push_back(getTimeNs() - start);
+
+      if (r == 0) {
+        totalTargets += targets.size();
+        totalCandidates += pipeline.candidates().size();
+        totalBlobs += pipeline.candidates().size() + pipeline.rejected().size();
+        totalRuns += mask.runs.size();
+      }
+      if (dump && r == 0) {
+        const MaskFrameHeader &header = replay.header(i);
+        printf("frame %d (t=%lld): %d runs, %d targets\n", i,
+               (long long)header.timestamp_ns, int(mask.runs.size()),
+               int(targets.size()));
+        for (const auto &target : targets) {
+          printf("  type %d at %.1f, %.1f size %.1f x %.1f ratio %.3f\n",
+                 target.type, target.centroid_x, target.centroid_y,
+                 target.width, target.height, target.leftToRightRatio);
+        }
+      }
+    }
+  }
+
+  int frames = to - from;
+  printf("blobs/frame %.1f  candidates/frame %.1f\n",
+         double(totalBlobs) / frames, double(totalCandidates) / frames);
+  TimingSummary summary = summarize(samples);
+  printf("frames %d  targets %d  runs/frame %.1f  mean %.3f ms  median %.3f ms  "
+         "p99 %.3f ms  max %.3f ms\n",
+         summary.count, totalTargets, double(totalRuns) / frames,
+         summary.mean_ms, summary.median_ms, summary.p99_ms, summary.max_ms);
+  return 0;
+}
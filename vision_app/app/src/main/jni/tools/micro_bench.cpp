@@ -0,0 +1,530 @@
+// Times each pipeline primitive on its own, where replay_bench only times
+// whole frames. Every kernel runs on the same prepared inputs, at several
+// frame sizes, on a synthetic scene and optionally on a recorded frame.
+//
+//   micro_bench [--sizes WxH,...] [--replay FILE.vrpl] [--frame N]
+//               [--filter TEXT] [--min-time MS] [--counters] [--json FILE]
+//
+// Sizes default to 320x240, 640x480 and 1280x720. --replay adds a recorded
+// frame (scaled to each size) with its recorded thresholds. --filter runs only
+// the benchmarks whose name contains TEXT. Each benchmark repeats for at least
+// --min-time (200 ms by default) and reports per-call times. --counters adds
+// IPC and cache and branch misses per pixel (per call for the matchers) from
+// perf_event_open, where the kernel allows it.
+//
+// --json writes the results one benchmark per line, in a fixed order, so
+// files from two commits can be compared with diff or a script.
+//
+// Loops compiled per frame shape (morphology/open_*, unpack/*) run in both
+// their fixed-size and generic builds when the size has a fixed one.
+//
+// The mask kernels (kernel/...) run once per instruction set variant this CPU
+// supports, side by side, whatever VISION_KERNELS selects. Each variant's
+// output is checked against the scalar one first; any difference is reported
+// as a MISMATCH and the exit status is 1.
+//
+// The matchers are timed on synthetic candidate lists of 4, 16, 64 and 256
+// strips, independent of frame size. JNI marshalling can only be measured in
+// the app: see NativePart.benchmarkTargetsInfo(), which debug builds log when
+// the pipeline is created.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include "../blob_extractor.hpp"
+#include "../common.hpp"
+#include "../frame_shape.hpp"
+#include "../hsv_threshold.hpp"
+#include "../mask_morphology.hpp"
+#include "../mask_kernels.hpp"
+#include "../perf_counters.hpp"
+#include "../replay_format.hpp"
+#include "../run_labeler.hpp"
+#include "../target_drawing.hpp"
+#include "../target_matcher.hpp"
+#include "../tiled_extractor.hpp"
+#include "bench_stats.hpp"
+#include "synthetic_scene.hpp"
+
+static const uint64_t kSeed = 3061;
+static const int kCandidateCounts[] = {4, 16, 64, 256};
+
+struct BenchResult {
+  std::string name;
+  std::string input;
+  std::string size;
+  TimingSummary summary;
+  double min_ms;
+  // Per pixel, or per call when the kernel has no pixels
+  double ipc;
+  double cache_misses;
+  double branch_misses;
+};
+
+class BenchRunner {
+ public:
+  BenchRunner(const std::string &filter, int64_t min_time_ns)
+      : filter_(filter), min_time_ns_(min_time_ns) {}
+
+  // Returns false if the kernel doesn't allow counters
+  bool enableCounters() { return counters_.open(); }
+
+  // pixels scales the counts; 0 reports them per call
+  void run(const std::string &name, const std::string &input,
+           const std::string &size, double pixels, const std::function<void()> &fn) {
+    if (!filter_.empty() && name.find(filter_) == std::string::npos) {
+      return;
+    }
+    // Warm caches and let lazily sized buffers settle
+    for (int i = 0; i < 3; ++i) {
+      fn();
+    }
+    std::vector<int64_t> samples;
+    PerfCounts before, after;
+    counters_.read(&before);
+    int64_t start = getTimeNs();
+    while (samples.size() < 10 ||
+           (getTimeNs() - start < min_time_ns_ && samples.size() < 1000000)) {
+      int64_t t = getTimeNs();
+      fn();
+      samples.push_back(getTimeNs() - t);
+    }
+    counters_.read(&after);
+    PerfCounts counts = after - before;
+    double per = samples.size() * (pixels > 0 ? pixels : 1);
+    BenchResult result;
+    result.name = name;
+    result.input = input;
+    result.size = size;
+    result.summary = summarize(samples);
+    result.min_ms = percentile(sortedCopy(samples), 0);
+    result.ipc = counts.ipc();
+    result.cache_misses = counts.cache_misses / per;
+    result.branch_misses = counts.branch_misses / per;
+    printf("%-28s %-10s %-10s %8d  median %9.4f ms  mean %9.4f ms  p99 %9.4f ms",
+           name.c_str(), input.c_str(), size.c_str(), result.summary.count,
+           result.summary.median_ms, result.summary.mean_ms, result.summary.p99_ms);
+    if (counters_.available()) {
+      printf("  IPC %.2f  cache misses %.4f  branch misses %.4f /%s", result.ipc,
+             result.cache_misses, result.branch_misses, pixels > 0 ? "px" : "call");
+    }
+    printf("\n");
+    fflush(stdout);
+    results_.push_back(result);
+  }
+
+  bool writeJson(const char *path, int64_t min_time_ns) const {
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) {
+      fprintf(stderr, "Could not write %s\n", path);
+      return false;
+    }
+    fprintf(file, "{\"min_time_ms\":%lld,\"benchmarks\":[\n",
+            (long long)(min_time_ns / 1000000));
+    for (size_t i = 0; i < results_.size(); ++i) {
+      const BenchResult &r = results_[i];
+      fprintf(file,
+              "{\"name\":\"%s\",\"input\":\"%s\",\"size\":\"%s\",\"iterations\":%d,"
+              "\"median_ms\":%.5f,\"mean_ms\":%.5f,\"p99_ms\":%.5f,\"min_ms\":%.5f",
+              r.name.c_str(), r.input.c_str(), r.size.c_str(), r.summary.count,
+              r.summary.median_ms, r.summary.mean_ms, r.summary.p99_ms, r.min_ms);
+      if (counters_.available()) {
+        fprintf(file, ",\"ipc\":%.3f,\"cache_misses\":%.5f,\"branch_misses\":%.5f",
+                r.ipc, r.cache_misses, r.branch_misses);
+      }
+      fprintf(file, "}%s\n", i + 1 < results_.size() ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    fclose(file);
+    return true;
+  }
+
+ private:
+  static std::vector<int64_t> sortedCopy(std::vector<int64_t> samples) {
+    std::sort(samples.begin(), samples.end());
+    return samples;
+  }
+
+  std::string filter_;
+  int64_t min_time_ns_;
+  PerfCounters counters_;
+  std::vector<BenchResult> results_;
+};
+
+// What one variant's kernels produce on a frame, for checking against scalar
+struct KernelOutput {
+  std::vector<uint64_t> thresholded;
+  std::vector<uint64_t> packed;
+  std::vector<int> counts;
+  std::vector<MaskRun> runs;
+};
+
+// PackedMask::countBox through one variant
+static int countBox(const MaskKernels &kernels, const PackedMask &packed,
+                    const cv::Rect &box) {
+  int last = box.x + box.width - 1;
+  uint64_t lastMask = (last & 63) == 63 ? ~0ULL : (1ULL << ((last & 63) + 1)) - 1;
+  return kernels.count_box(packed.row(box.y), packed.words_per_row, box.height, box.x >> 6,
+                           last >> 6, ~0ULL << (box.x & 63), lastMask);
+}
+
+static void runKernels(const MaskKernels &kernels, const cv::Mat &hsv, const cv::Mat &thresh,
+                       const HsvLut &lut, const PackedMask &packed,
+                       const std::vector<cv::Rect> &boxes, KernelOutput *out) {
+  int wordsPerRow = packed.words_per_row;
+  out->thresholded.assign(size_t(wordsPerRow) * hsv.rows, 0);
+  out->packed.assign(size_t(wordsPerRow) * hsv.rows, 0);
+  for (int y = 0; y < hsv.rows; ++y) {
+    kernels.threshold_row(hsv.ptr<uint8_t>(y), hsv.cols, lut,
+                          &out->thresholded[y * wordsPerRow]);
+    kernels.pack_row(thresh.ptr<uint8_t>(y), thresh.cols, &out->packed[y * wordsPerRow]);
+    kernels.row_runs(packed.row(y), wordsPerRow, packed.width, y, &out->runs);
+  }
+  for (const auto &box : boxes) {
+    out->counts.push_back(countBox(kernels, packed, box));
+  }
+}
+
+static bool sameRuns(const std::vector<MaskRun> &a, const std::vector<MaskRun> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].length != b[i].length) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Every supported variant of the mask kernels, checked against scalar and
+// then timed. Returns the number of variants that disagree with scalar.
+static int benchKernels(BenchRunner *runner, const std::string &input,
+                        const std::string &size, double pixels, const cv::Mat &hsv,
+                        const cv::Mat &thresh, const HsvLut &lut, const PackedMask &packed,
+                        const std::vector<cv::Rect> &boxes) {
+  KernelOutput expected;
+  runKernels(scalarMaskKernels(), hsv, thresh, lut, packed, boxes, &expected);
+  int mismatches = 0;
+  std::vector<uint64_t> words(packed.words.size());
+  std::vector<MaskRun> runs;
+  volatile int sink = 0;
+  for (const MaskKernels *kernels : supportedMaskKernels()) {
+    KernelOutput actual;
+    runKernels(*kernels, hsv, thresh, lut, packed, boxes, &actual);
+    const char *wrong = actual.thresholded != expected.thresholded ? "threshold_row"
+                        : actual.packed != expected.packed         ? "pack_row"
+                        : actual.counts != expected.counts         ? "count_box"
+                        : !sameRuns(actual.runs, expected.runs)    ? "row_runs"
+                                                                   : nullptr;
+    if (wrong != nullptr) {
+      printf("MISMATCH: %s %s differs from scalar on %s %s\n", kernels->name, wrong,
+             input.c_str(), size.c_str());
+      ++mismatches;
+      continue;
+    }
+
+    std::string suffix = std::string("/") + kernels->name;
+    int wordsPerRow = packed.words_per_row;
+    runner->run("kernel/threshold_row" + suffix, input, size, pixels, [&] {
+      for (int y = 0; y < hsv.rows; ++y) {
+        kernels->threshold_row(hsv.ptr<uint8_t>(y), hsv.cols, lut, &words[y * wordsPerRow]);
+      }
+    });
+    runner->run("kernel/pack_row" + suffix, input, size, pixels, [&] {
+      for (int y = 0; y < thresh.rows; ++y) {
+        kernels->pack_row(thresh.ptr<uint8_t>(y), thresh.cols, &words[y * wordsPerRow]);
+      }
+    });
+    runner->run("kernel/count_box" + suffix, input, size, pixels, [&] {
+      for (const auto &box : boxes) {
+        sink += countBox(*kernels, packed, box);
+      }
+    });
+    runner->run("kernel/row_runs" + suffix, input, size, pixels, [&] {
+      runs.clear();
+      for (int y = 0; y < packed.height; ++y) {
+        kernels->row_runs(packed.row(y), wordsPerRow, packed.width, y, &runs);
+      }
+    });
+  }
+  return mismatches;
+}
+
+// The packed mask loops that are compiled per frame shape, timed in one
+// build (the frame's FixedShape, or the generic RuntimeShape)
+struct ShapedMaskBench {
+  BenchRunner *runner;
+  const std::string *input;
+  const std::string *size;
+  double pixels;
+  const PackedMask *packed;
+
+  template <class Shape, class Visualize>
+  void operator()(const Shape &shape, Visualize) {
+    std::string build = std::is_same<Shape, RuntimeShape>::value ? "generic" : "fixed";
+    MorphConfig open = {MORPH_OP_OPEN, 3, 3};
+    PackedMorphology morphology;
+    PackedMask scratch;
+    runner->run("morphology/open_" + build, *input, *size, pixels, [&] {
+      // Includes a copy of the mask, the same for both builds
+      scratch.words = packed->words;
+      scratch.width = packed->width;
+      scratch.height = packed->height;
+      scratch.words_per_row = packed->words_per_row;
+      morphology.apply(open, shape, &scratch);
+    });
+    cv::Mat image;
+    runner->run("unpack/" + build, *input, *size, pixels, [&] {
+      packed->unpack(shape, image);
+    });
+  }
+};
+
+// Every per-frame kernel on one RGBA frame. Returns the number of mask
+// kernel variants that disagree with scalar.
+static int benchFrame(BenchRunner *runner, const std::string &input,
+                       const cv::Mat &rgba, const HsvThresholds &thresholds) {
+  char sizeText[32];
+  snprintf(sizeText, sizeof(sizeText), "%dx%d", rgba.cols, rgba.rows);
+  std::string size = sizeText;
+  double pixels = double(rgba.cols) * rgba.rows;
+  HsvLut lut;
+  lut.build(thresholds);
+  cv::Scalar lower(thresholds.h_min, thresholds.s_min, thresholds.v_min);
+  cv::Scalar upper(thresholds.h_max, thresholds.s_max, thresholds.v_max);
+
+  // Inputs for the later stages, computed once the way the pipeline does
+  cv::Mat rgb, hsv, thresh, scratch;
+  cv::cvtColor(rgba, hsv, CV_RGB2HSV);
+  cv::inRange(hsv, lower, upper, thresh);
+  PackedMask packed;
+  thresholdPacked(hsv, lut, &packed);
+  std::vector<std::vector<cv::Point>> contours;
+  thresh.copyTo(scratch);
+  cv::findContours(scratch, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_TC89_KCOS);
+  std::vector<cv::Rect> boxes;
+  for (auto &contour : contours) {
+    boxes.push_back(cv::boundingRect(contour));
+  }
+  std::vector<TargetInfo> candidates, rejected, targets;
+  extractCandidates(thresh, scratch, &candidates, &rejected);
+  MatcherSet matchers;
+  matchers.match(kAllMatchers, candidates, &targets);
+
+  runner->run("rgba_to_hsv/two_pass", input, size, pixels, [&] {
+    cv::cvtColor(rgba, rgb, CV_RGBA2RGB);
+    cv::cvtColor(rgb, hsv, CV_RGB2HSV);
+  });
+  runner->run("rgba_to_hsv/direct", input, size, pixels, [&] {
+    cv::cvtColor(rgba, hsv, CV_RGB2HSV);
+  });
+  runner->run("threshold/in_range", input, size, pixels, [&] {
+    cv::inRange(hsv, lower, upper, thresh);
+  });
+  PackedMask packedOut;
+  runner->run("threshold/lut_packed", input, size, pixels, [&] {
+    thresholdPacked(hsv, lut, &packedOut);
+  });
+  TiledExtractor tiled;
+  runner->run("threshold/tiled_from_rgba", input, size, pixels, [&] {
+    tiled.threshold(rgba, lut, &packedOut);
+  });
+
+  std::vector<std::vector<cv::Point>> found;
+  runner->run("blobs/find_contours", input, size, pixels, [&] {
+    thresh.copyTo(scratch);
+    cv::findContours(scratch, found, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_TC89_KCOS);
+  });
+  std::vector<MaskRun> runs;
+  std::vector<Blob> blobs;
+  RunLabeler labeler;
+  runner->run("blobs/run_labeler", input, size, pixels, [&] {
+    runs.clear();
+    packed.extractRuns(&runs);
+    labeler.label(runs, &blobs);
+  });
+  runner->run("blobs/tiled_from_rgba", input, size, pixels, [&] {
+    tiled.run(rgba, lut, &packedOut, nullptr, &blobs);
+  });
+
+  volatile int sink = 0;
+  runner->run("bounding_rect", input, size, pixels, [&] {
+    for (auto &contour : contours) {
+      sink += cv::boundingRect(contour).width;
+    }
+  });
+  runner->run("fullness/bytes", input, size, pixels, [&] {
+    for (auto &box : boxes) {
+      sink += countWhite(thresh, box);
+    }
+  });
+  runner->run("fullness/packed", input, size, pixels, [&] {
+    for (auto &box : boxes) {
+      sink += packed.countBox(box);
+    }
+  });
+  runner->run("candidates/contours", input, size, pixels, [&] {
+    candidates.clear();
+    rejected.clear();
+    extractCandidates(thresh, scratch, &candidates, &rejected);
+  });
+
+  // Drawing over the same image each time costs the same as on a fresh one
+  cv::Mat vis = rgba.clone();
+  runner->run("draw/targets", input, size, pixels, [&] {
+    drawTargets(vis, targets);
+  });
+  runner->run("draw/candidates", input, size, pixels, [&] {
+    drawCandidates(vis, candidates, rejected);
+  });
+  // Two ways to keep a recorded frame clean under the overlays: copy it
+  // first, or save what the overlays cover (what the pipeline does)
+  cv::Mat copy;
+  runner->run("record_clean/copy_frame", input, size, pixels, [&] {
+    rgba.copyTo(copy);
+  });
+  OverlayUndo undo;
+  runner->run("record_clean/save_overlays", input, size, pixels, [&] {
+    undo.clear();
+    undo.saveTargets(vis, targets);
+    undo.saveCandidates(vis, candidates, rejected);
+  });
+
+  ShapedMaskBench shaped = {runner, &input, &size, pixels, &packed};
+  shaped(RuntimeShape(packed.width, packed.height), DetectionOnly());
+  if (isFixedFrameShape(packed.width, packed.height)) {
+    dispatchFrameShape(packed.width, packed.height, false, shaped);
+  }
+
+  return benchKernels(runner, input, size, pixels, hsv, thresh, lut, packed, boxes);
+}
+
+static void benchPairing(BenchRunner *runner) {
+  for (int count : kCandidateCounts) {
+    std::vector<TargetInfo> candidates = syntheticCandidates(count, kSeed);
+    std::vector<TargetInfo> targets;
+    char size[16];
+    snprintf(size, sizeof(size), "%d", count);
+    PegMatcher peg;
+    runner->run("pairing/peg", "synthetic", size, 0, [&] {
+      targets.clear();
+      peg.match(candidates, &targets);
+    });
+    BoilerMatcher boiler;
+    runner->run("pairing/boiler", "synthetic", size, 0, [&] {
+      targets.clear();
+      boiler.match(candidates, &targets);
+    });
+  }
+}
+
+static bool parseSizes(const std::string &text, std::vector<cv::Size> *sizes) {
+  sizes->clear();
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find(',', pos);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    cv::Size size;
+    if (sscanf(text.substr(pos, end - pos).c_str(), "%dx%d", &size.width,
+               &size.height) != 2 || size.width <= 0 || size.height <= 0) {
+      return false;
+    }
+    sizes->push_back(size);
+    pos = end + 1;
+  }
+  return !sizes->empty();
+}
+
+static int usage() {
+  fprintf(stderr,
+          "usage: micro_bench [--sizes WxH,...] [--replay FILE.vrpl] [--frame N] "
+          "[--filter TEXT] [--min-time MS] [--counters] [--json FILE]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  std::vector<cv::Size> sizes = {cv::Size(320, 240), cv::Size(640, 480),
+                                 cv::Size(1280, 720)};
+  const char *replayPath = nullptr;
+  const char *jsonPath = nullptr;
+  int frame = 0;
+  std::string filter;
+  double minTimeMs = 200;
+  bool counters = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--sizes" && hasValue) {
+      if (!parseSizes(argv[++i], &sizes)) {
+        return usage();
+      }
+    } else if (arg == "--replay" && hasValue) {
+      replayPath = argv[++i];
+    } else if (arg == "--frame" && hasValue) {
+      frame = atoi(argv[++i]);
+    } else if (arg == "--filter" && hasValue) {
+      filter = argv[++i];
+    } else if (arg == "--min-time" && hasValue) {
+      minTimeMs = atof(argv[++i]);
+    } else if (arg == "--counters") {
+      counters = true;
+    } else if (arg == "--json" && hasValue) {
+      jsonPath = argv[++i];
+    } else {
+      return usage();
+    }
+  }
+
+  cv::Mat recorded;
+  HsvThresholds recordedThresholds = kSyntheticThresholds;
+  if (replayPath != nullptr) {
+    ReplayReader replay;
+    if (!replay.open(replayPath)) {
+      return 1;
+    }
+    if (frame < 0 || frame >= replay.frameCount()) {
+      fprintf(stderr, "%s has no frame %d\n", replayPath, frame);
+      return 1;
+    }
+    if (replay.pixelFormat() == PIXEL_NV21) {
+      cv::cvtColor(replay.frame(frame), recorded, CV_YUV2RGBA_NV21);
+    } else {
+      replay.frame(frame).copyTo(recorded);
+    }
+    const ReplayFrameMeta &meta = replay.meta(frame);
+    recordedThresholds = {meta.h_min, meta.h_max, meta.s_min, meta.s_max,
+                          meta.v_min, meta.v_max};
+  }
+
+  int64_t minTimeNs = int64_t(minTimeMs * 1e6);
+  BenchRunner runner(filter, minTimeNs);
+  if (counters && !runner.enableCounters()) {
+    printf("hardware counters unavailable, timing only\n");
+  }
+  int mismatches = 0;
+  for (const cv::Size &size : sizes) {
+    cv::Mat rgba;
+    renderSyntheticFrame(size.width, size.height, kSeed, &rgba);
+    mismatches += benchFrame(&runner, "synthetic", rgba, kSyntheticThresholds);
+    if (!recorded.empty()) {
+      cv::resize(recorded, rgba, size, 0, 0, cv::INTER_AREA);
+      mismatches += benchFrame(&runner, "recorded", rgba, recordedThresholds);
+    }
+  }
+  benchPairing(&runner);
+
+  if (jsonPath != nullptr && !runner.writeJson(jsonPath, minTimeNs)) {
+    return 1;
+  }
+  return mismatches > 0 ? 1 : 0;
+}
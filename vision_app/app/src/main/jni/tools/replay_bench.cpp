@@ -0,0 +1,246 @@
+// Runs the vision pipeline over a .vrpl replay file and reports per-frame
+// timing. Frames are fed straight from the mmap'ed file, so decode and copy
+// costs stay out of the measurement.
+//
+//   replay_bench <file.vrpl> [--from N] [--to N] [--repeat K] [--mode M]
+//                [--matchers MASK] [--blobs contours|runs|tiled]
+//                [--morph OP[:WxH]] [--stream ROWS] [--budget MS] [--counters]
+//                [--config FILE] [--dump]
+//
+// --from/--to select a frame range (for bisecting a bad frame), --mode
+// overrides the recorded display mode, --dump prints the targets found on
+// every frame. --blobs runs uses the packed-mask labeler instead of
+// findContours; --blobs tiled does the same fused into strips across all
+// cores. --morph cleans up the mask before blob extraction; compare
+// blobs/frame with and without it to see how much speckle it removes.
+// --stream feeds each frame ROWS rows at a time through the streaming API and
+// also reports the time from the last rows to the result. --budget turns on
+// the latency governor and reports how many frames ran at each level and how
+// many it skipped; skipped frames are left out of the target counts.
+// --counters breaks the time down by stage and, where the kernel allows
+// perf_event_open, adds IPC and cache and branch misses per pixel: low IPC
+// with many cache misses means a stage waits on memory. --config reads
+// detection parameters in the pipeline_config.hpp text format, thresholds
+// included, instead of using the defaults and the recorded thresholds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../common.hpp"
+#include "../pipeline_config.hpp"
+#include "../replay_format.hpp"
+#include "../vision_pipeline.hpp"
+#include "bench_stats.hpp"
+
+static int usage() {
+  fprintf(stderr,
+          "usage: replay_bench <file.vrpl> [--from N] [--to N] [--repeat K] "
+          "[--mode M] [--matchers MASK] [--blobs contours|runs|tiled] "
+          "[--morph OP[:WxH]] [--stream ROWS] [--budget MS] [--counters] "
+          "[--config FILE] [--dump]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    return usage();
+  }
+  int from = 0, to = -1, repeat = 1, mode = -1, matchers = kDefaultMatchers;
+  BlobExtraction blobs = BLOB_CONTOURS;
+  MorphConfig morph = {MORPH_OP_NONE, 3, 3};
+  int streamRows = 0;
+  double budgetMs = 0;
+  bool dump = false, counters = false;
+  std::string configPath;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--from" && hasValue) {
+      from = atoi(argv[++i]);
+    } else if (arg == "--to" && hasValue) {
+      to = atoi(argv[++i]);
+    } else if (arg == "--repeat" && hasValue) {
+      repeat = atoi(argv[++i]);
+    } else if (arg == "--mode" && hasValue) {
+      mode = atoi(argv[++i]);
+    } else if (arg == "--matchers" && hasValue) {
+      matchers = strtol(argv[++i], nullptr, 0);
+    } else if (arg == "--blobs" && hasValue) {
+      std::string method = argv[++i];
+      if (method == "runs") {
+        blobs = BLOB_RUNS;
+      } else if (method == "tiled") {
+        blobs = BLOB_TILED;
+      } else if (method != "contours") {
+        return usage();
+      }
+    } else if (arg == "--morph" && hasValue) {
+      if (!parseMorphology(argv[++i], &morph)) {
+        return usage();
+      }
+    } else if (arg == "--stream" && hasValue) {
+      streamRows = atoi(argv[++i]);
+    } else if (arg == "--budget" && hasValue) {
+      budgetMs = atof(argv[++i]);
+    } else if (arg == "--counters") {
+      counters = true;
+    } else if (arg == "--config" && hasValue) {
+      configPath = argv[++i];
+    } else if (arg == "--dump") {
+      dump = true;
+    } else {
+      return usage();
+    }
+  }
+
+  PipelineConfig config = defaultPipelineConfig();
+  std::string error;
+  if (!configPath.empty() && !loadPipelineConfig(configPath, &config, &error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  ReplayReader replay;
+  if (!replay.open(argv[1])) {
+    return 1;
+  }
+  if (to < 0 || to > replay.frameCount()) {
+    to = replay.frameCount();
+  }
+  if (from < 0 || from >= to) {
+    fprintf(stderr, "Empty frame range %d..%d\n", from, to);
+    return 1;
+  }
+  if (streamRows > 0 && replay.pixelFormat() != PIXEL_RGBA) {
+    fprintf(stderr, "--stream needs an RGBA replay file\n");
+    return 1;
+  }
+  printf("%s: %d frames %dx%d, running %d..%d x%d\n", argv[1],
+         replay.frameCount(), replay.width(), replay.height(), from, to, repeat);
+
+  VisionPipeline pipeline;
+  pipeline.setEnabledMatchers(matchers);
+  pipeline.setBlobExtraction(blobs);
+  pipeline.setMorphology(morph);
+  pipeline.setLatencyTarget(int64_t(budgetMs * 1e6));
+  pipeline.setConfig(config);
+  bool countersAvailable = counters && pipeline.enablePerfCounters(true);
+  int64_t stageNs[NUM_STAGES] = {0};
+  PerfCounts stageCounts[NUM_STAGES];
+  int framesAtLevel[NUM_GOVERNOR_LEVELS] = {0};
+  std::vector<int64_t> samples, tailSamples;
+  samples.reserve((to - from) * repeat);
+  int totalTargets = 0, skippedFrames = 0;
+  int64_t totalBlobs = 0, totalCandidates = 0;
+  for (int r = 0; r < repeat; ++r) {
+    replay.prefetch(from, to - from);
+    for (int i = from; i < to; ++i) {
+      const ReplayFrameMeta &meta = replay.meta(i);
+      if (configPath.empty()) {
+        pipeline.setThresholds({meta.h_min, meta.h_max, meta.s_min, meta.s_max,
+                                meta.v_min, meta.v_max});
+      }
+      pipeline.setDisplayMode(static_cast<DisplayMode>(mode >= 0 ? mode : meta.mode));
+      pipeline.setInput(replay.frame(i), replay.pixelFormat());
+
+      int64_t start = getTimeNs();
+      const std::vector<TargetInfo> *result;
+      if (streamRows > 0) {
+        int rows = replay.height();
+        pipeline.beginFrame(meta.timestamp_ns);
+        for (int row = 0; row + streamRows < rows; row += streamRows) {
+          pipeline.rowsReady(row, streamRows);
+        }
+        // The last batch is what the caller still waits for after its final
+        // pixel arrives
+        int64_t lastRows = getTimeNs();
+        int first = (rows - 1) / streamRows * streamRows;
+        pipeline.rowsReady(first, rows - first);
+        result = &pipeline.finishFrame();
+        tailSamples.push_back(getTimeNs() - lastRows);
+      } else {
+        result = &pipeline.process(meta.timestamp_ns);
+      }
+      samples.push_back(getTimeNs() - start);
+      const auto &targets = *result;
+
+      ++framesAtLevel[pipeline.frameLevel()];
+      for (int stage = 0; stage < NUM_STAGES; ++stage) {
+        stageNs[stage] += pipeline.stageTimer().stageNs(Stage(stage));
+        stageCounts[stage] += pipeline.stageTimer().stageCounts(Stage(stage));
+      }
+      if (pipeline.frameSkipped()) {
+        // Its targets are the previous frame's
+        if (r == 0) {
+          ++skippedFrames;
+          if (dump) {
+            printf("frame %d: skipped\n", i);
+          }
+        }
+        continue;
+      }
+      if (r == 0) {
+        totalTargets += targets.size();
+        totalCandidates += pipeline.candidates().size();
+        totalBlobs += pipeline.candidates().size() + pipeline.rejected().size();
+      }
+      if (dump && r == 0) {
+        printf("frame %d: %d targets (expected %d)\n", i, int(targets.size()),
+               meta.num_expected);
+        for (const auto &target : targets) {
+          printf("  type %d at %.1f, %.1f size %.1f x %.1f ratio %.3f\n",
+                 target.type, target.centroid_x, target.centroid_y,
+                 target.width, target.height, target.leftToRightRatio);
+        }
+      }
+    }
+  }
+
+  int frames = to - from;
+  int processed = std::max(1, frames - skippedFrames);
+  printf("blobs/frame %.1f  candidates/frame %.1f\n",
+         double(totalBlobs) / processed, double(totalCandidates) / processed);
+  TimingSummary summary = summarize(samples);
+  printf("frames %d  targets %d  mean %.3f ms  median %.3f ms  p99 %.3f ms  "
+         "max %.3f ms  (%.1f fps)\n",
+         summary.count, totalTargets, summary.mean_ms, summary.median_ms,
+         summary.p99_ms, summary.max_ms,
+         summary.mean_ms > 0 ? 1000.0 / summary.mean_ms : 0.0);
+  if (streamRows > 0) {
+    TimingSummary tail = summarize(tailSamples);
+    printf("after last batch: mean %.3f ms  median %.3f ms  p99 %.3f ms  "
+           "max %.3f ms\n",
+           tail.mean_ms, tail.median_ms, tail.p99_ms, tail.max_ms);
+  }
+  if (counters) {
+    static const char *kStageNames[NUM_STAGES] = {"threshold", "blobs", "match", "render"};
+    int64_t runs = int64_t(frames) * repeat;
+    double pixels = double(runs) * replay.width() * replay.height();
+    if (!countersAvailable) {
+      printf("hardware counters unavailable, stage times only\n");
+    }
+    for (int stage = 0; stage < NUM_STAGES; ++stage) {
+      const PerfCounts &c = stageCounts[stage];
+      printf("%-10s %8.3f ms/frame", kStageNames[stage], stageNs[stage] / 1e6 / runs);
+      if (countersAvailable) {
+        printf("  IPC %.2f  cache misses/px %.4f  branch misses/px %.4f",
+               c.ipc(), c.cache_misses / pixels, c.branch_misses / pixels);
+      }
+      printf("\n");
+    }
+  }
+  if (budgetMs > 0) {
+    printf("budget %.1f ms  misses %lld  frames per level:", budgetMs,
+           (long long)pipeline.budgetMisses());
+    for (int level = 0; level < NUM_GOVERNOR_LEVELS; ++level) {
+      printf(" %d", framesAtLevel[level]);
+    }
+    printf("  skipped %d\n", skippedFrames);
+  }
+  return 0;
+}
@@ -0,0 +1,185 @@
+// Builds .vrpl replay files from directories of PNG frames.
+//
+//   replay_convert png <dir> <out.vrpl> [h_min h_max s_min s_max v_min v_max]
+//       Every *.png in dir, in name order, with the given thresholds.
+//   replay_convert recorder <dir> <out.vrpl>
+//       A flight recorder dump. Thresholds, mode and timestamps come from
+//       frames.csv; the targets found on the phone become the expected ones.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "../replay_format.hpp"
+#include "../vision_pipeline.hpp"
+
+static int usage() {
+  fprintf(stderr,
+          "usage: replay_convert png <dir> <out.vrpl> [h_min h_max s_min s_max v_min v_max]\n"
+          "       replay_convert recorder <dir> <out.vrpl>\n");
+  return 2;
+}
+
+static std::vector<std::string> listPngs(const std::string &dir) {
+  std::vector<std::string> names;
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return names;
+  }
+  while (struct dirent *entry = readdir(d)) {
+    std::string name = entry->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".png") == 0) {
+      names.push_back(name);
+    }
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+// Parses "type:cx:cy:w:h:ratio;..." as written by the flight recorder
+static void parseTargets(const char *field, ReplayFrameMeta *meta) {
+  meta->num_expected = 0;
+  while (*field != '\0' && *field != '\n' && meta->num_expected < kMaxReplayTargets) {
+    ReplayTarget &target = meta->expected[meta->num_expected];
+    int consumed = 0;
+    if (sscanf(field, "%d:%f:%f:%f:%f:%f%n", &target.type, &target.centroid_x,
+               &target.centroid_y, &target.width, &target.height,
+               &target.leftToRightRatio, &consumed) != 6) {
+      break;
+    }
+    meta->num_expected++;
+    field += consumed;
+    if (*field == ';') {
+      field++;
+    }
+  }
+}
+
+struct Entry {
+  std::string file;
+  ReplayFrameMeta meta;
+};
+
+static bool readRecorderCsv(const std::string &dir, std::vector<Entry> *entries) {
+  FILE *csv = fopen((dir + "/frames.csv").c_str(), "r");
+  if (csv == nullptr) {
+    fprintf(stderr, "No frames.csv in %s\n", dir.c_str());
+    return false;
+  }
+  char line[4096];
+  bool header = true;
+  while (fgets(line, sizeof(line), csv) != nullptr) {
+    if (header) {
+      header = false;
+      continue;
+    }
+    Entry entry;
+    memset(&entry.meta, 0, sizeof(entry.meta));
+    char file[256];
+    long long timestamp;
+    int consumed = 0;
+    ReplayFrameMeta &m = entry.meta;
+    int n = sscanf(line, "%255[^,],%lld,%d,%d,%d,%d,%d,%d,%d,%*d,%n", file,
+                   &timestamp, &m.h_min, &m.h_max, &m.s_min, &m.s_max,
+                   &m.v_min, &m.v_max, &m.mode, &consumed);
+    if (n != 9 || consumed == 0) {
+      fprintf(stderr, "Skipping malformed line: %s", line);
+      continue;
+    }
+    m.timestamp_ns = timestamp;
+    parseTargets(line + consumed, &m);
+    entry.file = file;
+    entries->push_back(entry);
+  }
+  fclose(csv);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    return usage();
+  }
+  std::string kind = argv[1];
+  std::string dir = argv[2];
+  std::string out = argv[3];
+
+  std::vector<Entry> entries;
+  if (kind == "png") {
+    int thresholds[6] = {0, 255, 0, 255, 0, 255};
+    if (argc == 10) {
+      for (int i = 0; i < 6; ++i) {
+        thresholds[i] = atoi(argv[4 + i]);
+      }
+    } else if (argc != 4) {
+      return usage();
+    }
+    int64_t timestamp = 0;
+    for (const auto &name : listPngs(dir)) {
+      Entry entry;
+      memset(&entry.meta, 0, sizeof(entry.meta));
+      entry.file = name;
+      entry.meta.timestamp_ns = timestamp;
+      entry.meta.h_min = thresholds[0];
+      entry.meta.h_max = thresholds[1];
+      entry.meta.s_min = thresholds[2];
+      entry.meta.s_max = thresholds[3];
+      entry.meta.v_min = thresholds[4];
+      entry.meta.v_max = thresholds[5];
+      entry.meta.mode = DISP_MODE_TARGETS_PLUS;
+      entries.push_back(entry);
+      timestamp += 1000000000LL / 30;
+    }
+  } else if (kind == "recorder") {
+    if (argc != 4 || !readRecorderCsv(dir, &entries)) {
+      return usage();
+    }
+  } else {
+    return usage();
+  }
+  if (entries.empty()) {
+    fprintf(stderr, "No frames found in %s\n", dir.c_str());
+    return 1;
+  }
+
+  ReplayWriter writer;
+  cv::Mat rgba;
+  for (const auto &entry : entries) {
+    cv::Mat image = cv::imread(dir + "/" + entry.file, cv::IMREAD_UNCHANGED);
+    if (image.empty()) {
+      fprintf(stderr, "Could not read %s\n", entry.file.c_str());
+      return 1;
+    }
+    // Frames on disk are BGR(A); the pipeline sees RGBA, as from glReadPixels
+    if (image.channels() == 4) {
+      cv::cvtColor(image, rgba, CV_BGRA2RGBA);
+    } else if (image.channels() == 3) {
+      cv::cvtColor(image, rgba, CV_BGR2RGBA);
+    } else {
+      cv::cvtColor(image, rgba, CV_GRAY2RGBA);
+    }
+    if (writer.frameCount() == 0 &&
+        !writer.open(out, PIXEL_RGBA, rgba.cols, rgba.rows)) {
+      return 1;
+    }
+    if (!writer.append(rgba, entry.meta)) {
+      fprintf(stderr, "Could not add %s\n", entry.file.c_str());
+      return 1;
+    }
+  }
+  uint64_t count = writer.frameCount();
+  if (!writer.close()) {
+    fprintf(stderr, "Could not finish %s\n", out.c_str());
+    return 1;
+  }
+  printf("Wrote %llu frames to %s\n", (unsigned long long)count, out.c_str());
+  return 0;
+}
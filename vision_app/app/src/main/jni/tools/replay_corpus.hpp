@@ -0,0 +1,44 @@
+#pragma once
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Corpus arguments shared by auto_tune and batch_eval: .vrpl files and
+// directories of them. Appends the files in argument order, each directory's
+// in name order. Prints the problem and returns false on a missing path.
+static inline bool listReplayFiles(const std::vector<std::string> &args,
+                                   std::vector<std::string> *files) {
+  for (const auto &arg : args) {
+    struct stat st;
+    if (stat(arg.c_str(), &st) != 0) {
+      fprintf(stderr, "No such file %s\n", arg.c_str());
+      return false;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+      files->push_back(arg);
+      continue;
+    }
+    std::vector<std::string> names;
+    DIR *d = opendir(arg.c_str());
+    if (d == nullptr) {
+      fprintf(stderr, "Could not open %s\n", arg.c_str());
+      return false;
+    }
+    while (struct dirent *entry = readdir(d)) {
+      size_t n = strlen(entry->d_name);
+      if (n > 5 && strcmp(entry->d_name + n - 5, ".vrpl") == 0) {
+        names.push_back(arg + "/" + entry->d_name);
+      }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    files->insert(files->end(), names.begin(), names.end());
+  }
+  return true;
+}
@@ -0,0 +1,83 @@
+// Stands in for the robot end of RobotConnection: accepts the phone on
+// port 3061, answers heartbeats and reports how stale the target updates are
+// when they arrive. Run it on a Linux box and point the phone at it with
+// `adb reverse tcp:3061 tcp:3061`.
+//
+//   robot_standin [--port N] [--seconds N] [--reply-delay MS]
+//                 [--read-delay MS] [--stall EVERY_MS:MS]
+//                 [--disconnect-every MS] [--rcvbuf BYTES]
+//
+// --reply-delay holds heartbeat replies back. --read-delay sleeps after
+// every message, so the robot reads slower than the phone sends; --stall
+// stops reading altogether for a while. Both back the link up the way a slow
+// or lossy link does. --rcvbuf shrinks the kernel receive buffer so the
+// backpressure reaches the phone quickly instead of piling up in the socket.
+// --disconnect-every drops the phone periodically to exercise reconnects.
+//
+// Every second it prints the targets received and their capturedAgoMs, which
+// the phone computes right before writing. That includes the time the update
+// waited on the phone, but not the time it spent in the socket; link_rig
+// measures the whole trip.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "../common.hpp"
+#include "../standin_server.hpp"
+#include "bench_stats.hpp"
+#include "link_options.hpp"
+
+static int usage() {
+  fprintf(stderr, "usage: robot_standin [--port N] [--seconds N] " STANDIN_OPTIONS_USAGE "\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  int port = 3061, seconds = 0;
+  StandinConfig config = kDefaultStandinConfig;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    bool bad = false;
+    if (arg == "--port" && hasValue) {
+      port = atoi(argv[++i]);
+    } else if (arg == "--seconds" && hasValue) {
+      seconds = atoi(argv[++i]);
+    } else if (!parseStandinOption(argc, argv, &i, &config, &bad) || bad) {
+      return usage();
+    }
+  }
+
+  StandinServer server;
+  if (!server.start(port, config)) {
+    return 1;
+  }
+  printf("listening on port %d\n", server.port());
+
+  std::vector<StandinArrival> arrivals;
+  std::vector<int64_t> ages;
+  int connections = 0, heartbeats = 0;
+  for (int s = 0; seconds == 0 || s < seconds; ++s) {
+    sleep(1);
+    arrivals.clear();
+    server.takeArrivals(&arrivals);
+    ages.clear();
+    for (const auto &arrival : arrivals) {
+      ages.push_back(int64_t(arrival.captured_ago_ms * 1e6));
+    }
+    TimingSummary age = summarize(ages);
+    printf("targets %3d  capturedAgo median %.0f ms  p99 %.0f ms  max %.0f ms"
+           "  heartbeats %d  connections %d\n",
+           age.count, age.median_ms, age.p99_ms, age.max_ms,
+           server.heartbeats() - heartbeats, server.connections() - connections);
+    fflush(stdout);
+    heartbeats = server.heartbeats();
+    connections = server.connections();
+  }
+  server.stop();
+  return 0;
+}
@@ -0,0 +1,280 @@
+// Renders synthetic 2017 peg scenes into a replay file, with the true target
+// stored as each frame's expected target, for accuracy and scaling tests that
+// recorded footage can't cover.
+//
+//   scene_gen <out.vrpl> [--size WxH] [--distance IN[:IN:STEP]]
+//             [--yaw DEG[:DEG:STEP]] [--offset X,Y] [--split IN]
+//             [--blur SIGMA] [--distractors N[:N:STEP]] [--noise SIGMA]
+//             [--gradient G] [--frames N] [--seed S] [--evaluate]
+//             [--level full|no_vis|decimated|roi_only]
+//
+// --distance, --yaw and --distractors take a single value or a sweep; every
+// combination gets --frames frames (1 by default), each with its own clutter
+// and noise. --offset moves the target center off the optical axis (inches),
+// --split hides that many inches in the middle of the right strip, as the
+// peg does when seen from the side. Distractors are target-colored strips
+// sized to pass the blob filters, so they all become candidates.
+//
+// Besides the replay file, <out>.truth.csv lists every frame's scene
+// parameters and true target box. --evaluate also runs the pipeline on each
+// frame and reports, per sweep point, how often the peg was found, the error
+// of the app's distance estimate (6329.113924 / width) and the time spent
+// pairing, e.g. --distractors 0:500:50 to see how pairing scales.
+// --level holds the latency governor at one level for the evaluation, so
+// e.g. --distance 120:360:60 --level decimated shows whether distant pegs
+// survive the half-resolution detection.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "../common.hpp"
+#include "../replay_format.hpp"
+#include "../vision_pipeline.hpp"
+#include "bench_stats.hpp"
+#include "synthetic_scene.hpp"
+
+// VisionTrackerGLSurfaceView's distance constant, for 640 px wide frames
+static const double kAppDistanceConstant = 6329.113924;
+
+static const char *kLevelNames[] = {"full", "no_vis", "decimated", "roi_only"};
+
+struct Sweep {
+  double first, last, step;
+};
+
+static bool parseSweep(const char *text, Sweep *sweep) {
+  int n = sscanf(text, "%lf:%lf:%lf", &sweep->first, &sweep->last, &sweep->step);
+  if (n == 1) {
+    sweep->last = sweep->first;
+    sweep->step = 1;
+    return true;
+  }
+  return n == 3 && sweep->step > 0 && sweep->last >= sweep->first;
+}
+
+static std::vector<double> sweepValues(const Sweep &sweep) {
+  std::vector<double> values;
+  // Half a step of slack so 0:500:50 includes 500 despite rounding
+  for (double v = sweep.first; v <= sweep.last + sweep.step / 2; v += sweep.step) {
+    values.push_back(v);
+  }
+  return values;
+}
+
+// Results of one sweep point
+struct PointStats {
+  int frames = 0;
+  int visible = 0;
+  int found = 0;
+  double distance_error_sum = 0;  // |estimate - truth| / truth
+  double centroid_error_sum = 0;  // px
+  int64_t candidates = 0;
+  std::vector<int64_t> match_ns;
+  std::vector<int64_t> frame_ns;
+};
+
+static void printStats(double distractors, double distance, double yaw,
+                       const PointStats &s) {
+  TimingSummary match = summarize(s.match_ns);
+  TimingSummary frame = summarize(s.frame_ns);
+  printf("%11.0f %8.1f %6.1f %7.1f %7.1f%% %9.2f%% %8.2f %10.4f %9.3f\n", distractors,
+         distance, yaw, double(s.candidates) / s.frames,
+         s.visible > 0 ? 100.0 * s.found / s.visible : 0.0,
+         s.found > 0 ? 100 * s.distance_error_sum / s.found : 0.0,
+         s.found > 0 ? s.centroid_error_sum / s.found : 0.0, match.median_ms,
+         frame.median_ms);
+}
+
+static int usage() {
+  fprintf(stderr,
+          "usage: scene_gen <out.vrpl> [--size WxH] [--distance IN[:IN:STEP]] "
+          "[--yaw DEG[:DEG:STEP]] [--offset X,Y] [--split IN] [--blur SIGMA] "
+          "[--distractors N[:N:STEP]] [--noise SIGMA] [--gradient G] [--frames N] "
+          "[--seed S] [--evaluate] [--level full|no_vis|decimated|roi_only]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    return usage();
+  }
+  std::string out = argv[1];
+  PegScene scene;
+  Sweep distances = {72, 72, 1}, yaws = {0, 0, 1}, distractors = {0, 0, 1};
+  int framesPerPoint = 1;
+  uint64_t seed = 3061;
+  bool evaluate = false;
+  int level = GOV_FULL;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--size" && hasValue) {
+      if (sscanf(argv[++i], "%dx%d", &scene.width, &scene.height) != 2 ||
+          scene.width <= 0 || scene.height <= 0) {
+        return usage();
+      }
+    } else if (arg == "--distance" && hasValue) {
+      if (!parseSweep(argv[++i], &distances) || distances.first <= 0) {
+        return usage();
+      }
+    } else if (arg == "--yaw" && hasValue) {
+      if (!parseSweep(argv[++i], &yaws)) {
+        return usage();
+      }
+    } else if (arg == "--distractors" && hasValue) {
+      if (!parseSweep(argv[++i], &distractors) || distractors.first < 0) {
+        return usage();
+      }
+    } else if (arg == "--offset" && hasValue) {
+      if (sscanf(argv[++i], "%lf,%lf", &scene.offset_x_in, &scene.offset_y_in) != 2) {
+        return usage();
+      }
+    } else if (arg == "--split" && hasValue) {
+      scene.split_in = atof(argv[++i]);
+    } else if (arg == "--blur" && hasValue) {
+      scene.blur_sigma = atof(argv[++i]);
+    } else if (arg == "--noise" && hasValue) {
+      scene.noise_sigma = atof(argv[++i]);
+    } else if (arg == "--gradient" && hasValue) {
+      scene.gradient = atof(argv[++i]);
+    } else if (arg == "--frames" && hasValue) {
+      framesPerPoint = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--seed" && hasValue) {
+      seed = strtoull(argv[++i], nullptr, 0);
+    } else if (arg == "--evaluate") {
+      evaluate = true;
+    } else if (arg == "--level" && hasValue) {
+      std::string name = argv[++i];
+      level = -1;
+      for (int l = 0; l < int(sizeof(kLevelNames) / sizeof(kLevelNames[0])); ++l) {
+        if (name == kLevelNames[l]) {
+          level = l;
+        }
+      }
+      if (level < 0) {
+        return usage();
+      }
+    } else {
+      return usage();
+    }
+  }
+
+  ReplayWriter writer;
+  if (!writer.open(out, PIXEL_RGBA, scene.width, scene.height)) {
+    return 1;
+  }
+  std::string truthPath = out + ".truth.csv";
+  FILE *truthCsv = fopen(truthPath.c_str(), "w");
+  if (truthCsv == nullptr) {
+    fprintf(stderr, "Could not write %s\n", truthPath.c_str());
+    return 1;
+  }
+  fprintf(truthCsv, "frame,distractors,distance_in,yaw_deg,offset_x_in,offset_y_in,"
+          "split_in,blur,noise,gradient,visible,box_x,box_y,box_w,box_h,left_to_right\n");
+
+  VisionPipeline pipeline;
+  pipeline.setDisplayMode(DISP_MODE_RAW);
+  pipeline.setThresholds(kSyntheticThresholds);
+  pipeline.pinGovernorLevel(static_cast<GovernorLevel>(level));
+  if (evaluate) {
+    printf("distractors distance    yaw  cands/f   found  dist err  cent px   match ms"
+           "  frame ms\n");
+  }
+
+  cv::Mat rgba;
+  int frame = 0;
+  for (double count : sweepValues(distractors)) {
+    for (double distance : sweepValues(distances)) {
+      for (double yaw : sweepValues(yaws)) {
+        scene.distractors = int(count);
+        scene.distance_in = distance;
+        scene.yaw_deg = yaw;
+        PointStats stats;
+        for (int k = 0; k < framesPerPoint; ++k, ++frame) {
+          cv::RNG rng(seed + frame);
+          PegTruth truth = renderPegScene(scene, rng, &rgba);
+
+          ReplayFrameMeta meta;
+          memset(&meta, 0, sizeof(meta));
+          meta.timestamp_ns = frame * (1000000000LL / 30);
+          meta.h_min = kSyntheticThresholds.h_min;
+          meta.h_max = kSyntheticThresholds.h_max;
+          meta.s_min = kSyntheticThresholds.s_min;
+          meta.s_max = kSyntheticThresholds.s_max;
+          meta.v_min = kSyntheticThresholds.v_min;
+          meta.v_max = kSyntheticThresholds.v_max;
+          meta.mode = DISP_MODE_RAW;
+          if (truth.visible) {
+            ReplayTarget &target = meta.expected[meta.num_expected++];
+            target.type = TARGET_PEG;
+            target.centroid_x = float(truth.box.x + truth.box.width / 2);
+            target.centroid_y = float(truth.box.y + truth.box.height / 2);
+            target.width = float(truth.box.width);
+            target.height = float(truth.box.height);
+            target.leftToRightRatio = float(truth.left_to_right);
+          }
+          if (!writer.append(rgba, meta)) {
+            fprintf(stderr, "Could not add frame %d\n", frame);
+            return 1;
+          }
+          fprintf(truthCsv, "%d,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.3f,%d,%.2f,%.2f,"
+                  "%.2f,%.2f,%.4f\n",
+                  frame, scene.distractors, scene.distance_in, scene.yaw_deg,
+                  scene.offset_x_in, scene.offset_y_in, scene.split_in, scene.blur_sigma,
+                  scene.noise_sigma, scene.gradient, truth.visible ? 1 : 0, truth.box.x,
+                  truth.box.y, truth.box.width, truth.box.height, truth.left_to_right);
+
+          if (!evaluate) {
+            continue;
+          }
+          pipeline.setInput(rgba, PIXEL_RGBA);
+          int64_t start = getTimeNs();
+          const auto &targets = pipeline.process(meta.timestamp_ns);
+          stats.frame_ns.push_back(getTimeNs() - start);
+          stats.match_ns.push_back(pipeline.stageTimer().stageNs(STAGE_MATCH));
+          stats.candidates += pipeline.candidates().size();
+          ++stats.frames;
+          if (!truth.visible) {
+            continue;
+          }
+          ++stats.visible;
+          // The peg closest to the true center, if any
+          double cx = truth.box.x + truth.box.width / 2;
+          double cy = truth.box.y + truth.box.height / 2;
+          const TargetInfo *best = nullptr;
+          double bestError = truth.box.width / 2;
+          for (const auto &target : targets) {
+            double error = hypot(target.centroid_x - cx, target.centroid_y - cy);
+            if (target.type == TARGET_PEG && error < bestError) {
+              best = &target;
+              bestError = error;
+            }
+          }
+          if (best != nullptr) {
+            ++stats.found;
+            double estimate = kAppDistanceConstant / (best->width * 640.0 / scene.width);
+            stats.distance_error_sum += std::fabs(estimate - distance) / distance;
+            stats.centroid_error_sum += bestError;
+          }
+        }
+        if (evaluate) {
+          printStats(count, distance, yaw, stats);
+        }
+      }
+    }
+  }
+
+  fclose(truthCsv);
+  if (!writer.close()) {
+    fprintf(stderr, "Could not finish %s\n", out.c_str());
+    return 1;
+  }
+  printf("Wrote %d frames to %s (truth in %s)\n", frame, out.c_str(), truthPath.c_str());
+  return 0;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+// Synthetic inputs for the benchmarks: frames that look roughly like a
+// lit retroreflective target against a noisy field, and candidate lists for
+// the matchers. Everything comes from a seeded cv::RNG, so a given seed and
+// size always produce the same input.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "../hsv_threshold.hpp"
+#include "../targets.hpp"
+
+// Inside the app's default thresholds (res/values/integers.xml)
+static const HsvThresholds kSyntheticThresholds = {79, 87, 123, 255, 50, 255};
+
+static inline cv::Scalar syntheticTargetRgba() {
+  cv::Mat hsv(1, 1, CV_8UC3, cv::Scalar(83, 200, 220)), rgb;
+  cv::cvtColor(hsv, rgb, CV_HSV2RGB);
+  cv::Vec3b c = rgb.at<cv::Vec3b>(0, 0);
+  return cv::Scalar(c[0], c[1], c[2], 255);
+}
+
+// Two peg targets (one split by the peg), a boiler, and speckles of target
+// color that the size and fullness filters should reject, over a noisy
+// background. Proportions follow the frame size so every size sees the same
+// scene.
+static inline void renderSyntheticFrame(int width, int height, uint64_t seed,
+                                        cv::Mat *rgba) {
+  cv::RNG rng(seed);
+  rgba->create(height, width, CV_8UC4);
+  rng.fill(*rgba, cv::RNG::UNIFORM, cv::Scalar(20, 20, 20, 255),
+           cv::Scalar(90, 80, 70, 256));
+  cv::Scalar color = syntheticTargetRgba();
+  double s = width / 640.0;
+  auto box = [&](double x, double y, double w, double h) {
+    cv::rectangle(*rgba, cv::Rect(int(x * s), int(y * s), std::max(1, int(w * s)),
+                                  std::max(1, int(h * s))),
+                  color, cv::FILLED);
+  };
+  // Peg: two 2" x 5" strips 8.25" apart (outer edges)
+  box(150, 200, 16, 40);
+  box(200, 200, 16, 40);
+  box(430, 180, 20, 22);  // split by the peg
+  box(430, 212, 20, 18);
+  box(490, 180, 20, 50);
+  // Boiler: 4" strip over a 2" strip
+  box(300, 60, 60, 16);
+  box(300, 84, 60, 8);
+  for (int i = 0; i < 40; ++i) {
+    box(rng.uniform(0, 630), rng.uniform(0, 470), rng.uniform(1, 4), rng.uniform(1, 4));
+  }
+}
+
+// count candidate strips as the blob extractor would report them: mostly
+// peg halves in pairs, some split in two, with a few boiler strips mixed in
+static inline std::vector<TargetInfo> syntheticCandidates(int count, uint64_t seed) {
+  cv::RNG rng(seed);
+  std::vector<TargetInfo> candidates;
+  auto add = [&](int x, int y, int w, int h) {
+    TargetInfo target;
+    target.box = cv::Rect(x, y, w, h);
+    target.centroid_x = x + w / 2.0;
+    target.centroid_y = y + h / 2.0;
+    target.width = w;
+    target.height = h;
+    candidates.push_back(target);
+  };
+  for (int i = 0; candidates.size() < size_t(count); ++i) {
+    int x = rng.uniform(0, 560), y = rng.uniform(0, 380);
+    int w = rng.uniform(12, 24), h = int(w * 2.5);
+    if (i % 5 == 4) {
+      add(x, y, 3 * w, w);
+      add(x, y + 2 * w, 3 * w, w / 2);
+    } else if (i % 3 == 2) {
+      add(x, y, w, h / 2 - 2);
+      add(x, y + h / 2 + 2, w, h / 2 - 2);
+    } else {
+      add(x, y, w, h);
+      add(x + int(w * 4.1), y, w, h);
+    }
+  }
+  candidates.resize(count);
+  return candidates;
+}
+
+// Focal length, in pixels at 640 wide, behind the distance estimate in
+// VisionTrackerGLSurfaceView: 6329.113924 / width is 617.5 px times the
+// 10.25" outer width of the peg target
+static const double kSceneFocalPx640 = 617.475;
+static const double kPegOuterWidthIn = 10.25;
+
+// A 2017 peg target seen by a pinhole camera, plus clutter. Target
+// coordinates are inches, camera frame: x right, y up, z forward.
+struct PegScene {
+  int width = 640, height = 480;
+  double distance_in = 72;  // to the center of the target
+  double yaw_deg = 0;       // rotation of the target about the vertical axis
+  double offset_x_in = 0;   // target center relative to the optical axis
+  double offset_y_in = 0;
+  double split_in = 0;      // height of the peg covering the right strip
+  double blur_sigma = 0;    // px
+  int distractors = 0;      // strip-like blobs that pass the blob filters
+  double noise_sigma = 0;   // per channel
+  double gradient = 0;      // brightness goes from 1 - gradient to 1 + gradient
+};
+
+// Ground truth of a rendered peg, in the terms the pipeline reports
+struct PegTruth {
+  bool visible;
+  cv::Rect2d box;       // of both strips together
+  double left_to_right; // area ratio of the strip boxes
+};
+
+static inline double sceneFocalPx(const PegScene &scene) {
+  return kSceneFocalPx640 * scene.width / 640.0;
+}
+
+// Projects target-plane point (u, v), in inches from the target center, to
+// pixels
+static inline cv::Point2d projectPeg(const PegScene &scene, double u, double v) {
+  double yaw = scene.yaw_deg * CV_PI / 180;
+  double x = scene.offset_x_in + u * std::cos(yaw);
+  double y = scene.offset_y_in + v;
+  double z = scene.distance_in + u * std::sin(yaw);
+  double f = sceneFocalPx(scene);
+  return cv::Point2d(scene.width / 2.0 + f * x / z, scene.height / 2.0 - f * y / z);
+}
+
+// Strip from u0 to u1, v0 to v1 as an antialiased quad
+static inline cv::Rect2d fillPegQuad(const PegScene &scene, cv::Mat *rgba, double u0,
+                                     double u1, double v0, double v1,
+                                     const cv::Scalar &color) {
+  const int kShift = 4;
+  cv::Point2d corners[4] = {projectPeg(scene, u0, v0), projectPeg(scene, u1, v0),
+                            projectPeg(scene, u1, v1), projectPeg(scene, u0, v1)};
+  cv::Point points[4];
+  double x0 = 1e9, y0 = 1e9, x1 = -1e9, y1 = -1e9;
+  for (int i = 0; i < 4; ++i) {
+    points[i] = cv::Point(cvRound(corners[i].x * (1 << kShift)),
+                          cvRound(corners[i].y * (1 << kShift)));
+    x0 = std::min(x0, corners[i].x);
+    x1 = std::max(x1, corners[i].x);
+    y0 = std::min(y0, corners[i].y);
+    y1 = std::max(y1, corners[i].y);
+  }
+  cv::fillConvexPoly(*rgba, points, 4, color, cv::LINE_AA, kShift);
+  return cv::Rect2d(x0, y0, x1 - x0, y1 - y0);
+}
+
+// Renders scene into rgba (CV_8UC4) with clutter from rng
+static inline PegTruth renderPegScene(const PegScene &scene, cv::RNG &rng, cv::Mat *rgba) {
+  const cv::Scalar kBackground(40, 40, 45, 255);
+  rgba->create(scene.height, scene.width, CV_8UC4);
+  rgba->setTo(kBackground);
+  cv::Scalar color = syntheticTargetRgba();
+
+  // Strips are 2" x 5", 8.25" apart center to center
+  PegTruth truth;
+  cv::Rect2d left = fillPegQuad(scene, rgba, -5.125, -3.125, -2.5, 2.5, color);
+  cv::Rect2d right = fillPegQuad(scene, rgba, 3.125, 5.125, -2.5, 2.5, color);
+  if (scene.split_in > 0) {
+    fillPegQuad(scene, rgba, 3.0, 5.25, -scene.split_in / 2, scene.split_in / 2,
+                kBackground);
+  }
+  truth.box = left | right;
+  truth.left_to_right = left.area() / right.area();
+  truth.visible = truth.box.x >= 0 && truth.box.y >= 0 &&
+                  truth.box.br().x <= scene.width && truth.box.br().y <= scene.height;
+
+  // Distractors go one per cell of a grid, clear of the target, so they stay
+  // separate blobs and the candidate count is what was asked for
+  if (scene.distractors > 0) {
+    cv::Rect keepOut(cv::Point(int(truth.box.x) - 8, int(truth.box.y) - 8),
+                     cv::Point(int(truth.box.br().x) + 8, int(truth.box.br().y) + 8));
+    int cols = int(std::ceil(std::sqrt(scene.distractors * 1.3 * scene.width / scene.height)));
+    std::vector<cv::Rect> cells;
+    while (true) {
+      int rows = std::max(1, cols * scene.height / scene.width);
+      int cw = scene.width / cols, ch = scene.height / rows;
+      cells.clear();
+      for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+          cv::Rect cell(c * cw, r * ch, cw, ch);
+          if ((cell & keepOut).area() == 0) {
+            cells.push_back(cell);
+          }
+        }
+      }
+      if (int(cells.size()) >= scene.distractors || cw < 10 || ch < 10) {
+        break;
+      }
+      ++cols;
+    }
+    for (size_t i = cells.size(); i > 1; --i) {
+      std::swap(cells[i - 1], cells[rng.uniform(0, int(i))]);
+    }
+    int count = std::min(scene.distractors, int(cells.size()));
+    for (int i = 0; i < count; ++i) {
+      const cv::Rect &cell = cells[i];
+      // At least the blob extractor's minimum size, with a 2 px gap
+      int w = rng.uniform(4, std::max(5, std::min(cell.width - 3, 24)));
+      int h = rng.uniform(5, std::max(6, std::min(cell.height - 3, 4 * w)));
+      int x = cell.x + 1 + rng.uniform(0, std::max(1, cell.width - w - 2));
+      int y = cell.y + 1 + rng.uniform(0, std::max(1, cell.height - h - 2));
+      cv::rectangle(*rgba, cv::Rect(x, y, w, h), color, cv::FILLED);
+    }
+  }
+
+  if (scene.blur_sigma > 0) {
+    cv::GaussianBlur(*rgba, *rgba, cv::Size(0, 0), scene.blur_sigma);
+  }
+  if (scene.gradient != 0 || scene.noise_sigma > 0) {
+    cv::Mat light(scene.height, scene.width, CV_32FC4);
+    for (int x = 0; x < scene.width; ++x) {
+      float gain = float(1 - scene.gradient + 2 * scene.gradient * x / scene.width);
+      light.col(x).setTo(cv::Scalar(gain, gain, gain, 1));
+    }
+    cv::Mat pixels;
+    rgba->convertTo(pixels, CV_32FC4);
+    pixels = pixels.mul(light);
+    if (scene.noise_sigma > 0) {
+      cv::Mat noise(scene.height, scene.width, CV_32FC4);
+      rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0),
+               cv::Scalar(scene.noise_sigma, scene.noise_sigma, scene.noise_sigma, 0));
+      pixels += noise;
+    }
+    pixels.convertTo(*rgba, CV_8UC4);
+  }
+  return truth;
+}
@@ -0,0 +1,155 @@
+// Runs detection on frames from any FrameSource and writes the targets found
+// as one JSON object per line on stdout, so it can sit in a shell pipeline
+// between whatever produces frames and whatever consumes targets.
+//
+//   vision_detect <source> [--thresholds HMIN HMAX SMIN SMAX VMIN VMAX]
+//                 [--matchers MASK] [--blobs contours|runs|tiled]
+//                 [--morph OP[:WxH]] [--config FILE] [--limit N]
+//
+// <source> is one of dir:PATH[:WxH], pipe:WxH[:nv21][:ts], video:PATH or
+// replay:PATH (see frame_source.hpp). --config reads detection parameters in
+// the pipeline_config.hpp text format, as the app reads pipeline.cfg;
+// --thresholds overrides the file's. Replay files use their recorded
+// thresholds unless --thresholds or --config is given; everything else uses
+// the app's defaults. Each line is flushed as soon as the frame is done, e.g.
+//
+//   {"frame":0,"timestamp_ns":0,"process_ms":1.92,"targets":[{"type":0,...}]}
+//
+// A timing summary goes to stderr at the end.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "../common.hpp"
+#include "../frame_source.hpp"
+#include "../pipeline_config.hpp"
+#include "../vision_pipeline.hpp"
+#include "bench_stats.hpp"
+
+// res/values/integers.xml
+static const HsvThresholds kAppThresholds = {79, 87, 123, 255, 50, 255};
+
+static int usage() {
+  fprintf(stderr,
+          "usage: vision_detect <dir:PATH[:WxH] | pipe:WxH[:nv21][:ts] | "
+          "video:PATH | replay:PATH> [--thresholds HMIN HMAX SMIN SMAX VMIN VMAX] "
+          "[--matchers MASK] [--blobs contours|runs|tiled] [--morph OP[:WxH]] "
+          "[--config FILE] [--limit N]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    return usage();
+  }
+  HsvThresholds thresholds = kAppThresholds;
+  bool thresholdsGiven = false;
+  int matchers = kDefaultMatchers;
+  BlobExtraction blobs = BLOB_CONTOURS;
+  MorphConfig morph = {MORPH_OP_NONE, 3, 3};
+  std::string configPath;
+  long limit = -1;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--thresholds" && i + 6 < argc) {
+      thresholds = {atoi(argv[i + 1]), atoi(argv[i + 2]), atoi(argv[i + 3]),
+                    atoi(argv[i + 4]), atoi(argv[i + 5]), atoi(argv[i + 6])};
+      thresholdsGiven = true;
+      i += 6;
+    } else if (arg == "--matchers" && hasValue) {
+      matchers = strtol(argv[++i], nullptr, 0);
+    } else if (arg == "--blobs" && hasValue) {
+      std::string method = argv[++i];
+      if (method == "runs") {
+        blobs = BLOB_RUNS;
+      } else if (method == "tiled") {
+        blobs = BLOB_TILED;
+      } else if (method != "contours") {
+        return usage();
+      }
+    } else if (arg == "--morph" && hasValue) {
+      if (!parseMorphology(argv[++i], &morph)) {
+        return usage();
+      }
+    } else if (arg == "--config" && hasValue) {
+      configPath = argv[++i];
+    } else if (arg == "--limit" && hasValue) {
+      limit = atol(argv[++i]);
+    } else {
+      return usage();
+    }
+  }
+
+  PipelineConfig config = defaultPipelineConfig();
+  config.thresholds = kAppThresholds;
+  if (!configPath.empty()) {
+    std::string error;
+    if (!loadPipelineConfig(configPath, &config, &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+  }
+  if (thresholdsGiven) {
+    config.thresholds = thresholds;
+  }
+  bool recordedThresholds = !thresholdsGiven && configPath.empty();
+
+  std::unique_ptr<FrameSource> source = openFrameSource(argv[1]);
+  if (!source) {
+    return 1;
+  }
+  ReplaySource *replay = dynamic_cast<ReplaySource *>(source.get());
+
+  VisionPipeline pipeline;
+  pipeline.setEnabledMatchers(matchers);
+  pipeline.setBlobExtraction(blobs);
+  pipeline.setMorphology(morph);
+  // Only the targets are wanted; the raw view skips overlay drawing
+  pipeline.setDisplayMode(DISP_MODE_RAW);
+  pipeline.setConfig(config);
+
+  std::vector<int64_t> samples;
+  long frame = 0, totalTargets = 0;
+  int64_t timestamp;
+  while ((limit < 0 || frame < limit) && source->next(&pipeline, &timestamp)) {
+    if (replay != nullptr && recordedThresholds) {
+      const ReplayFrameMeta &meta = replay->meta();
+      pipeline.setThresholds({meta.h_min, meta.h_max, meta.s_min, meta.s_max,
+                              meta.v_min, meta.v_max});
+    }
+    int64_t start = getTimeNs();
+    const auto &targets = pipeline.process(timestamp);
+    int64_t elapsed = getTimeNs() - start;
+    samples.push_back(elapsed);
+    totalTargets += targets.size();
+
+    printf("{\"frame\":%ld,\"timestamp_ns\":%lld,\"process_ms\":%.3f,\"targets\":[",
+           frame, (long long)timestamp, elapsed / 1e6);
+    for (size_t t = 0; t < targets.size(); ++t) {
+      const TargetInfo &target = targets[t];
+      printf("%s{\"type\":%d,\"x\":%.2f,\"y\":%.2f,\"width\":%.2f,\"height\":%.2f,"
+             "\"ratio\":%.4f}",
+             t > 0 ? "," : "", target.type, target.centroid_x, target.centroid_y,
+             target.width, target.height, target.leftToRightRatio);
+    }
+    printf("]}\n");
+    fflush(stdout);
+    ++frame;
+  }
+
+  if (frame == 0) {
+    fprintf(stderr, "%s: no frames\n", argv[1]);
+    return 1;
+  }
+  TimingSummary summary = summarize(samples);
+  fprintf(stderr, "%s: frames %ld %dx%d  targets %ld  mean %.3f ms  median %.3f ms  "
+          "p99 %.3f ms  max %.3f ms\n",
+          argv[1], frame, source->width(), source->height(), totalTargets,
+          summary.mean_ms, summary.median_ms, summary.p99_ms, summary.max_ms);
+  return 0;
+}
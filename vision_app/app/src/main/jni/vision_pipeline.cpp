@@ -0,0 +1,443 @@
+#include "vision_pipeline.hpp"
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "blob_extractor.hpp"
+#include "common.hpp"
+#include "frame_shape.hpp"
+#include "target_drawing.hpp"
+
+VisionPipeline::VisionPipeline()
+    : config_channel_(&own_config_),
+      config_(own_config_.acquire()),
+      config_version_(config_->version),
+      mode_(DISP_MODE_TARGETS_PLUS),
+      enabled_matchers_(kDefaultMatchers),
+      blob_extraction_(BLOB_CONTOURS),
+      morphology_{MORPH_OP_NONE, 3, 3},
+      input_format_(PIXEL_RGBA),
+      input_owned_(true),
+      blobs_ready_(false),
+      packed_frame_(false),
+      streaming_rows_(0),
+      frame_timestamp_ns_(0),
+      full_frame_(true),
+      frame_level_(GOV_FULL),
+      frame_skipped_(false) {
+}
+
+VisionPipeline::~VisionPipeline() {
+  stopMaskRecording();
+}
+
+void VisionPipeline::setLatencyTarget(int64_t target_ns) {
+  GovernorConfig config = kDefaultGovernorConfig;
+  config.target_ns = target_ns;
+  governor_.configure(config);
+}
+
+void VisionPipeline::enableFlightRecorder(int width, int height, int frames) {
+  // Free the old ring first so two are never allocated at once
+  recorder_.reset();
+  recorder_.reset(new FlightRecorder(width, height, frames));
+}
+
+bool VisionPipeline::startMaskRecording(const std::string &path, int width,
+                                        int height) {
+  stopMaskRecording();
+  mask_recorder_.reset(new MaskRecorder());
+  if (!mask_recorder_->start(path, width, height)) {
+    mask_recorder_.reset();
+    return false;
+  }
+  return true;
+}
+
+void VisionPipeline::stopMaskRecording() {
+  // Up to a second of masks may still be queued; they are written out
+  // without holding up this thread
+  stopInBackground(std::move(mask_recorder_));
+}
+
+cv::Mat &VisionPipeline::inputBuffer(int width, int height) {
+  if (!input_owned_) {
+    // Don't let create() reuse someone else's memory
+    input_.release();
+    input_owned_ = true;
+  }
+  input_format_ = PIXEL_RGBA;
+  input_.create(height, width, CV_8UC4);
+  return input_;
+}
+
+void VisionPipeline::setInput(const cv::Mat &frame, PixelFormat format) {
+  input_ = frame;
+  input_format_ = format;
+  input_owned_ = false;
+}
+
+void VisionPipeline::setConfigChannel(ConfigChannel *channel) {
+  config_channel_ = channel != nullptr ? channel : &own_config_;
+  config_ = config_channel_->acquire();
+  config_version_ = config_->version;
+  matchers_.setParams(config_->peg, config_->boiler);
+}
+
+void VisionPipeline::setThresholds(const HsvThresholds &thresholds) {
+  PipelineConfig config = config_channel_->latest();
+  if (config.thresholds != thresholds) {
+    config.thresholds = thresholds;
+    config_channel_->publish(config);
+  }
+}
+
+// Picks up the newest snapshot; the frame uses it from start to finish
+void VisionPipeline::acquireConfig() {
+  config_ = config_channel_->acquire();
+  if (config_->version != config_version_) {
+    config_version_ = config_->version;
+    matchers_.setParams(config_->peg, config_->boiler);
+  }
+}
+
+const std::vector<TargetInfo> &VisionPipeline::process(int64_t timestamp_ns) {
+  timer_.begin();
+  acquireConfig();
+  frame_level_ = governor_.level();
+  frame_skipped_ = governor_.enabled() && !governor_.shouldProcess();
+  if (frame_skipped_) {
+    // Skipped by the governor: no detection and the raw frame shown. The
+    // last frame's targets stay, so the next one can look around them.
+    showRawFrame();
+    return targets_;
+  }
+
+  // Degraded levels detect on a smaller image and map the results back
+  cv::Mat source = input_;
+  double scale = 1;
+  cv::Point offset(0, 0);
+  if (frame_level_ >= GOV_DECIMATED && input_format_ == PIXEL_RGBA) {
+    cv::Rect roi;
+    if (frame_level_ >= GOV_ROI_ONLY && roiFromLastTargets(&roi)) {
+      source = input_(roi);
+      offset = roi.tl();
+    } else {
+      cv::resize(input_, decimated_, cv::Size(input_.cols / 2, input_.rows / 2),
+                 0, 0, cv::INTER_NEAREST);
+      source = decimated_;
+      scale = 2;
+    }
+  }
+  full_frame_ = source.size() == input_.size();
+
+  packed_frame_ = blob_extraction_ != BLOB_CONTOURS;
+  bool morph = morphology_.op != MORPH_OP_NONE;
+  bool recordRuns = mask_recorder_ && full_frame_;
+  blobs_ready_ = false;
+
+  if (blob_extraction_ == BLOB_TILED && input_format_ == PIXEL_RGBA) {
+    // Conversion and threshold fused per strip; with no morphology in the way
+    // runs and labeling happen in the same pass
+    if (morph) {
+      tiled_.threshold(source, config_->lut, &packed_);
+      if (recordRuns) {
+        runs_.clear();
+        packed_.extractRuns(&runs_);
+      }
+    } else {
+      tiled_.run(source, config_->lut, &packed_, &runs_, &blobs_);
+      blobs_ready_ = true;
+    }
+  } else {
+    // modify color scales
+    if (input_format_ == PIXEL_NV21) {
+      cv::cvtColor(source, hsv_, CV_YUV2RGB_NV21);
+    } else {
+      cv::cvtColor(source, hsv_, CV_RGBA2RGB);
+    }
+    cv::cvtColor(hsv_, hsv_, CV_RGB2HSV);
+
+    //Threshold image
+    if (packed_frame_) {
+      thresholdPacked(hsv_, config_->lut, &packed_);
+      if (!morph || recordRuns) {
+        runs_.clear();
+        packed_.extractRuns(&runs_);
+      }
+    } else {
+      const HsvThresholds &th = config_->thresholds;
+      cv::inRange(hsv_, cv::Scalar(th.h_min, th.s_min, th.v_min),
+                  cv::Scalar(th.h_max, th.s_max, th.v_max), thresh_);
+    }
+  }
+  timer_.mark(STAGE_THRESHOLD);
+
+  return completeFrame(timestamp_ns, scale, offset);
+}
+
+bool VisionPipeline::roiFromLastTargets(cv::Rect *roi) const {
+  if (targets_.empty()) {
+    return false;
+  }
+  cv::Rect area = targets_[0].box;
+  for (auto &target : targets_) {
+    area |= target.box;
+  }
+  // Leave room for the target to move by about its own size
+  int margin = std::max(area.width, area.height);
+  area.x -= margin;
+  area.y -= margin;
+  area.width += 2 * margin;
+  area.height += 2 * margin;
+  *roi = area & cv::Rect(0, 0, input_.cols, input_.rows);
+  return roi->area() > 0;
+}
+
+static void mapToFrame(std::vector<TargetInfo> *targets, double scale,
+                       cv::Point offset) {
+  for (auto &target : *targets) {
+    target.centroid_x = target.centroid_x * scale + offset.x;
+    target.centroid_y = target.centroid_y * scale + offset.y;
+    target.width *= scale;
+    target.height *= scale;
+    target.box = cv::Rect(int(target.box.x * scale) + offset.x,
+                          int(target.box.y * scale) + offset.y,
+                          int(target.box.width * scale),
+                          int(target.box.height * scale));
+  }
+}
+
+void VisionPipeline::beginFrame(int64_t timestamp_ns) {
+  timer_.begin();
+  // Rows arrive full size, so only the visualization can be shed here
+  frame_level_ = std::min(governor_.level(), GOV_NO_VIS);
+  frame_skipped_ = false;
+  full_frame_ = true;
+  frame_timestamp_ns_ = timestamp_ns;
+  acquireConfig();
+  streaming_.begin(input_.cols, input_.rows, config_->lut);
+}
+
+void VisionPipeline::rowsReady(int first, int count) {
+  streaming_.pushRows(first, count, input_.ptr<uint8_t>(first), input_.step);
+}
+
+const std::vector<TargetInfo> &VisionPipeline::finishFrame() {
+  if (!streaming_.finish()) {
+    // Some rows never came; the buffer may still be complete, so fall back
+    // to the whole-frame path rather than report nothing
+    return process(frame_timestamp_ns_);
+  }
+  packed_frame_ = true;
+  // The detector refills its mask from scratch, so trading buffers is safe
+  std::swap(packed_, streaming_.mask());
+  runs_ = streaming_.runs();
+  blobs_ = streaming_.blobs();
+  // cleanMask() drops these again if morphology changes the mask
+  blobs_ready_ = true;
+  timer_.mark(STAGE_THRESHOLD);
+  return completeFrame(frame_timestamp_ns_, 1, cv::Point(0, 0));
+}
+
+void VisionPipeline::recordMask(int64_t timestamp_ns) {
+  MaskFrameHeader header;
+  header.timestamp_ns = timestamp_ns;
+  header.h_min = config_->thresholds.h_min;
+  header.h_max = config_->thresholds.h_max;
+  header.s_min = config_->thresholds.s_min;
+  header.s_max = config_->thresholds.s_max;
+  header.v_min = config_->thresholds.v_min;
+  header.v_max = config_->thresholds.v_max;
+  if (packed_frame_) {
+    mask_recorder_->record(runs_, header);
+  } else {
+    mask_recorder_->record(thresh_, header);
+  }
+}
+
+// Everything after thresholding, shared by process() and finishFrame().
+// scale and offset map detection coordinates back to the input frame.
+const std::vector<TargetInfo> &VisionPipeline::completeFrame(int64_t timestamp_ns,
+                                                            double scale,
+                                                            cv::Point offset) {
+  // Recordings keep the mask from before cleanup, so replay can try other
+  // morphology settings
+  if (mask_recorder_ && full_frame_) {
+    recordMask(timestamp_ns);
+  }
+
+  // Only the threshold display needs the mask as an image
+  cleanMask(mode_ == DISP_MODE_THRESH && frame_level_ < GOV_NO_VIS);
+
+  findTargets(scale);
+  if (scale != 1 || offset != cv::Point(0, 0)) {
+    mapToFrame(&target_parts_, scale, offset);
+    mapToFrame(&rejected_targets_, scale, offset);
+    mapToFrame(&targets_, scale, offset);
+  }
+
+  // write back
+  if (frame_level_ >= GOV_NO_VIS) {
+    showRawFrame();
+  } else {
+    renderVisualization();
+  }
+  timer_.mark(STAGE_RENDER);
+
+  if (recorder_ && input_owned_) {
+    FrameRecord record;
+    record.timestamp_ns = timestamp_ns;
+    record.h_min = config_->thresholds.h_min;
+    record.h_max = config_->thresholds.h_max;
+    record.s_min = config_->thresholds.s_min;
+    record.s_max = config_->thresholds.s_max;
+    record.v_min = config_->thresholds.v_min;
+    record.v_max = config_->thresholds.v_max;
+    record.mode = mode_;
+    record.setTargets(targets_);
+    // Swaps buffers rather than copying; input_ is refilled by the next
+    // readback. The overlays drawn on it come off again when it is saved.
+    recorder_->record(input_, record, &overlay_undo_);
+  }
+
+  governor_.update(timer_.elapsedNs());
+  return targets_;
+}
+
+const std::vector<TargetInfo> &VisionPipeline::processMask(const RleMask &mask) {
+  acquireConfig();
+  blobs_ready_ = false;
+  packed_frame_ = blob_extraction_ != BLOB_CONTOURS;
+  if (packed_frame_) {
+    runs_ = mask.runs;
+    packed_.setRuns(runs_, mask.width, mask.height);
+  } else {
+    mask.decode(thresh_);
+  }
+  // The visualization below always shows the mask
+  cleanMask(true);
+  findTargets(1);
+
+  cv::cvtColor(thresh_, overlay_, CV_GRAY2RGBA);
+  vis_ = overlay_;
+  drawCandidates(vis_, target_parts_, rejected_targets_);
+  drawTargets(vis_, targets_);
+  return targets_;
+}
+
+// Calls cleanPackedMask() compiled for the frame's shape
+struct VisionPipeline::CleanPackedMask {
+  VisionPipeline *pipeline;
+
+  template <class Shape, class Visualize>
+  void operator()(const Shape &shape, Visualize visualize) {
+    pipeline->cleanPackedMask(shape, visualize);
+  }
+};
+
+// visualize: leave the cleaned mask in thresh_ for display
+void VisionPipeline::cleanMask(bool visualize) {
+  if (packed_frame_) {
+    CleanPackedMask clean = {this};
+    dispatchFrameShape(packed_.width, packed_.height, visualize, clean);
+  } else {
+    applyMorphology(morphology_, thresh_);
+  }
+}
+
+template <class Shape, class Visualize>
+void VisionPipeline::cleanPackedMask(const Shape &shape, Visualize) {
+  if (morphology_.op != MORPH_OP_NONE) {
+    morphology_runner_.apply(morphology_, shape, &packed_);
+    runs_.clear();
+    packed_.extractRuns(&runs_);
+    blobs_ready_ = false;
+  }
+  if (Visualize::value) {
+    packed_.unpack(shape, thresh_);
+  }
+}
+
+// scale is how much smaller than the input frame the mask is. The size
+// filter is in input pixels, so on a decimated mask it shrinks to match;
+// otherwise decimation would drop distant targets rather than just precision.
+void VisionPipeline::findTargets(double scale) {
+  CandidateFilter filter = config_->candidates;
+  if (scale != 1) {
+    filter.min_width /= scale;
+    filter.max_width /= scale;
+    filter.min_height /= scale;
+    filter.max_height /= scale;
+  }
+
+  // Blob extraction runs once, then every enabled matcher shares the result
+  targets_.clear();
+  target_parts_.clear();
+  rejected_targets_.clear();
+  if (packed_frame_) {
+    if (!blobs_ready_) {
+      labeler_.label(runs_, &blobs_);
+    }
+    extractCandidates(packed_, blobs_, &target_parts_, &rejected_targets_, filter);
+  } else {
+    extractCandidates(thresh_, contour_input_, &target_parts_, &rejected_targets_,
+                      filter);
+  }
+  // Blobs no enabled matcher could use are shown as rejected, and the parts
+  // the matchers build from several blobs are shown with the candidates
+  matchers_.filterShapes(enabled_matchers_, &target_parts_, &rejected_targets_);
+  timer_.mark(STAGE_BLOBS);
+  matchers_.match(enabled_matchers_, target_parts_, &targets_);
+  matchers_.appendGeneratedParts(enabled_matchers_, &target_parts_);
+  timer_.mark(STAGE_MATCH);
+}
+
+void VisionPipeline::showRawFrame() {
+  overlay_undo_.clear();
+  if (input_format_ == PIXEL_NV21) {
+    cv::cvtColor(input_, overlay_, CV_YUV2RGBA_NV21);
+    vis_ = overlay_;
+  } else {
+    vis_ = input_;
+  }
+}
+
+void VisionPipeline::renderVisualization() {
+  overlay_undo_.clear();
+  if (mode_ == DISP_MODE_THRESH) {
+    cv::cvtColor(thresh_, overlay_, CV_GRAY2RGBA);
+    vis_ = overlay_;
+  } else if (input_format_ == PIXEL_NV21) {
+    cv::cvtColor(input_, overlay_, CV_YUV2RGBA_NV21);
+    vis_ = overlay_;
+  } else if (!input_owned_ && mode_ != DISP_MODE_RAW) {
+    // Someone else's frame, possibly a read-only mapping: draw on a copy
+    input_.copyTo(overlay_);
+    vis_ = overlay_;
+  } else {
+    vis_ = input_;
+  }
+
+  // The recorder keeps input_, so it gets back the pixels under the overlays
+  if (recorder_ && input_owned_ && vis_.data == input_.data) {
+    if (mode_ == DISP_MODE_TARGETS || mode_ == DISP_MODE_TARGETS_PLUS) {
+      overlay_undo_.saveTargets(vis_, targets_);
+    }
+    if (mode_ == DISP_MODE_TARGETS_PLUS) {
+      overlay_undo_.saveCandidates(vis_, target_parts_, rejected_targets_);
+    }
+  }
+
+  // Render the targets
+  if (mode_ == DISP_MODE_THRESH) {
+    drawCandidates(vis_, target_parts_, rejected_targets_);
+    drawTargets(vis_, targets_);
+  } else if (mode_ == DISP_MODE_TARGETS) {
+    drawTargets(vis_, targets_);
+  } else if (mode_ == DISP_MODE_TARGETS_PLUS) {
+    drawTargets(vis_, targets_);
+    drawCandidates(vis_, target_parts_, rejected_targets_);
+  }
+}
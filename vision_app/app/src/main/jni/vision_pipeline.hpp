@@ -0,0 +1,206 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "flight_recorder.hpp"
+#include "frame_format.hpp"
+#include "hsv_threshold.hpp"
+#include "latency_governor.hpp"
+#include "mask_morphology.hpp"
+#include "packed_mask.hpp"
+#include "pipeline_config.hpp"
+#include "rle_mask.hpp"
+#include "stage_timer.hpp"
+#include "streaming_detector.hpp"
+#include "run_labeler.hpp"
+#include "target_drawing.hpp"
+#include "target_matcher.hpp"
+#include "targets.hpp"
+#include "tiled_extractor.hpp"
+
+enum DisplayMode {
+  DISP_MODE_RAW = 0,
+  DISP_MODE_THRESH = 1,
+  DISP_MODE_TARGETS = 2,
+  DISP_MODE_TARGETS_PLUS = 3
+};
+
+// How the threshold mask is turned into blobs
+enum BlobExtraction {
+  // Byte mask and findContours; the reference behavior
+  BLOB_CONTOURS = 0,
+  // Bit-packed mask, run extraction and a union-find labeler. Faster, but see
+  // run_labeler.hpp for where the results can differ.
+  BLOB_RUNS = 1,
+  // BLOB_RUNS with conversion, threshold, run extraction and labeling fused
+  // per strip and spread over cores (see tiled_extractor.hpp). RGBA input
+  // only; NV21 frames take the BLOB_RUNS path.
+  BLOB_TILED = 2
+};
+
+// Everything needed to turn one camera frame into targets. An instance owns
+// all of its buffers, configuration and scratch space, so separate instances
+// can run at the same time on different threads. A single instance must only
+// be used from one thread at a time.
+class VisionPipeline {
+ public:
+  VisionPipeline();
+  // Doesn't wait for a mask recording to finish writing
+  ~VisionPipeline();
+
+  // Detection parameters come from a ConfigChannel, read once at the start
+  // of each frame. By default the pipeline has its own; setConfigChannel()
+  // shares one another thread publishes to (nullptr goes back to its own).
+  // A channel has a single reader, so each pipeline needs a channel of its own.
+  void setConfigChannel(ConfigChannel *channel);
+  // Publish to the current channel; the next frame picks the change up
+  void setConfig(const PipelineConfig &config) { config_channel_->publish(config); }
+  void setThresholds(const HsvThresholds &thresholds);
+  // The snapshot the last frame used
+  const PipelineConfig &config() const { return *config_; }
+
+  void setDisplayMode(DisplayMode mode) { mode_ = mode; }
+  void setEnabledMatchers(int mask) { enabled_matchers_ = mask & kAllMatchers; }
+  void setBlobExtraction(BlobExtraction method) { blob_extraction_ = method; }
+  // Cleans up the threshold mask before blob extraction. Off by default.
+  void setMorphology(const MorphConfig &config) { morphology_ = config; }
+
+  // Per-frame time budget for the latency governor; 0 (the default) turns it
+  // off. While frames run over, the pipeline steps through GovernorLevels,
+  // shedding work until it is back under budget.
+  void setLatencyTarget(int64_t target_ns);
+  void configureGovernor(const GovernorConfig &config) { governor_.configure(config); }
+  // Runs every frame at one level, e.g. to measure what it costs in accuracy
+  void pinGovernorLevel(GovernorLevel level) { governor_.pin(level); }
+  // Level the last frame ran at, and frames over budget so far
+  GovernorLevel frameLevel() const { return frame_level_; }
+  // Whether the governor skipped the last frame. targets() etc. then still
+  // hold the results of the last frame that was processed.
+  bool frameSkipped() const { return frame_skipped_; }
+  int64_t budgetMisses() const { return governor_.misses(); }
+
+  // Stage durations of the last frame. Timing uses the given clock, which
+  // must outlive the pipeline; tests and simulations pass a ManualClock.
+  const StageTimer &stageTimer() const { return timer_; }
+  void setClock(Clock *clock) { timer_.setClock(clock); }
+  // Per-stage hardware counters in stageTimer(), for benchmarks; returns
+  // false if the kernel doesn't allow them. Call on the processing thread.
+  bool enablePerfCounters(bool enable) { return timer_.enableCounters(enable); }
+
+  // Keeps the last `frames` raw input frames in a flight recorder. Allocates
+  // the whole ring immediately.
+  void enableFlightRecorder(int width, int height, int frames);
+  FlightRecorder *flightRecorder() { return recorder_.get(); }
+
+  // Appends the threshold mask of every processed frame, run-length encoded,
+  // to a .vrle file until stopped
+  bool startMaskRecording(const std::string &path, int width, int height);
+  void stopMaskRecording();
+
+  // RGBA buffer the next frame should be written into
+  cv::Mat &inputBuffer(int width, int height);
+
+  // Uses an existing frame as the input without copying it, e.g. one mapped
+  // from a replay file. The frame must outlive the next process() call and is
+  // not passed to the flight recorder. It is never written to; modes that
+  // draw do so on a copy.
+  void setInput(const cv::Mat &frame, PixelFormat format);
+
+  // Runs detection on the frame in the input buffer and renders the
+  // visualization for the current display mode. timestamp_ns is the capture
+  // time, used only for recording.
+  const std::vector<TargetInfo> &process(int64_t timestamp_ns);
+
+  // Row-streaming alternative to process(): after inputBuffer(), fill its
+  // rows top to bottom and call rowsReady() for each batch. They are thresholded and
+  // labeled right away, so finishFrame() is left with only pairing and the
+  // visualization. Always uses the packed mask and run labeler (BLOB_RUNS),
+  // whatever setBlobExtraction() says.
+  void beginFrame(int64_t timestamp_ns);
+  void rowsReady(int first, int count);
+  const std::vector<TargetInfo> &finishFrame();
+
+  // Rows per batch for callers that can deliver the input in pieces, e.g.
+  // the GL readback. 0 means use process().
+  void setStreamingRows(int rows) { streaming_rows_ = rows; }
+  int streamingRows() const { return streaming_rows_; }
+
+  // Runs blob extraction and pairing on a recorded mask, skipping color
+  // conversion and thresholding. The visualization shows the mask.
+  const std::vector<TargetInfo> &processMask(const RleMask &mask);
+
+  const cv::Mat &visualization() const { return vis_; }
+  const std::vector<TargetInfo> &targets() const { return targets_; }
+  // Blobs from the last frame that passed / failed the size, fullness and
+  // shape filters; the candidates are followed by the parts the matchers
+  // built from split strips (isGeneratedPair)
+  const std::vector<TargetInfo> &candidates() const { return target_parts_; }
+  const std::vector<TargetInfo> &rejected() const { return rejected_targets_; }
+
+ private:
+  void acquireConfig();
+  void recordMask(int64_t timestamp_ns);
+  const std::vector<TargetInfo> &completeFrame(int64_t timestamp_ns,
+                                              double scale, cv::Point offset);
+  bool roiFromLastTargets(cv::Rect *roi) const;
+  void showRawFrame();
+  void cleanMask(bool visualize);
+  struct CleanPackedMask;
+  template <class Shape, class Visualize>
+  void cleanPackedMask(const Shape &shape, Visualize);
+  void findTargets(double scale);
+  void renderVisualization();
+
+  ConfigChannel own_config_;
+  ConfigChannel *config_channel_;
+  const PipelineConfig *config_;
+  uint64_t config_version_;
+  DisplayMode mode_;
+  int enabled_matchers_;
+  BlobExtraction blob_extraction_;
+  MorphConfig morphology_;
+
+  cv::Mat input_;
+  PixelFormat input_format_;
+  bool input_owned_;
+  cv::Mat hsv_;
+  cv::Mat thresh_;
+  cv::Mat contour_input_;
+  cv::Mat overlay_;
+  cv::Mat vis_;
+  // What the overlays covered on input_, for the flight recorder
+  OverlayUndo overlay_undo_;
+
+  // BLOB_RUNS / BLOB_TILED state
+  PackedMask packed_;
+  std::vector<MaskRun> runs_;
+  std::vector<Blob> blobs_;
+  RunLabeler labeler_;
+  TiledExtractor tiled_;
+  bool blobs_ready_;  // blobs_ already labeled this frame
+  bool packed_frame_;  // this frame went through packed_ rather than thresh_
+  StreamingDetector streaming_;
+  int streaming_rows_;
+  int64_t frame_timestamp_ns_;
+
+  StageTimer timer_;
+  LatencyGovernor governor_;
+  cv::Mat decimated_;
+  bool full_frame_;  // detection saw the whole input at full resolution
+  GovernorLevel frame_level_;
+  bool frame_skipped_;
+  PackedMorphology morphology_runner_;
+
+  std::vector<TargetInfo> targets_;
+  std::vector<TargetInfo> target_parts_;
+  std::vector<TargetInfo> rejected_targets_;
+
+  MatcherSet matchers_;
+
+  std::unique_ptr<FlightRecorder> recorder_;
+  std::unique_ptr<MaskRecorder> mask_recorder_;
+};
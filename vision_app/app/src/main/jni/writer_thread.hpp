@@ -0,0 +1,5 @@
+#pragma once
+
+// Nice value for the recorders' writer threads; compression and file I/O
+// must never compete with the vision thread for a core.
+static const int kWriterNice = 10;